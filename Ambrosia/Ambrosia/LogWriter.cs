@@ -386,10 +386,12 @@ namespace Ambrosia
         uint _allocations;
         uint _lastError;
 
+        // recordLog (the file holds log records) only matters to the native writer on Linux.
         public unsafe LogWriter(string fileName,
                                 uint chunkSize,
                                 uint maxChunksPerWrite,
-                                bool appendOpen = false)
+                                bool appendOpen = false,
+                                bool recordLog = false)
         {
             //Console.WriteLine("64-bitness: " + Environment.Is64BitProcess);
             _lastError = 0;
@@ -780,13 +782,19 @@ namespace Ambrosia
 #if NETCORE
     internal class LogWriter : IDisposable
     {
-        FileStream _logStream;
+        Stream _logStream;
+        // With recordLog (the file holds log records), an append continues after the last
+        // complete record, rather than at the end of the file, which after a crash may hold a
+        // torn write, block padding or preallocated space.
         public unsafe LogWriter(string fileName,
                                 uint chunkSize,
                                 uint maxChunksPerWrite,
-                                bool appendOpen = false)
+                                bool appendOpen = false,
+                                bool recordLog = false)
         {
-            _logStream = new FileStream(fileName, FileMode.OpenOrCreate, FileAccess.ReadWrite, FileShare.Read & ~FileShare.Inheritable);
+            // On Linux, AMBROSIA_NATIVE_LOG=1 selects the native direct I/O writer with group commit.
+            _logStream = (Stream)NativeLogStream.TryOpen(fileName, appendOpen, recordLog) ??
+                new FileStream(fileName, FileMode.OpenOrCreate, FileAccess.ReadWrite, FileShare.Read & ~FileShare.Inheritable);
             if (appendOpen)
             {
                 _logStream.Position = _logStream.Length;
@@ -814,11 +822,21 @@ namespace Ambrosia
         }
         public void WriteIntFixed(int value)
         {
+            if (_logStream is NativeLogStream nativeStream)
+            {
+                nativeStream.WriteFixed(value, 4);
+                return;
+            }
             _logStream.WriteIntFixed(value);
         }
 
         public void WriteLongFixed(long value)
         {
+            if (_logStream is NativeLogStream nativeStream)
+            {
+                nativeStream.WriteFixed(value, 8);
+                return;
+            }
             _logStream.WriteLongFixed(value);
         }
         public void Write(byte[] buffer,
@@ -878,10 +896,12 @@ namespace Ambrosia
 
         private ulong _fileSize = 0;
 
+        // recordLog (the file holds log records) only matters to the native writer on Linux.
         public LogWriter(string fileName,
                                 uint chunkSize,
                                 uint maxChunksPerWrite,
-                                bool appendOpen = false)
+                                bool appendOpen = false,
+                                bool recordLog = false)
         {
             InitializeAsync(fileName, appendOpen).Wait();
         }
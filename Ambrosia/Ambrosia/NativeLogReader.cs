@@ -0,0 +1,159 @@
+﻿#if NETCORE
+using System;
+using System.IO;
+using System.Runtime.InteropServices;
+
+namespace Ambrosia
+{
+    /// <summary>
+    /// Reads a log through the native mapped log reader in adv-file-ops (Linux). Records are
+    /// handed out in place, without copying, and a persisted seqID index (the log's file name
+    /// with ".idx" appended) lets Seek start anywhere in the log without scanning it.
+    /// </summary>
+    internal class NativeLogReader : IDisposable
+    {
+        const int ADV_LOGREAD_VERIFY = 1;
+
+        /// <summary>
+        /// A record, as a cursor. Payload and Watermarks point into the mapped log, and are
+        /// valid until the next Refresh or Dispose of the reader.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        public struct Record
+        {
+            public long Offset;
+            public long Next;
+            public long SeqID;
+            public long CheckBytes;
+            public IntPtr Payload;
+            public IntPtr Watermarks;
+            public int CommitID;
+            public int TotalSize;
+            public int PayloadSize;
+            public int WatermarksSize;
+
+            /// <summary>
+            /// The payload as a stream over the mapping.
+            /// </summary>
+            public unsafe UnmanagedMemoryStream PayloadStream()
+            {
+                return new UnmanagedMemoryStream((byte*)Payload, PayloadSize);
+            }
+
+            /// <summary>
+            /// The input and trim watermark lists that follow the payload, to read with
+            /// ReadInt/ReadLongFixed as replay does.
+            /// </summary>
+            public unsafe UnmanagedMemoryStream WatermarksStream()
+            {
+                return new UnmanagedMemoryStream((byte*)Watermarks, WatermarksSize);
+            }
+        }
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern IntPtr LogReaderOpen(ref string filename, int flags);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern long LogReaderRefresh(IntPtr reader);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern int LogReaderFirst(IntPtr reader, out Record rec);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern int LogReaderNext(IntPtr reader, ref Record rec);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern int LogReaderSeek(IntPtr reader, long seqID, out Record rec);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern long LogReaderEnd(IntPtr reader, out long nextSeqID);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern void LogReaderClose(IntPtr reader);
+
+        IntPtr _reader;
+
+        /// <summary>
+        /// Returns null if the native library is unavailable or the file could not be opened.
+        /// With verify, records whose payload fails its checksum end the log.
+        /// </summary>
+        public static NativeLogReader TryOpen(string fileName, bool verify)
+        {
+            if (!RuntimeInformation.IsOSPlatform(OSPlatform.Linux))
+            {
+                return null;
+            }
+            try
+            {
+                var name = fileName;
+                var reader = LogReaderOpen(ref name, verify ? ADV_LOGREAD_VERIFY : 0);
+                return reader == IntPtr.Zero ? null : new NativeLogReader(reader);
+            }
+            catch (DllNotFoundException)
+            {
+                return null;
+            }
+            catch (EntryPointNotFoundException)
+            {
+                return null;
+            }
+        }
+
+        NativeLogReader(IntPtr reader)
+        {
+            _reader = reader;
+        }
+
+        /// <summary>
+        /// Reads the first record. Returns false if the log is empty.
+        /// </summary>
+        public bool First(out Record rec)
+        {
+            return LogReaderFirst(_reader, out rec) != 0;
+        }
+
+        /// <summary>
+        /// Advances rec to the record after it. Returns false at the end of the log.
+        /// </summary>
+        public bool Next(ref Record rec)
+        {
+            return LogReaderNext(_reader, ref rec) != 0;
+        }
+
+        /// <summary>
+        /// Finds the record with seqID. Returns false if the log does not have it.
+        /// </summary>
+        public bool Seek(long seqID, out Record rec)
+        {
+            return LogReaderSeek(_reader, seqID, out rec) != 0;
+        }
+
+        /// <summary>
+        /// The offset just past the last record, and the seqID the next record would have
+        /// (-1 for an empty log).
+        /// </summary>
+        public long End(out long nextSeqID)
+        {
+            return LogReaderEnd(_reader, out nextSeqID);
+        }
+
+        /// <summary>
+        /// Maps what has been appended since the open or the last refresh. Records read
+        /// before are invalid afterwards.
+        /// </summary>
+        public long Refresh()
+        {
+            return LogReaderRefresh(_reader);
+        }
+
+        public void Dispose()
+        {
+            if (_reader != IntPtr.Zero)
+            {
+                LogReaderClose(_reader);
+                _reader = IntPtr.Zero;
+            }
+        }
+    }
+}
+#endif
@@ -0,0 +1,307 @@
+﻿#if NETCORE
+using System;
+using System.IO;
+using System.Runtime.InteropServices;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace Ambrosia
+{
+    /// <summary>
+    /// An append-only Stream over the native log writer in adv-file-ops (Linux).
+    /// Writes are buffered natively and written with direct I/O; Flush/FlushAsync
+    /// complete once the data is durable (fdatasync), with concurrent flushes
+    /// sharing one sync. Used by LogWriter when AMBROSIA_NATIVE_LOG=1.
+    /// </summary>
+    internal class NativeLogStream : Stream
+    {
+        const int ADV_LOG_APPEND = 1;
+        const int ADV_LOG_REUSE = 2;
+        const int ADV_LOG_APPEND_RECORDS = 3;
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        delegate void LogFileCallback(IntPtr context, long durable, int ok);
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern IntPtr LogFileOpen(ref string filename, int mode, long preallocSize, int bufferSize);
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern unsafe long LogFileAppend(IntPtr log, byte* buf, long len);
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern int LogFileFlush(IntPtr log, long upto);
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern int LogFileFlushAsync(IntPtr log, long upto, LogFileCallback callback, IntPtr context);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern long LogFileSize(IntPtr log);
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern int LogFileClose(IntPtr log);
+
+        // Kept alive for as long as native code may call it.
+        static readonly LogFileCallback _onFlushed = OnFlushed;
+
+        IntPtr _log;
+        readonly string _fileName;
+
+        /// <summary>
+        /// Returns null if the native library is unavailable or the file could not be opened.
+        /// Appending to a recordLog continues after its last complete record (see LogWriter).
+        /// </summary>
+        public static NativeLogStream TryOpen(string fileName, bool appendOpen, bool recordLog)
+        {
+            if (!RuntimeInformation.IsOSPlatform(OSPlatform.Linux) ||
+                Environment.GetEnvironmentVariable("AMBROSIA_NATIVE_LOG") != "1")
+            {
+                return null;
+            }
+            try
+            {
+                var name = fileName;
+                // Not appending: write from the start over whatever is there (like
+                // FileMode.OpenOrCreate), keeping a preallocated segment's extents.
+                var mode = !appendOpen ? ADV_LOG_REUSE : recordLog ? ADV_LOG_APPEND_RECORDS : ADV_LOG_APPEND;
+                var log = LogFileOpen(ref name, mode, 0, 0);
+                if (log == IntPtr.Zero)
+                {
+                    Console.WriteLine("WARNING: native log writer could not open {0}, using FileStream", fileName);
+                    return null;
+                }
+                return new NativeLogStream(log, fileName);
+            }
+            catch (DllNotFoundException)
+            {
+                Console.WriteLine("WARNING: AMBROSIA_NATIVE_LOG is set, but adv-file-ops is not installed; using FileStream");
+                return null;
+            }
+        }
+
+        NativeLogStream(IntPtr log, string fileName)
+        {
+            _log = log;
+            _fileName = fileName;
+        }
+
+        public override bool CanRead => false;
+        public override bool CanSeek => false;
+        public override bool CanWrite => true;
+        public override long Length => LogFileSize(_log);
+
+        public override long Position
+        {
+            get { return Length; }
+            set
+            {
+                if (value != Length)
+                {
+                    throw new NotSupportedException("NativeLogStream is append-only");
+                }
+            }
+        }
+
+        public override unsafe void Write(byte[] buffer, int offset, int count)
+        {
+            if (count == 0)
+            {
+                return;
+            }
+            fixed (byte* p = &buffer[offset])
+            {
+                if (LogFileAppend(_log, p, count) < 0)
+                {
+                    throw new IOException("Log write to " + _fileName + " failed, errno " + Marshal.GetLastWin32Error());
+                }
+            }
+        }
+
+        public override unsafe void WriteByte(byte value)
+        {
+            if (LogFileAppend(_log, &value, 1) < 0)
+            {
+                throw new IOException("Log write to " + _fileName + " failed, errno " + Marshal.GetLastWin32Error());
+            }
+        }
+
+        /// <summary>
+        /// Writes the low size bytes of value, little-endian, in one native append
+        /// rather than a call per byte.
+        /// </summary>
+        internal unsafe void WriteFixed(long value, int size)
+        {
+            if (LogFileAppend(_log, (byte*)&value, size) < 0)
+            {
+                throw new IOException("Log write to " + _fileName + " failed, errno " + Marshal.GetLastWin32Error());
+            }
+        }
+
+        public override Task WriteAsync(byte[] buffer, int offset, int count, CancellationToken cancellationToken)
+        {
+            // Appends only copy into the native buffer.
+            Write(buffer, offset, count);
+            return Task.CompletedTask;
+        }
+
+        public override void Flush()
+        {
+            if (LogFileFlush(_log, -1) == 0)
+            {
+                throw new IOException("Log flush of " + _fileName + " failed, errno " + Marshal.GetLastWin32Error());
+            }
+        }
+
+        public override Task FlushAsync(CancellationToken cancellationToken)
+        {
+            // Continuations must not run on the native I/O thread.
+            var tcs = new TaskCompletionSource<bool>(TaskCreationOptions.RunContinuationsAsynchronously);
+            var handle = GCHandle.Alloc(tcs);
+            if (LogFileFlushAsync(_log, -1, _onFlushed, GCHandle.ToIntPtr(handle)) == 0)
+            {
+                handle.Free();
+                throw new IOException("Log flush of " + _fileName + " failed, errno " + Marshal.GetLastWin32Error());
+            }
+            return tcs.Task;
+        }
+
+        static void OnFlushed(IntPtr context, long durable, int ok)
+        {
+            var handle = GCHandle.FromIntPtr(context);
+            var tcs = (TaskCompletionSource<bool>)handle.Target;
+            handle.Free();
+            if (ok != 0)
+            {
+                tcs.TrySetResult(true);
+            }
+            else
+            {
+                tcs.TrySetException(new IOException("Log flush failed"));
+            }
+        }
+
+        public override int Read(byte[] buffer, int offset, int count)
+        {
+            throw new NotSupportedException("NativeLogStream is write-only");
+        }
+
+        public override long Seek(long offset, SeekOrigin origin)
+        {
+            throw new NotSupportedException("NativeLogStream is append-only");
+        }
+
+        public override void SetLength(long value)
+        {
+            throw new NotSupportedException("NativeLogStream is append-only");
+        }
+
+        protected override void Dispose(bool disposing)
+        {
+            if (_log != IntPtr.Zero)
+            {
+                var log = _log;
+                _log = IntPtr.Zero;
+                if (LogFileClose(log) == 0)
+                {
+                    Console.WriteLine("WARNING: closing log {0} failed", _fileName);
+                }
+            }
+            base.Dispose(disposing);
+        }
+    }
+
+    /// <summary>
+    /// The native segment manager in adv-file-ops (Linux): keeps preallocated log files ready,
+    /// so that a log rollover is a rename, and recycles old files into them. Enabled with the
+    /// native log writer (AMBROSIA_NATIVE_LOG=1). AMBROSIA_LOG_SEGMENT_MB sets the segment size
+    /// (default 64) and AMBROSIA_LOG_SPARE_SEGMENTS the number kept ready (default 2).
+    /// </summary>
+    internal class NativeLogSegments : IDisposable
+    {
+        const int ADV_PREZERO = 1;
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern IntPtr SegmentManagerCreate(ref string prefix, long segmentSize, int spares, int flags);
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern int SegmentManagerTake(IntPtr mgr, ref string path, int wait);
+
+        [DllImport("adv-file-ops.dll", SetLastError = true)]
+        static extern int SegmentManagerRecycle(IntPtr mgr, ref string path);
+
+        [DllImport("adv-file-ops.dll")]
+        static extern void SegmentManagerDestroy(IntPtr mgr);
+
+        IntPtr _mgr;
+
+        public string Prefix { get; }
+
+        /// <summary>
+        /// Returns null unless the native log writer is enabled and available.
+        /// </summary>
+        public static NativeLogSegments TryCreate(string prefix)
+        {
+            if (!RuntimeInformation.IsOSPlatform(OSPlatform.Linux) ||
+                Environment.GetEnvironmentVariable("AMBROSIA_NATIVE_LOG") != "1")
+            {
+                return null;
+            }
+            long segmentMB;
+            if (!long.TryParse(Environment.GetEnvironmentVariable("AMBROSIA_LOG_SEGMENT_MB"), out segmentMB) || segmentMB <= 0)
+            {
+                segmentMB = 64;
+            }
+            int spares;
+            if (!int.TryParse(Environment.GetEnvironmentVariable("AMBROSIA_LOG_SPARE_SEGMENTS"), out spares) || spares < 0)
+            {
+                spares = 2;
+            }
+            var flags = Environment.GetEnvironmentVariable("AMBROSIA_LOG_PREZERO") == "1" ? ADV_PREZERO : 0;
+            try
+            {
+                var name = prefix;
+                var mgr = SegmentManagerCreate(ref name, segmentMB * 1024 * 1024, spares, flags);
+                return mgr == IntPtr.Zero ? null : new NativeLogSegments(mgr, prefix);
+            }
+            catch (DllNotFoundException)
+            {
+                return null;
+            }
+        }
+
+        NativeLogSegments(IntPtr mgr, string prefix)
+        {
+            _mgr = mgr;
+            Prefix = prefix;
+        }
+
+        /// <summary>
+        /// Moves a ready segment to path. Returns false if none was ready, in which case
+        /// the log file is created as usual.
+        /// </summary>
+        public bool Take(string path)
+        {
+            return SegmentManagerTake(_mgr, ref path, 0) != 0;
+        }
+
+        /// <summary>
+        /// Recycles the file at path into a spare segment (or deletes it, if enough are ready).
+        /// </summary>
+        public void Recycle(string path)
+        {
+            if (SegmentManagerRecycle(_mgr, ref path) == 0)
+            {
+                File.Delete(path);
+            }
+        }
+
+        public void Dispose()
+        {
+            if (_mgr != IntPtr.Zero)
+            {
+                SegmentManagerDestroy(_mgr);
+                _mgr = IntPtr.Zero;
+            }
+        }
+    }
+}
+#endif
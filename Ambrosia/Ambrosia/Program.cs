@@ -1318,127 +1318,95 @@ namespace Ambrosia
                 await TryCommitAsync(this._myAmbrosia._outputs);
             }
 
-            byte[] _checkTempBytes = new byte[8];
-            byte[] _checkTempBytes2 = new byte[8];
+            // Checksums at least this long are computed by the vectorized CheckBytes in
+            // adv-file-ops; below it the call costs more than it saves.
+            const int NativeCheckBytesMinLength = 256;
 
-            internal unsafe long CheckBytesExtra(int offset,
-                                                 int length,
-                                                 byte[] extraBytes,
-                                                 int extraLength)
+            [DllImport("adv-file-ops.dll", EntryPoint = "CheckBytes")]
+            static extern unsafe long NativeCheckBytes(byte* buf, long len);
+
+            [DllImport("adv-file-ops.dll", EntryPoint = "CheckBytes2")]
+            static extern unsafe long NativeCheckBytes2(byte* first, long firstLen, byte* second, long secondLen);
+
+            static readonly bool _nativeCheckBytes = NativeCheckBytesAvailable();
+
+            static unsafe bool NativeCheckBytesAvailable()
             {
-                var firstBufferCheck = CheckBytes(offset, length);
-                var secondBufferCheck = CheckBytes(extraBytes, 0, extraLength);
-                long shiftedSecondBuffer = secondBufferCheck;
-                var lastByteLongOffset = length % 8;
-                if (lastByteLongOffset != 0)
+                try
                 {
-                    fixed (byte* p = _checkTempBytes)
-                    {
-                        *((long*)p) = secondBufferCheck;
-                    }
-                    // Create new buffer with circularly shifted secondBufferCheck
-                    for (int i = 0; i < 8; i++)
-                    {
-                        _checkTempBytes2[i] = _checkTempBytes[(i - lastByteLongOffset + 8) % 8];
-                    }
-                    fixed (byte* p = _checkTempBytes2)
-                    {
-                        shiftedSecondBuffer = *((long*)p);
-                    }
+                    byte b = 0;
+                    NativeCheckBytes(&b, 1);
+                    return true;
+                }
+                catch (DllNotFoundException)
+                {
+                    return false;
+                }
+                catch (EntryPointNotFoundException)
+                {
+                    // An adv-file-ops from before CheckBytes was added
+                    return false;
                 }
-                return firstBufferCheck ^ shiftedSecondBuffer;
             }
 
-            internal unsafe long CheckBytes(int offset,
-                                            int length)
+            // The XOR of the bytes as little-endian longs, the last one zero padded. p may have any alignment.
+            static unsafe long ManagedCheckBytes(byte* p, int length)
             {
                 long checkBytes = 0;
+                int numLongCalcs = length / 8;
+                long* longPtr = (long*)p;
+                for (int i = 0; i < numLongCalcs; i++)
+                {
+                    checkBytes ^= longPtr[i];
+                }
+                var lastBytes = (byte*)(longPtr + numLongCalcs);
+                for (int i = 0; i < length % 8; i++)
+                {
+                    checkBytes ^= (long)lastBytes[i] << (8 * i);
+                }
+                return checkBytes;
+            }
 
+            internal unsafe long CheckBytesExtra(int offset,
+                                                 int length,
+                                                 byte[] extraBytes,
+                                                 int extraLength)
+            {
                 fixed (byte* p = _buf)
+                fixed (byte* p2 = extraBytes)
                 {
-                    if (offset % 8 == 0)
+                    if (_nativeCheckBytes && length + extraLength >= NativeCheckBytesMinLength)
                     {
-                        int startLongCalc = offset / 8;
-                        int numLongCalcs = length / 8;
-                        int numByteCalcs = length % 8;
-                        long* longPtr = ((long*)p) + startLongCalc;
-                        for (int i = 0; i < numLongCalcs; i++)
-                        {
-                            checkBytes ^= longPtr[i];
-                        }
-                        if (numByteCalcs != 0)
-                        {
-                            var lastBytes = (byte*)(longPtr + numLongCalcs);
-                            for (int i = 0; i < 8; i++)
-                            {
-                                if (i < numByteCalcs)
-                                {
-                                    _checkTempBytes[i] = lastBytes[i];
-                                }
-                                else
-                                {
-                                    _checkTempBytes[i] = 0;
-                                }
-                            }
-                            fixed (byte* p2 = _checkTempBytes)
-                            {
-                                checkBytes ^= *((long*)p2);
-                            }
-                        }
-                    }
-                    else
-                    {
-                        _myAmbrosia.OnError(0, "checkbytes case not implemented");
+                        return NativeCheckBytes2(p + offset, length, p2, extraLength);
                     }
+                    var firstBufferCheck = ManagedCheckBytes(p + offset, length);
+                    var secondBufferCheck = ManagedCheckBytes(p2, extraLength);
+                    // The second buffer continues the first, so rotate its check bytes by the first's length
+                    var shift = 8 * (length % 8);
+                    var shiftedSecondBuffer = shift == 0 ? secondBufferCheck :
+                        (long)(((ulong)secondBufferCheck << shift) | ((ulong)secondBufferCheck >> (64 - shift)));
+                    return firstBufferCheck ^ shiftedSecondBuffer;
                 }
-                return checkBytes;
             }
 
+            internal long CheckBytes(int offset,
+                                     int length)
+            {
+                return CheckBytes(_buf, offset, length);
+            }
 
             internal unsafe long CheckBytes(byte[] bufToCalc,
                                             int offset,
                                             int length)
             {
-                long checkBytes = 0;
-
                 fixed (byte* p = bufToCalc)
                 {
-                    if (offset % 8 == 0)
+                    if (_nativeCheckBytes && length >= NativeCheckBytesMinLength)
                     {
-                        int startLongCalc = offset / 8;
-                        int numLongCalcs = length / 8;
-                        int numByteCalcs = length % 8;
-                        long* longPtr = ((long*)p) + startLongCalc;
-                        for (int i = 0; i < numLongCalcs; i++)
-                        {
-                            checkBytes ^= longPtr[i];
-                        }
-                        if (numByteCalcs != 0)
-                        {
-                            var lastBytes = (byte*)(longPtr + numLongCalcs);
-                            for (int i = 0; i < 8; i++)
-                            {
-                                if (i < numByteCalcs)
-                                {
-                                    _checkTempBytes[i] = lastBytes[i];
-                                }
-                                else
-                                {
-                                    _checkTempBytes[i] = 0;
-                                }
-                            }
-                            fixed (byte* p2 = _checkTempBytes)
-                            {
-                                checkBytes ^= *((long*)p2);
-                            }
-                        }
-                    }
-                    else
-                    {
-                        _myAmbrosia.OnError(0, "checkbytes case not implemented 2");
+                        return NativeCheckBytes(p + offset, length);
                     }
+                    return ManagedCheckBytes(p + offset, length);
                 }
-                return checkBytes;
             }
 
 
@@ -1846,6 +1814,9 @@ namespace Ambrosia
         internal string _serviceName;  // specifiable on the command line
         internal string _serviceLogPath;
         internal string _logFileNameBase;
+#if NETCORE
+        NativeLogSegments _logSegments;  // Preallocated log files, with the native log writer
+#endif
         public const string AmbrosiaDataInputsName = "Ambrosiadatain";
         public const string AmbrosiaControlInputsName = "Ambrosiacontrolin";
         public const string AmbrosiaDataOutputsName = "Ambrosiadataout";
@@ -2196,6 +2167,15 @@ namespace Ambrosia
             {
                 File.Delete(_logFileNameBase + "log" + (_lastLogFile + 1).ToString());
             }
+#if NETCORE
+            // Use a preallocated segment if one is ready, rather than allocating at rollover
+            if (_logSegments == null || _logSegments.Prefix != _logFileNameBase)
+            {
+                _logSegments?.Dispose();
+                _logSegments = NativeLogSegments.TryCreate(_logFileNameBase);
+            }
+            _logSegments?.Take(_logFileNameBase + "log" + (_lastLogFile + 1).ToString());
+#endif
             LogWriter retVal = null;
             try
             {
@@ -2276,7 +2256,7 @@ namespace Ambrosia
                 {
                     var oldLastLogFile = _lastLogFile;
                     // Compete for log write permission - non destructive open for write - open for append
-                    var lastLogFileStream = new LogWriter(_logFileNameBase + "log" + (oldLastLogFile).ToString(), 1024 * 1024, 6, true);
+                    var lastLogFileStream = new LogWriter(_logFileNameBase + "log" + (oldLastLogFile).ToString(), 1024 * 1024, 6, true, true);
                     if (long.Parse(RetrieveServiceInfo("LastLogFile")) != oldLastLogFile)
                     {
                         // We got an old log. Try again
@@ -3277,6 +3257,13 @@ namespace Ambrosia
             var fileNameToDelete = _logFileNameBase + (_lastCommittedCheckpoint - 1).ToString();
             if (LogWriter.FileExists(fileNameToDelete))
             {
+#if NETCORE
+                if (_logSegments != null)
+                {
+                    _logSegments.Recycle(fileNameToDelete);
+                    return;
+                }
+#endif
                 File.Delete(fileNameToDelete);
             }
         }
@@ -0,0 +1,288 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// The Linux build of adv-file-ops.  See adv-file-ops.h for the ABI.
+//
+// On Windows, CreateAndSetFileSize preallocates the log with
+// SetFileValidData, so appends never pay for block allocation or for
+// zero-filling.  Here fallocate plays the same part.  It allocates the
+// extents up front but marks them unwritten, so the first write to each
+// one still converts it, which is a (much smaller) metadata update.  With
+// ADV_PREZERO the extents are written with zeros once, at creation, and
+// appends are then pure overwrites.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT, fallocate, statx
+#endif
+
+#include "adv-file-ops.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+static const int64_t kZeroChunk = 1 << 20;
+
+static std::string FormatErrno(int err) {
+	return std::string(strerror(err)) + " (errno " + std::to_string(err) + ")";
+}
+
+static bool EnvPrezero() {
+	const char* v = getenv("AMBROSIA_LOG_PREZERO");
+	return v != nullptr && atoi(v) == 1;
+}
+
+// Write the whole buffer at the offset, retrying short writes.
+static bool PwriteAll(int fd, const char* buf, int64_t len, int64_t offset) {
+	while (len > 0) {
+		ssize_t n = pwrite(fd, buf, (size_t)len, (off_t)offset);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		buf += n; len -= n; offset += n;
+	}
+	return true;
+}
+
+// Overwrite [from, to) with zeros.  from is block aligned.  A descriptor
+// opened with O_DIRECT is written directly, apart from an unaligned tail,
+// for which O_DIRECT is switched off for the one write.
+static bool ZeroRange(int fd, int64_t from, int64_t to) {
+	int64_t block = GetLogicalBlockSize(fd);
+	void* zeros = nullptr;
+	if (posix_memalign(&zeros, (size_t)(block > 4096 ? block : 4096), (size_t)kZeroChunk) != 0) {
+		errno = ENOMEM;
+		return false;
+	}
+	memset(zeros, 0, (size_t)kZeroChunk);
+
+	int fl = fcntl(fd, F_GETFL);
+	bool ok = true;
+	for (int64_t pos = from; ok && pos < to; ) {
+		int64_t len = to - pos < kZeroChunk ? to - pos : kZeroChunk;
+		if ((fl & O_DIRECT) && len % block != 0) {
+			int64_t aligned = len - len % block;
+			if (aligned > 0) ok = PwriteAll(fd, (const char*)zeros, aligned, pos);
+			if (ok) {
+				fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+				ok = PwriteAll(fd, (const char*)zeros, len - aligned, pos + aligned);
+				int err = errno;
+				fcntl(fd, F_SETFL, fl);
+				errno = err;
+			}
+		} else {
+			ok = PwriteAll(fd, (const char*)zeros, len, pos);
+		}
+		pos += len;
+	}
+	int err = errno;
+	free(zeros);
+	errno = err;
+	if (ok && fdatasync(fd) != 0) ok = false;
+	return ok;
+}
+
+extern "C"
+int EnableProcessPrivileges() {
+	return 1;
+}
+
+extern "C"
+int EnableVolumePrivileges(const char** filename, intptr_t fd)
+{
+	(void)filename; (void)fd;
+	return 1;
+}
+
+extern "C"
+int SetFileSizeEx(intptr_t fd, int64_t file_size, int flags)
+{
+	struct stat st;
+	if (fstat((int)fd, &st) != 0) {
+		std::cerr << "fstat failed with error: " << FormatErrno(errno) << std::endl;
+		return 0;
+	}
+	int64_t old_size = st.st_size;
+
+	if (flags & ADV_KEEP_SIZE) {
+		// Allocate only; st_size stays the length actually written.
+		if (file_size > old_size &&
+			fallocate((int)fd, FALLOC_FL_KEEP_SIZE, (off_t)old_size, (off_t)(file_size - old_size)) != 0 &&
+			errno != EOPNOTSUPP && errno != ENOSYS) {
+			std::cerr << "fallocate failed with error: " << FormatErrno(errno) << std::endl;
+			return 0;
+		}
+		return 1;
+	}
+
+	if (file_size <= old_size) {
+		if (file_size < old_size && ftruncate((int)fd, (off_t)file_size) != 0) {
+			std::cerr << "ftruncate failed with error: " << FormatErrno(errno) << std::endl;
+			return 0;
+		}
+		return 1;
+	}
+
+	if (fallocate((int)fd, 0, (off_t)old_size, (off_t)(file_size - old_size)) != 0) {
+		if (errno != EOPNOTSUPP && errno != ENOSYS) {
+			std::cerr << "fallocate failed with error: " << FormatErrno(errno) << std::endl;
+			return 0;
+		}
+		// Not supported by the filesystem: glibc emulates it by touching
+		// every block.
+		int err = posix_fallocate((int)fd, (off_t)old_size, (off_t)(file_size - old_size));
+		if (err != 0) {
+			std::cerr << "posix_fallocate failed with error: " << FormatErrno(err) << std::endl;
+			errno = err;
+			return 0;
+		}
+	}
+
+	if (flags & ADV_PREZERO) {
+		// The block holding the old end of file is already written.
+		int64_t block = GetLogicalBlockSize(fd);
+		int64_t from = (old_size + block - 1) / block * block;
+		if (from < file_size && !ZeroRange((int)fd, from, file_size)) {
+			std::cerr << "Pre-zeroing failed with error: " << FormatErrno(errno) << std::endl;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+extern "C"
+int SetFileSize(intptr_t fd, int64_t file_size)
+{
+	return SetFileSizeEx(fd, file_size, EnvPrezero() ? ADV_PREZERO : 0);
+}
+
+static int OpenDirect(const char* filename, int extra_flags) {
+	int fd = open(filename, O_RDWR | O_CLOEXEC | O_DIRECT | extra_flags, 0644);
+	if (fd < 0 && errno == EINVAL)
+		fd = open(filename, O_RDWR | O_CLOEXEC | extra_flags, 0644);
+	return fd;
+}
+
+extern "C"
+intptr_t OpenFileDirect(const char** filename, int create)
+{
+	int fd = OpenDirect(*filename, create ? O_CREAT : 0);
+	if (fd < 0)
+		std::cerr << "open file (" << *filename << ") failed with error: " << FormatErrno(errno) << std::endl;
+	return fd;
+}
+
+extern "C"
+int CreateAndSetFileSizeEx(const char** filename, int64_t file_size, int flags)
+{
+	int fd = OpenDirect(*filename, O_CREAT | O_TRUNC);
+	if (fd < 0) {
+		std::cerr << "write file (" << *filename << ") not created. Error: " << FormatErrno(errno) << std::endl;
+		return 0;
+	}
+
+	int result = SetFileSizeEx(fd, file_size, flags);
+	if (!result) {
+		int err = errno;
+		std::cerr << "SetFileSize failed with error: " << FormatErrno(err) << std::endl;
+		close(fd);
+		errno = err;
+		return 0;
+	}
+
+	close(fd);
+	return 1;
+}
+
+extern "C"
+int CreateAndSetFileSize(const char** filename, int64_t file_size)
+{
+	return CreateAndSetFileSizeEx(filename, file_size, EnvPrezero() ? ADV_PREZERO : 0);
+}
+
+extern "C"
+int ZeroFileRange(intptr_t fd, int64_t from, int64_t to, int flags)
+{
+	if (to <= from) return 1;
+	if (flags & ADV_PREZERO) {
+		int64_t block = GetLogicalBlockSize(fd);
+		if (from % block != 0) {
+			errno = EINVAL;
+			return 0;
+		}
+		if (!ZeroRange((int)fd, from, to)) {
+			std::cerr << "Zeroing failed with error: " << FormatErrno(errno) << std::endl;
+			return 0;
+		}
+		return 1;
+	}
+	// Convert the range back to allocated-but-unwritten extents.
+	if (fallocate((int)fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, (off_t)from, (off_t)(to - from)) == 0)
+		return 1;
+	if (errno != EOPNOTSUPP) {
+		std::cerr << "fallocate(ZERO_RANGE) failed with error: " << FormatErrno(errno) << std::endl;
+		return 0;
+	}
+	// No ZERO_RANGE: punch the range out and allocate it again.
+	if (fallocate((int)fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)from, (off_t)(to - from)) == 0) {
+		int err = posix_fallocate((int)fd, (off_t)from, (off_t)(to - from));
+		if (err == 0) return 1;
+		errno = err;
+	}
+	if (errno != EOPNOTSUPP) {
+		std::cerr << "Hole punching failed with error: " << FormatErrno(errno) << std::endl;
+		return 0;
+	}
+	if (!ZeroRange((int)fd, from, to)) {
+		std::cerr << "Zeroing failed with error: " << FormatErrno(errno) << std::endl;
+		return 0;
+	}
+	return 1;
+}
+
+extern "C"
+int64_t GetLogicalBlockSize(intptr_t fd)
+{
+	struct stat st;
+	if (fstat((int)fd, &st) != 0) return 512;
+
+	// A raw block device answers directly.
+	if (S_ISBLK(st.st_mode)) {
+		int size = 0;
+		if (ioctl((int)fd, BLKSSZGET, &size) == 0 && size > 0) return size;
+		return 512;
+	}
+
+	// Linux 6.1+ reports the direct I/O alignment for the file itself.
+#ifdef STATX_DIOALIGN
+	struct statx stx;
+	if (statx((int)fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+		(stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align > 0) {
+		return stx.stx_dio_offset_align > stx.stx_dio_mem_align ?
+			stx.stx_dio_offset_align : stx.stx_dio_mem_align;
+	}
+#endif
+
+	// Otherwise ask sysfs about the device holding the file.
+	std::string path = "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" +
+		std::to_string(minor(st.st_dev)) + "/queue/logical_block_size";
+	std::ifstream in(path);
+	int64_t size = 0;
+	if (!(in >> size)) {
+		// A partition keeps its queue/ in the parent device's directory.
+		std::ifstream parent("/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" +
+			std::to_string(minor(st.st_dev)) + "/../queue/logical_block_size");
+		if (!(parent >> size)) size = 0;
+	}
+	return size > 0 ? size : 512;
+}
@@ -0,0 +1,302 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// The C ABI of the Linux build of adv-file-ops (libadv-file-ops.so).
+//
+// The entry points mirror the Windows DLL, so the [DllImport] declarations
+// in Native32.cs bind to either one:
+//
+//   - A C# `ref string` arrives as a pointer to a NUL-terminated UTF-8
+//     string, i.e. `const char**`.
+//   - A SafeFileHandle arrives as its handle value, which on Linux is the
+//     file descriptor.
+//   - A C# `bool` return is marshaled as a 4-byte BOOL, so the functions
+//     return int: nonzero for success.  On failure errno is preserved
+//     (SetLastError = true picks it up) and a message goes to stderr.
+
+#ifndef ADV_FILE_OPS_HEADER
+#define ADV_FILE_OPS_HEADER
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Flags for the *Ex variants.
+#define ADV_PREZERO   0x1  // Write zeros over the new extents, rather than
+                           // leaving them allocated but unwritten.
+#define ADV_KEEP_SIZE 0x2  // Allocate the extents without changing the
+                           // file's size (FALLOC_FL_KEEP_SIZE), so that
+                           // the size stays the length written.  Never
+                           // shrinks; ADV_PREZERO is ignored.
+
+// Volume privileges are a Windows concept: SetFileValidData is what
+// needs them.  Both succeed and do nothing.
+int EnableProcessPrivileges();
+int EnableVolumePrivileges(const char** filename, intptr_t fd);
+
+// Set the file's size.  Growing the file allocates its blocks with
+// fallocate (or posix_fallocate where the filesystem lacks it), so that
+// later appends into the range need no allocation or size update.
+// Shrinking it truncates.  SetFileSize pre-zeroes when the environment
+// variable AMBROSIA_LOG_PREZERO is set to 1.
+int SetFileSize(intptr_t fd, int64_t file_size);
+int SetFileSizeEx(intptr_t fd, int64_t file_size, int flags);
+
+// Create (or truncate) the file, opened for direct I/O, and set its size
+// as above.
+int CreateAndSetFileSize(const char** filename, int64_t file_size);
+int CreateAndSetFileSizeEx(const char** filename, int64_t file_size, int flags);
+
+// Open the file for reading and writing with O_DIRECT, creating it if
+// create is nonzero.  On a filesystem that refuses O_DIRECT (tmpfs, for
+// example) it is opened buffered instead.
+// RETURN: the file descriptor, or -1.
+intptr_t OpenFileDirect(const char** filename, int create);
+
+// The alignment that direct I/O on the file requires, for offsets,
+// lengths and buffer addresses alike: the device's logical block size.
+// RETURN: the size in bytes; 512 if it cannot be determined.
+int64_t GetLogicalBlockSize(intptr_t fd);
+
+// Make [from, to) read as zeros while keeping its blocks allocated
+// (FALLOC_FL_ZERO_RANGE, or a hole punch and reallocation).  With
+// ADV_PREZERO, zeros are written instead; from must then be block
+// aligned.  RETURN: nonzero, or 0 on failure.
+int ZeroFileRange(intptr_t fd, int64_t from, int64_t to, int flags);
+
+// ----------------------------------------------------------------------------
+// Log files: asynchronous appends with group commit (log-writer-linux.cpp)
+// ----------------------------------------------------------------------------
+
+// A log is an intptr_t handle (IntPtr in C#).  Any number of threads may
+// append and flush concurrently.  Appends are copied and return at once.
+// A background I/O thread writes them with direct I/O, through io_uring
+// where the kernel allows it.  All the flushes waiting when a sync starts
+// are served by that one fdatasync.
+
+// Called on the log's I/O thread once the log is durable up to the
+// requested offset (ok = 1), or has failed (ok = 0).  It must not block,
+// or call back into the log.
+typedef void (*LogFileCallback)(intptr_t context, int64_t durable, int ok);
+
+// LogFileOpen modes.  The file is created if it does not exist.
+#define ADV_LOG_TRUNCATE       0  // Start empty.
+#define ADV_LOG_APPEND         1  // Continue from the file's size.  Only
+                                  // right for a file that was closed with
+                                  // LogFileClose: until then the size may
+                                  // include block padding or preallocation.
+#define ADV_LOG_REUSE          2  // Write from the start over the existing,
+                                  // already allocated contents (e.g. a
+                                  // segment from SegmentManagerTake);
+                                  // trimmed at close.
+#define ADV_LOG_APPEND_RECORDS 3  // The file is a log of coordinator
+                                  // records: continue after the last
+                                  // complete one, with valid checksum, and
+                                  // zero whatever follows it.  Right after a
+                                  // crash, too.
+
+// Open a log for appending, in one of the modes above.  prealloc_size
+// allocates that much of the file ahead, without changing its size
+// (ADV_KEEP_SIZE; 0 for none).  buffer_size is the bytes buffered per
+// flush round (0 for the default, 4 MiB).
+// RETURN: the handle, or 0.
+intptr_t LogFileOpen(const char** filename, int mode, int64_t prealloc_size, int32_t buffer_size);
+
+// Append len bytes.  Blocks only while both buffers are full.
+// RETURN: the log's logical size after this append, which is the offset
+// to flush up to to make it durable; or -1 once a write has failed.
+int64_t LogFileAppend(intptr_t log, const void* buf, int64_t len);
+
+// Wait until the log is durable up to upto (all appends so far, if
+// negative).  RETURN: nonzero, or 0 if a write failed.
+int LogFileFlush(intptr_t log, int64_t upto);
+
+// As LogFileFlush, but return at once and call callback(context, ...)
+// when done.  RETURN: 0 if the log has already failed (no callback).
+int LogFileFlushAsync(intptr_t log, int64_t upto, LogFileCallback callback, intptr_t context);
+
+// The logical size (everything appended) and the durable size.
+int64_t LogFileSize(intptr_t log);
+int64_t LogFileDurable(intptr_t log);
+
+// Flush requests received and syncs performed; their ratio is the
+// commit group size.  using_io_uring reports the I/O path in use: 0 for
+// pwrite, 1 for io_uring, 2 for io_uring with registered buffers.
+void LogFileGetStats(intptr_t log, int64_t* flushes, int64_t* syncs, int* using_io_uring);
+
+// Flush everything, trim the file to its logical size and close it.
+// The handle is invalid afterwards.  RETURN: nonzero, or 0 on failure.
+int LogFileClose(intptr_t log);
+
+// ----------------------------------------------------------------------------
+// Log reading: mapped records and a seqID index (log-reader-linux.cpp)
+// ----------------------------------------------------------------------------
+
+// A log file is a series of records, each a 24-byte header:
+//
+//   int32 commitID, int32 totalSize, int64 checksum, int64 seqID
+//
+// then totalSize - 24 bytes of payload (checksum is CheckBytes of them),
+// then the input and trim watermark lists the committer appends.  seqIDs
+// go up by one from record to record.  The log ends at the first record
+// that is incomplete, or out of sequence: a torn write, or the zeros of
+// a preallocated segment.
+//
+// A reader maps the file and hands out records in place, without
+// copying.  It also keeps a sparse index from seqID to offset (one entry
+// per MiB of log), which it saves next to the log as <filename>.idx and
+// reuses if it still matches the log.  Use a reader from one thread at a
+// time.
+
+// A record, as a cursor.  The pointers are into the mapping, and valid
+// until the next LogReaderRefresh or LogReaderClose.
+typedef struct AdvLogRecord {
+	int64_t offset;           // Of the header in the file.
+	int64_t next;             // Offset of the record after it.
+	int64_t seq_id;
+	int64_t checksum;
+	const void* payload;
+	const void* watermarks;   // The watermark lists, as written.
+	int32_t commit_id;
+	int32_t total_size;       // Header and payload.
+	int32_t payload_size;
+	int32_t watermarks_size;
+} AdvLogRecord;
+
+// LogReaderOpen flags.
+#define ADV_LOGREAD_VERIFY   0x1  // Check payload checksums; a mismatch
+                                  // ends the log.  (Records covered by a
+                                  // loaded index are not checked again.)
+#define ADV_LOGREAD_NO_INDEX 0x2  // Neither load nor save <filename>.idx.
+
+// Open and map a log read-only.  RETURN: the handle, or 0.
+intptr_t LogReaderOpen(const char** filename, int flags);
+
+// Map whatever has been appended since the open or the last refresh.
+// Any AdvLogRecord from before is invalid afterwards.  A log that is
+// still being written is only safe to read if its writer never shrinks
+// it (ADV_LOG_REUSE trims the file at LogFileClose).
+// RETURN: the mapped size.
+int64_t LogReaderRefresh(intptr_t reader);
+
+// The bytes mapped, which may run past the end of the log.
+int64_t LogReaderSize(intptr_t reader);
+
+// Read the first record, the one after *rec, or the one at offset into
+// *rec.  RETURN: nonzero, or 0 at the end of the log.
+int LogReaderFirst(intptr_t reader, AdvLogRecord* rec);
+int LogReaderNext(intptr_t reader, AdvLogRecord* rec);
+int LogReaderRecordAt(intptr_t reader, int64_t offset, AdvLogRecord* rec);
+
+// Find the record with seq_id, through the index, extending it as
+// needed.  RETURN: nonzero, or 0 if the log has no such record.
+int LogReaderSeek(intptr_t reader, int64_t seq_id, AdvLogRecord* rec);
+
+// The offset just past the last record of the log (where a writer would
+// continue it), and the seqID the next record would have (-1 for an
+// empty log).  Indexes the whole log.
+int64_t LogReaderEnd(intptr_t reader, int64_t* next_seq_id);
+
+// Index entries, and the offset up to which the log is indexed.
+void LogReaderIndexStats(intptr_t reader, int64_t* entries, int64_t* indexed_to);
+
+// Write <filename>.idx now.  LogReaderClose does it too, if the index
+// has grown.  RETURN: nonzero, or 0 on failure.
+int LogReaderSaveIndex(intptr_t reader);
+
+// Unmap the log.  The handle is invalid afterwards.
+void LogReaderClose(intptr_t reader);
+
+// ----------------------------------------------------------------------------
+// Log segment preallocation and recycling (segment-manager-linux.cpp)
+// ----------------------------------------------------------------------------
+
+// Start a manager that keeps spares files of segment_size bytes ready,
+// named <prefix>.spare.*, preparing them on a background thread.  They
+// are allocated like SetFileSizeEx(..., flags); pass ADV_PREZERO to have
+// them written with zeros as well.  prefix is a path and file name
+// prefix in the log's directory (the same filesystem, so that taking a
+// segment is a rename).  Spares left by an earlier manager are adopted.
+// RETURN: the handle, or 0.
+intptr_t SegmentManagerCreate(const char** prefix, int64_t segment_size, int32_t spares, int flags);
+
+// Move a ready spare to path, replacing any file there.  If none is
+// ready, wait for one when wait is nonzero, else give up at once.  Open
+// the result with ADV_LOG_REUSE to keep its allocation.
+// RETURN: nonzero if path is now a fresh segment; 0 if the caller must
+// create the file itself.
+int SegmentManagerTake(intptr_t mgr, const char** path, int wait);
+
+// Hand over a file that is no longer needed, instead of deleting it.  It
+// is renamed away at once, then zeroed and resized into a spare in the
+// background.  It is deleted instead if twice spares files are already
+// ready or recycling.
+// RETURN: nonzero, or 0 on failure.
+int SegmentManagerRecycle(intptr_t mgr, const char** path);
+
+// Spares ready now, and totals of segments taken, files recycled into
+// spares, and takes that found no spare ready.
+void SegmentManagerGetStats(intptr_t mgr, int64_t* ready, int64_t* taken, int64_t* recycled, int64_t* missed);
+
+// Stop the background thread.  Ready spares stay on disk for the next
+// manager.
+void SegmentManagerDestroy(intptr_t mgr);
+
+// ----------------------------------------------------------------------------
+// Aligned buffer pools (buffer-pool-linux.cpp)
+// ----------------------------------------------------------------------------
+
+// BufferPoolCreate flags.
+#define ADV_POOL_NO_HUGE 0x1  // Use ordinary pages only.
+#define ADV_POOL_LOCK    0x2  // mlock the pool.
+
+// The page kinds BufferPoolRegion reports.
+#define ADV_POOL_THP     1    // Transparent huge pages were requested.
+#define ADV_POOL_HUGETLB 2    // Reserved (hugetlbfs) huge pages.
+
+// Create a pool of count buffers of buffer_size bytes (rounded up to a
+// multiple of 4 KiB), each 4 KiB aligned, so they serve direct I/O on
+// any device.  The memory is one prefaulted mapping, on huge pages when
+// the pool spans at least 2 MiB.  RETURN: the handle, or 0.
+intptr_t BufferPoolCreate(int64_t buffer_size, int32_t count, int flags);
+
+// (Any thread) Take a buffer, waiting for one to be returned if wait is
+// nonzero.  RETURN: the buffer, or null if none is free and wait is 0.
+void* BufferPoolLease(intptr_t pool, int wait);
+
+// (Any thread) Give a leased buffer back.
+void BufferPoolReturn(intptr_t pool, void* buf);
+
+int64_t BufferPoolBufferSize(intptr_t pool);
+
+// The whole mapping, e.g. to register it with io_uring, and its page kind.
+void BufferPoolRegion(intptr_t pool, void** base, int64_t* size, int* huge);
+
+// Unmap the pool.  Every buffer must have been returned.
+void BufferPoolDestroy(intptr_t pool);
+
+// ----------------------------------------------------------------------------
+// Log record checksums (checkbytes.cpp, also in the Windows DLL)
+// ----------------------------------------------------------------------------
+
+// The XOR of the bytes as little-endian 64-bit words, the last one zero
+// padded: the coordinator's CheckBytes.  Any alignment; AVX-512 or AVX2
+// where the CPU has them.
+int64_t CheckBytes(const void* buf, int64_t len);
+
+// The checksum of first followed by second, as one stream.
+int64_t CheckBytes2(const void* first, int64_t first_len, const void* second, int64_t second_len);
+
+// The checksum of the count buffers concatenated.
+int64_t CheckBytesMulti(const void* const* bufs, const int64_t* lens, int32_t count);
+
+// "avx512", "avx2" or "scalar": the version in use.
+const char* CheckBytesImplementation();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
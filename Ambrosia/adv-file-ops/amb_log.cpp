@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Inspect an Ambrosia log file offline, through the mapped log reader.
+//
+//   amb_log.exe [-v] stats LOG           records, seqIDs, and where the log ends
+//   amb_log.exe [-v] dump LOG [SEQ [N]]  one line per record, from seqID SEQ
+//   amb_log.exe [-v] seek LOG SEQ        the offset of seqID SEQ
+//   amb_log.exe index LOG                build and save LOG.idx
+//
+// -v checks payload checksums as well; a bad one ends the log there.
+
+// Linux only.
+
+#include "adv-file-ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void Usage() {
+	fprintf(stderr,
+		"usage: amb_log.exe [-v] stats LOG\n"
+		"       amb_log.exe [-v] dump LOG [SEQ [N]]\n"
+		"       amb_log.exe [-v] seek LOG SEQ\n"
+		"       amb_log.exe index LOG\n");
+	exit(2);
+}
+
+static double Now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void PrintRecord(const AdvLogRecord& rec) {
+	printf("seq %lld  offset %lld  commit %d  payload %d  watermarks %d  checksum %016llx\n",
+		(long long)rec.seq_id, (long long)rec.offset, rec.commit_id, rec.payload_size,
+		rec.watermarks_size, (unsigned long long)rec.checksum);
+}
+
+static int Stats(intptr_t log) {
+	double start = Now();
+	AdvLogRecord rec;
+	long long records = 0, payload = 0;
+	int64_t first_seq = -1, end = 0;
+	for (bool ok = LogReaderFirst(log, &rec) != 0; ok; ok = LogReaderNext(log, &rec) != 0) {
+		if (records++ == 0) first_seq = rec.seq_id;
+		payload += rec.payload_size;
+		end = rec.next;
+	}
+	double secs = Now() - start;
+	int64_t size = LogReaderSize(log);
+	printf("records      %lld\n", records);
+	if (records > 0)
+		printf("seqIDs       %lld to %lld\n", (long long)first_seq, (long long)(first_seq + records - 1));
+	printf("payload      %lld bytes\n", payload);
+	printf("log end      %lld of %lld bytes in the file\n", (long long)end, (long long)size);
+	printf("scanned in   %.3f s (%.0f MB/s)\n", secs, secs > 0 ? end / secs / 1e6 : 0.0);
+	return 0;
+}
+
+static int Dump(intptr_t log, int64_t from, long long count) {
+	AdvLogRecord rec;
+	bool ok = from >= 0 ? LogReaderSeek(log, from, &rec) != 0 : LogReaderFirst(log, &rec) != 0;
+	if (!ok && from >= 0) {
+		fprintf(stderr, "ERROR: seqID %lld is not in the log\n", (long long)from);
+		return 1;
+	}
+	for (; ok && count != 0; ok = LogReaderNext(log, &rec) != 0, count--) PrintRecord(rec);
+	return 0;
+}
+
+static int Seek(intptr_t log, int64_t seq) {
+	double start = Now();
+	AdvLogRecord rec;
+	if (!LogReaderSeek(log, seq, &rec)) {
+		fprintf(stderr, "ERROR: seqID %lld is not in the log\n", (long long)seq);
+		return 1;
+	}
+	double secs = Now() - start;
+	PrintRecord(rec);
+	printf("found in %.6f s\n", secs);
+	return 0;
+}
+
+static int Index(intptr_t log) {
+	int64_t next_seq, entries, indexed_to;
+	int64_t end = LogReaderEnd(log, &next_seq);
+	LogReaderIndexStats(log, &entries, &indexed_to);
+	if (!LogReaderSaveIndex(log)) {
+		perror("ERROR: could not save the index");
+		return 1;
+	}
+	printf("indexed %lld bytes, next seqID %lld, %lld entries\n",
+		(long long)end, (long long)next_seq, (long long)entries);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	int flags = 0;
+	int arg = 1;
+	if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+		flags |= ADV_LOGREAD_VERIFY;
+		arg++;
+	}
+	if (argc - arg < 2) Usage();
+	const char* command = argv[arg];
+	const char* path = argv[arg + 1];
+	char** rest = argv + arg + 2;
+	int nrest = argc - arg - 2;
+
+	intptr_t log = LogReaderOpen(&path, flags);
+	if (log == 0) return 1;
+	int result;
+	if (strcmp(command, "stats") == 0 && nrest == 0) {
+		result = Stats(log);
+	} else if (strcmp(command, "dump") == 0 && nrest <= 2) {
+		result = Dump(log, nrest > 0 ? atoll(rest[0]) : -1, nrest > 1 ? atoll(rest[1]) : -1);
+	} else if (strcmp(command, "seek") == 0 && nrest == 1) {
+		result = Seek(log, atoll(rest[0]));
+	} else if (strcmp(command, "index") == 0 && nrest == 0) {
+		result = Index(log);
+	} else {
+		Usage();
+		result = 2;
+	}
+	LogReaderClose(log);
+	return result;
+}
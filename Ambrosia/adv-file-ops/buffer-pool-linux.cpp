@@ -0,0 +1,159 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// A pool of aligned I/O buffers, carved out of one mapping.  See
+// adv-file-ops.h for the ABI.
+//
+// The mapping is backed by huge pages where possible: explicit ones
+// (MAP_HUGETLB) if the administrator has reserved any, otherwise
+// transparent huge pages through madvise.  That means fewer TLB misses
+// when the buffers are filled, and fewer pages for the kernel to pin for
+// each direct I/O.  It is prefaulted, so no write pays a page fault, and
+// being one region it can be registered with io_uring in a single call.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "adv-file-ops.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+static const int64_t kHugePage = 2 << 20;
+
+struct AdvBufferPool {
+	char* base;
+	int64_t region_size;
+	int64_t buffer_size;
+	int32_t count;
+	int huge;                      // ADV_POOL_HUGETLB, ADV_POOL_THP or 0.
+	std::mutex mutex;
+	std::condition_variable returned;
+	std::vector<char*> free_list;
+};
+
+static AdvBufferPool* ToPool(intptr_t pool) {
+	return (AdvBufferPool*)pool;
+}
+
+extern "C"
+intptr_t BufferPoolCreate(int64_t buffer_size, int32_t count, int flags)
+{
+	if (buffer_size <= 0 || count <= 0) {
+		errno = EINVAL;
+		return 0;
+	}
+	// Every buffer starts on a 4 KiB boundary, which satisfies direct I/O
+	// on any device.
+	buffer_size = (buffer_size + 4095) / 4096 * 4096;
+	int64_t size = buffer_size * count;
+
+	AdvBufferPool* pool = new AdvBufferPool();
+	pool->buffer_size = buffer_size;
+	pool->count = count;
+	pool->base = (char*)MAP_FAILED;
+
+	if (!(flags & ADV_POOL_NO_HUGE) && size >= kHugePage) {
+		int64_t huge_size = (size + kHugePage - 1) / kHugePage * kHugePage;
+		pool->base = (char*)mmap(nullptr, (size_t)huge_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+		if (pool->base != (char*)MAP_FAILED) {
+			pool->region_size = huge_size;
+			pool->huge = ADV_POOL_HUGETLB;
+		} else {
+			// No reserved huge pages: map 2 MiB aligned and ask for
+			// transparent ones before the pages are touched.
+			char* raw = (char*)mmap(nullptr, (size_t)(huge_size + kHugePage), PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (raw != (char*)MAP_FAILED) {
+				char* aligned = (char*)(((uintptr_t)raw + kHugePage - 1) & ~(uintptr_t)(kHugePage - 1));
+				if (aligned > raw) munmap(raw, (size_t)(aligned - raw));
+				char* end = raw + huge_size + kHugePage;
+				if (end > aligned + huge_size) munmap(aligned + huge_size, (size_t)(end - aligned - huge_size));
+				pool->base = aligned;
+				pool->region_size = huge_size;
+				if (madvise(aligned, (size_t)huge_size, MADV_HUGEPAGE) == 0) pool->huge = ADV_POOL_THP;
+			}
+		}
+	}
+	if (pool->base == (char*)MAP_FAILED) {
+		pool->base = (char*)mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		pool->region_size = size;
+		if (pool->base == (char*)MAP_FAILED) {
+			int err = errno;
+			std::cerr << "Could not map a " << size << " byte buffer pool: " << strerror(err) << std::endl;
+			delete pool;
+			errno = err;
+			return 0;
+		}
+	}
+	if (pool->huge != ADV_POOL_HUGETLB) {
+		// Prefault (MAP_HUGETLB | MAP_POPULATE did it already).
+		for (int64_t off = 0; off < pool->region_size; off += 4096) pool->base[off] = 0;
+	}
+	if ((flags & ADV_POOL_LOCK) && mlock(pool->base, (size_t)pool->region_size) != 0) {
+		std::cerr << "mlock of the buffer pool failed: " << strerror(errno) << std::endl;
+	}
+
+	pool->free_list.reserve(count);
+	for (int32_t i = count - 1; i >= 0; i--)
+		pool->free_list.push_back(pool->base + i * buffer_size);
+	return (intptr_t)pool;
+}
+
+extern "C"
+void* BufferPoolLease(intptr_t handle, int wait)
+{
+	AdvBufferPool* pool = ToPool(handle);
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	if (wait) pool->returned.wait(lock, [pool] { return !pool->free_list.empty(); });
+	if (pool->free_list.empty()) {
+		errno = EAGAIN;
+		return nullptr;
+	}
+	char* buf = pool->free_list.back();
+	pool->free_list.pop_back();
+	return buf;
+}
+
+extern "C"
+void BufferPoolReturn(intptr_t handle, void* buf)
+{
+	AdvBufferPool* pool = ToPool(handle);
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->free_list.push_back((char*)buf);
+	}
+	pool->returned.notify_one();
+}
+
+extern "C"
+int64_t BufferPoolBufferSize(intptr_t handle)
+{
+	return ToPool(handle)->buffer_size;
+}
+
+extern "C"
+void BufferPoolRegion(intptr_t handle, void** base, int64_t* size, int* huge)
+{
+	AdvBufferPool* pool = ToPool(handle);
+	*base = pool->base;
+	*size = pool->region_size;
+	*huge = pool->huge;
+}
+
+extern "C"
+void BufferPoolDestroy(intptr_t handle)
+{
+	AdvBufferPool* pool = ToPool(handle);
+	munmap(pool->base, (size_t)pool->region_size);
+	delete pool;
+}
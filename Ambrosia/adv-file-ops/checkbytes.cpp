@@ -0,0 +1,214 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Vectorized CheckBytes: the coordinator's log record checksum.
+//
+// The checksum of a byte stream is the XOR of its little-endian 64-bit
+// words, the last one zero padded; that is, byte k of the stream lands
+// in byte lane k % 8.  Lanes count from the start of the stream, not
+// from any address, so the inputs may have any alignment, and a stream
+// split across buffers is folded buffer by buffer, each result rotated
+// into its lanes.
+//
+// AVX-512 and AVX2 versions are chosen at runtime from what the CPU
+// supports, with a scalar fallback.  AMBROSIA_CHECKBYTES=scalar, avx2 or
+// avx512 forces one (if supported), for testing.  This file builds on
+// Windows (in adv-file-ops.dll) as well as Linux.
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS // getenv
+#endif
+
+#ifdef _WIN32
+  #define CHECKBYTES_EXPORT extern "C" __declspec(dllexport)
+#else
+  #include "adv-file-ops.h"
+  #define CHECKBYTES_EXPORT extern "C"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define CHECKBYTES_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#endif
+
+#if defined(__GNUC__)
+  #define TARGET(isa) __attribute__((target(isa)))
+#else
+  #define TARGET(isa)
+#endif
+
+static inline uint64_t Load64(const uint8_t* p) {
+	uint64_t v;
+	memcpy(&v, p, 8); // An unaligned load.
+	return v;
+}
+
+// Move byte lane i to lane (i + shift) % 8.
+static inline uint64_t RotateLanes(uint64_t v, int64_t shift) {
+	int bits = (int)(shift % 8) * 8;
+	return bits == 0 ? v : (v << bits) | (v >> (64 - bits));
+}
+
+// Each version folds len bytes at p with lanes counted from p.
+
+static uint64_t FoldScalar(const uint8_t* p, int64_t len) {
+	uint64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	int64_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		a0 ^= Load64(p + i);
+		a1 ^= Load64(p + i + 8);
+		a2 ^= Load64(p + i + 16);
+		a3 ^= Load64(p + i + 24);
+	}
+	for (; i + 8 <= len; i += 8) a0 ^= Load64(p + i);
+	uint64_t x = a0 ^ a1 ^ a2 ^ a3;
+	if (i < len) {
+		uint64_t tail = 0;
+		memcpy(&tail, p + i, (size_t)(len - i));
+		x ^= tail;
+	}
+	return x;
+}
+
+#ifdef CHECKBYTES_X86
+
+TARGET("avx2")
+static inline uint64_t Reduce256(__m256i v) {
+	__m128i x = _mm_xor_si128(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	return (uint64_t)_mm_cvtsi128_si64(x) ^ (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(x, x));
+}
+
+TARGET("avx2")
+static uint64_t FoldAvx2(const uint8_t* p, int64_t len) {
+	__m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+	__m256i a2 = _mm256_setzero_si256(), a3 = _mm256_setzero_si256();
+	int64_t i = 0;
+	for (; i + 128 <= len; i += 128) {
+		a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i*)(p + i)));
+		a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((const __m256i*)(p + i + 32)));
+		a2 = _mm256_xor_si256(a2, _mm256_loadu_si256((const __m256i*)(p + i + 64)));
+		a3 = _mm256_xor_si256(a3, _mm256_loadu_si256((const __m256i*)(p + i + 96)));
+	}
+	for (; i + 32 <= len; i += 32)
+		a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i*)(p + i)));
+	a0 = _mm256_xor_si256(_mm256_xor_si256(a0, a1), _mm256_xor_si256(a2, a3));
+	// i is a multiple of 8, so the rest keeps its lanes.
+	return Reduce256(a0) ^ FoldScalar(p + i, len - i);
+}
+
+TARGET("avx512f")
+static uint64_t FoldAvx512(const uint8_t* p, int64_t len) {
+	__m512i a0 = _mm512_setzero_si512(), a1 = _mm512_setzero_si512();
+	__m512i a2 = _mm512_setzero_si512(), a3 = _mm512_setzero_si512();
+	int64_t i = 0;
+	for (; i + 256 <= len; i += 256) {
+		a0 = _mm512_xor_si512(a0, _mm512_loadu_si512((const void*)(p + i)));
+		a1 = _mm512_xor_si512(a1, _mm512_loadu_si512((const void*)(p + i + 64)));
+		a2 = _mm512_xor_si512(a2, _mm512_loadu_si512((const void*)(p + i + 128)));
+		a3 = _mm512_xor_si512(a3, _mm512_loadu_si512((const void*)(p + i + 192)));
+	}
+	for (; i + 64 <= len; i += 64)
+		a0 = _mm512_xor_si512(a0, _mm512_loadu_si512((const void*)(p + i)));
+	a0 = _mm512_xor_si512(_mm512_xor_si512(a0, a1), _mm512_xor_si512(a2, a3));
+	uint64_t lanes[8];
+	_mm512_storeu_si512((void*)lanes, a0);
+	uint64_t x = FoldScalar(p + i, len - i);
+	for (int k = 0; k < 8; k++) x ^= lanes[k];
+	return x;
+}
+
+static bool CpuHasAvx2() {
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7) return false;
+	__cpuid(r, 1);
+	if (!(r[2] & (1 << 27)) || (_xgetbv(0) & 0x6) != 0x6) return false; // OS saves YMM
+	__cpuidex(r, 7, 0);
+	return (r[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool CpuHasAvx512() {
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7) return false;
+	__cpuid(r, 1);
+	if (!(r[2] & (1 << 27)) || (_xgetbv(0) & 0xe6) != 0xe6) return false; // OS saves ZMM
+	__cpuidex(r, 7, 0);
+	return (r[1] & (1 << 16)) != 0;
+#else
+	return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+#endif // CHECKBYTES_X86
+
+typedef uint64_t (*FoldFn)(const uint8_t*, int64_t);
+
+struct Implementation {
+	FoldFn fold;
+	const char* name;
+};
+
+static Implementation Choose() {
+	const char* forced = getenv("AMBROSIA_CHECKBYTES");
+	if (forced != nullptr && strcmp(forced, "scalar") == 0) return { FoldScalar, "scalar" };
+#ifdef CHECKBYTES_X86
+	bool avx512 = CpuHasAvx512(), avx2 = CpuHasAvx2();
+	if (forced != nullptr && strcmp(forced, "avx2") == 0) avx512 = false;
+	if (avx512) return { FoldAvx512, "avx512" };
+	if (avx2) return { FoldAvx2, "avx2" };
+#endif
+	return { FoldScalar, "scalar" };
+}
+
+static const Implementation& Impl() {
+	static const Implementation impl = Choose();
+	return impl;
+}
+
+CHECKBYTES_EXPORT
+int64_t CheckBytes(const void* buf, int64_t len)
+{
+	if (len <= 0) return 0;
+	return (int64_t)Impl().fold((const uint8_t*)buf, len);
+}
+
+CHECKBYTES_EXPORT
+int64_t CheckBytes2(const void* first, int64_t first_len, const void* second, int64_t second_len)
+{
+	uint64_t x = 0;
+	if (first_len > 0) x = Impl().fold((const uint8_t*)first, first_len);
+	if (second_len > 0) x ^= RotateLanes(Impl().fold((const uint8_t*)second, second_len), first_len);
+	return (int64_t)x;
+}
+
+CHECKBYTES_EXPORT
+int64_t CheckBytesMulti(const void* const* bufs, const int64_t* lens, int32_t count)
+{
+	uint64_t x = 0;
+	int64_t pos = 0;
+	for (int32_t i = 0; i < count; i++) {
+		if (lens[i] <= 0) continue;
+		x ^= RotateLanes(Impl().fold((const uint8_t*)bufs[i], lens[i]), pos);
+		pos += lens[i];
+	}
+	return (int64_t)x;
+}
+
+CHECKBYTES_EXPORT
+const char* CheckBytesImplementation()
+{
+	return Impl().name;
+}
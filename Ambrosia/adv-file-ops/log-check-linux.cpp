@@ -0,0 +1,158 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Crash checks for the log writer: a writer that dies without
+// LogFileClose leaves a padded, preallocated file, and a log reopened
+// with ADV_LOG_APPEND_RECORDS must continue right after its last
+// record, so that replay reaches the records written after the restart.
+//
+//   make check           (runs bin/log-check.exe bin/check)
+
+#include "adv-file-ops.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+static int g_failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { \
+	fprintf(stderr, "FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); g_failures++; } } while (0)
+
+// A record with payload_size bytes of payload and empty watermark lists.
+static std::vector<char> Record(int64_t seq_id, int payload_size) {
+	std::vector<char> rec(24 + payload_size + 2);
+	int32_t commit_id = 1, total_size = 24 + payload_size;
+	for (int i = 0; i < payload_size; i++) rec[24 + i] = (char)(seq_id * 31 + i);
+	int64_t checksum = CheckBytes(rec.data() + 24, payload_size);
+	memcpy(&rec[0], &commit_id, 4);
+	memcpy(&rec[4], &total_size, 4);
+	memcpy(&rec[8], &checksum, 8);
+	memcpy(&rec[16], &seq_id, 8);
+	return rec; // The two watermark counts are zero bytes.
+}
+
+static void Append(intptr_t log, int64_t seq_id, int payload_size) {
+	std::vector<char> rec = Record(seq_id, payload_size);
+	CHECK(LogFileAppend(log, rec.data(), (int64_t)rec.size()) > 0);
+}
+
+static int64_t FileSize(const std::string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+// Write records [0, count) in a child that exits without closing the log.
+static void WriteAndCrash(const std::string& path, int mode, int64_t prealloc, int count) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		g_failures = 0;
+		const char* name = path.c_str();
+		intptr_t log = LogFileOpen(&name, mode, prealloc, 0);
+		if (log == 0) _exit(1);
+		for (int i = 0; i < count; i++) Append(log, i, 50 + 7 * i);
+		_exit(LogFileFlush(log, -1) && g_failures == 0 ? 0 : 1);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// Reopen after the crash, append one more record, and check that a
+// reader walks all count + 1 of them to the end of the file.
+static void ReopenAndCheck(const std::string& path, int count) {
+	const char* name = path.c_str();
+	intptr_t log = LogFileOpen(&name, ADV_LOG_APPEND_RECORDS, 0, 0);
+	CHECK(log != 0);
+	if (log == 0) return;
+	int64_t start = LogFileSize(log);
+	Append(log, count, 100);
+	CHECK(LogFileClose(log));
+
+	intptr_t reader = LogReaderOpen(&name, ADV_LOGREAD_VERIFY | ADV_LOGREAD_NO_INDEX);
+	CHECK(reader != 0);
+	if (reader == 0) return;
+	AdvLogRecord rec;
+	int records = 0;
+	int64_t last_start = -1;
+	for (bool ok = LogReaderFirst(reader, &rec) != 0; ok; ok = LogReaderNext(reader, &rec) != 0) {
+		records++;
+		last_start = rec.offset;
+	}
+	CHECK(records == count + 1);
+	CHECK(last_start == start);
+	int64_t next_seq;
+	CHECK(LogReaderEnd(reader, &next_seq) == FileSize(path));
+	CHECK(next_seq == count + 1);
+	LogReaderClose(reader);
+}
+
+int main(int argc, char** argv) {
+	std::string dir = argc > 1 ? argv[1] : ".";
+	std::string path = dir + "/check.log";
+
+	// The last block is padded with zeros.
+	unlink(path.c_str());
+	WriteAndCrash(path, ADV_LOG_TRUNCATE, 0, 1);
+	CHECK(FileSize(path) > 74);
+	ReopenAndCheck(path, 1);
+
+	// Preallocation does not move the end of the file.
+	unlink(path.c_str());
+	WriteAndCrash(path, ADV_LOG_TRUNCATE, 1 << 20, 3);
+	CHECK(FileSize(path) < (1 << 20));
+	ReopenAndCheck(path, 3);
+
+	// A full size segment from the segment manager.
+	unlink(path.c_str());
+	std::string prefix = dir + "/check-segments";
+	const char* prefix_name = prefix.c_str();
+	intptr_t mgr = SegmentManagerCreate(&prefix_name, 1 << 20, 1, 0);
+	CHECK(mgr != 0);
+	const char* name = path.c_str();
+	CHECK(SegmentManagerTake(mgr, &name, 1));
+	SegmentManagerDestroy(mgr);
+	CHECK(FileSize(path) == (1 << 20));
+	WriteAndCrash(path, ADV_LOG_REUSE, 0, 5);
+	ReopenAndCheck(path, 5);
+
+	// A torn record: its payload never made it, so its checksum fails.
+	// Appending continues in its place.
+	unlink(path.c_str());
+	WriteAndCrash(path, ADV_LOG_TRUNCATE, 0, 2);
+	{
+		std::vector<char> torn = Record(2, 200);
+		memset(&torn[24], 0, 200);
+		FILE* f = fopen(path.c_str(), "r+b");
+		CHECK(f != nullptr);
+		if (f != nullptr) {
+			intptr_t reader = LogReaderOpen(&name, ADV_LOGREAD_NO_INDEX);
+			int64_t end = LogReaderEnd(reader, nullptr);
+			LogReaderClose(reader);
+			fseek(f, (long)end, SEEK_SET);
+			fwrite(torn.data(), 1, torn.size(), f);
+			fclose(f);
+		}
+	}
+	ReopenAndCheck(path, 2);
+
+	// A plain append to a cleanly closed file continues at its size.
+	{
+		intptr_t log = LogFileOpen(&name, ADV_LOG_APPEND, 0, 0);
+		CHECK(log != 0);
+		int64_t size = FileSize(path);
+		CHECK(LogFileSize(log) == size);
+		CHECK(LogFileAppend(log, "x", 1) == size + 1);
+		CHECK(LogFileClose(log));
+		CHECK(FileSize(path) == size + 1);
+	}
+
+	unlink(path.c_str());
+	if (g_failures == 0) printf("log checks passed\n");
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,368 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Reading logs through a read-only mapping.  See adv-file-ops.h for the
+// ABI and the record format.
+//
+// Replay reads a log front to back, so a scan is one pass over the
+// mapping (with sequential readahead) that parses headers in place and
+// hands out pointers, rather than a read call per field.  To start
+// anywhere else, the reader keeps a sparse index: the seqID and offset
+// of the first record in each MiB of log.  A seek is a binary search of
+// the index and a scan of at most a MiB.  The index is a cache; it is
+// saved as <log>.idx, and reused by a later reader only if the records
+// it names are still where it says.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "adv-file-ops.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const int64_t kHeaderSize = 24;
+static const int64_t kIndexStride = 1 << 20;
+static const char kIndexMagic[8] = { 'A', 'M', 'B', 'L', 'I', 'D', 'X', '1' };
+
+struct IndexEntry {
+	int64_t seq_id;
+	int64_t offset;
+};
+
+// The layout of <log>.idx: this, then count IndexEntry.
+struct IndexFileHeader {
+	char magic[8];
+	int64_t stride;
+	int64_t indexed_to;
+	int64_t next_seq;
+	int64_t count;
+};
+
+struct AdvLogReader {
+	std::string path;
+	int fd;
+	int flags;
+	const uint8_t* base = nullptr;
+	int64_t size = 0;
+
+	// Every record before indexed_to has been scanned; the next one must
+	// have next_seq (-1: none scanned yet).
+	std::vector<IndexEntry> index;
+	int64_t indexed_to = 0;
+	int64_t next_seq = -1;
+	bool index_dirty = false;
+};
+
+static AdvLogReader* ToReader(intptr_t reader) {
+	return (AdvLogReader*)reader;
+}
+
+template <typename T>
+static inline T Load(const uint8_t* p) {
+	T v;
+	memcpy(&v, p, sizeof(v)); // Records are not aligned.
+	return v;
+}
+
+// A zig-zag varint, as StreamCommunicator.ReadInt reads it.
+static bool ReadVarint(const uint8_t*& p, const uint8_t* end, int32_t* value) {
+	uint32_t result = 0;
+	for (int i = 0; i < 5; i++) {
+		if (p >= end) return false;
+		uint32_t b = *p++;
+		result |= (b & 0x7f) << (7 * i);
+		if (!(b & 0x80)) {
+			*value = (int32_t)((0 - (result & 1)) ^ ((result >> 1) & 0x7fffffff));
+			return true;
+		}
+	}
+	return false;
+}
+
+// Skip a watermark list: a count, then per entry a name (length and
+// bytes) and entry_size bytes of values.
+static bool SkipWatermarks(const uint8_t*& p, const uint8_t* end, int64_t entry_size) {
+	int32_t count;
+	if (!ReadVarint(p, end, &count) || count < 0) return false;
+	for (int32_t i = 0; i < count; i++) {
+		int32_t name_len;
+		if (!ReadVarint(p, end, &name_len) || name_len < 0) return false;
+		if (end - p < name_len + entry_size) return false;
+		p += name_len + entry_size;
+	}
+	return true;
+}
+
+// Parse the record at offset, if a complete one is there.
+static bool ParseAt(AdvLogReader* r, int64_t offset, AdvLogRecord* rec, bool verify) {
+	if (offset < 0 || r->size - offset < kHeaderSize) return false;
+	const uint8_t* h = r->base + offset;
+	int32_t total_size = Load<int32_t>(h + 4);
+	if (total_size < kHeaderSize || r->size - offset < total_size) return false;
+
+	const uint8_t* end = r->base + r->size;
+	const uint8_t* watermarks = h + total_size;
+	const uint8_t* p = watermarks;
+	if (!SkipWatermarks(p, end, 16) || !SkipWatermarks(p, end, 8)) return false;
+
+	rec->offset = offset;
+	rec->next = p - r->base;
+	rec->commit_id = Load<int32_t>(h);
+	rec->total_size = total_size;
+	rec->checksum = Load<int64_t>(h + 8);
+	rec->seq_id = Load<int64_t>(h + 16);
+	rec->payload = h + kHeaderSize;
+	rec->payload_size = total_size - (int32_t)kHeaderSize;
+	rec->watermarks = watermarks;
+	rec->watermarks_size = (int32_t)(p - watermarks);
+	if (verify && CheckBytes(rec->payload, rec->payload_size) != rec->checksum) return false;
+	return true;
+}
+
+static bool Verify(AdvLogReader* r) {
+	return (r->flags & ADV_LOGREAD_VERIFY) != 0;
+}
+
+static bool Map(AdvLogReader* r) {
+	struct stat st;
+	if (fstat(r->fd, &st) != 0) return false;
+	int64_t size = st.st_size;
+	if (size == r->size) return true;
+	if (r->base != nullptr) munmap((void*)r->base, (size_t)r->size);
+	r->base = nullptr;
+	r->size = 0;
+	if (size == 0) return true;
+	void* mem = mmap(nullptr, (size_t)size, PROT_READ, MAP_SHARED, r->fd, 0);
+	if (mem == MAP_FAILED) {
+		int err = errno;
+		std::cerr << "Could not map log " << r->path << ": " << strerror(err) << std::endl;
+		errno = err;
+		return false;
+	}
+	madvise(mem, (size_t)size, MADV_SEQUENTIAL);
+	r->base = (const uint8_t*)mem;
+	r->size = size;
+	return true;
+}
+
+static void ResetIndex(AdvLogReader* r) {
+	r->index.clear();
+	r->indexed_to = 0;
+	r->next_seq = -1;
+	r->index_dirty = false;
+}
+
+// Scan on from indexed_to, to the end of the log, or until the record
+// with target_seq (if not negative) has been indexed.
+static void ExtendIndex(AdvLogReader* r, int64_t target_seq) {
+	AdvLogRecord rec;
+	while (ParseAt(r, r->indexed_to, &rec, Verify(r)) && (r->next_seq < 0 || rec.seq_id == r->next_seq)) {
+		if (r->index.empty() || rec.offset >= r->index.back().offset + kIndexStride) {
+			r->index.push_back({ rec.seq_id, rec.offset });
+			r->index_dirty = true;
+		}
+		r->indexed_to = rec.next;
+		r->next_seq = rec.seq_id + 1;
+		if (target_seq >= 0 && rec.seq_id >= target_seq) return;
+	}
+}
+
+static std::string IndexPath(AdvLogReader* r) {
+	return r->path + ".idx";
+}
+
+// Take <log>.idx if it matches the log: the records at its first and
+// last entries are as it says, and the log goes on where it left off.
+static void LoadIndex(AdvLogReader* r) {
+	int fd = open(IndexPath(r).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return;
+	IndexFileHeader hdr;
+	std::vector<IndexEntry> entries;
+	bool ok = read(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) &&
+		memcmp(hdr.magic, kIndexMagic, sizeof(kIndexMagic)) == 0 &&
+		hdr.stride == kIndexStride && hdr.count > 0 &&
+		hdr.count <= hdr.indexed_to / kIndexStride + 1 &&
+		hdr.indexed_to > 0 && hdr.indexed_to <= r->size;
+	if (ok) {
+		entries.resize((size_t)hdr.count);
+		ssize_t bytes = (ssize_t)(sizeof(IndexEntry) * entries.size());
+		ok = read(fd, entries.data(), (size_t)bytes) == bytes;
+	}
+	close(fd);
+	if (!ok) return;
+
+	AdvLogRecord rec;
+	const IndexEntry& first = entries.front();
+	const IndexEntry& last = entries.back();
+	ok = first.offset == 0 && last.offset < hdr.indexed_to &&
+		ParseAt(r, first.offset, &rec, false) && rec.seq_id == first.seq_id &&
+		ParseAt(r, last.offset, &rec, false) && rec.seq_id == last.seq_id &&
+		last.seq_id < hdr.next_seq;
+	if (ok && ParseAt(r, hdr.indexed_to, &rec, false)) ok = rec.seq_id == hdr.next_seq;
+	if (!ok) return;
+
+	r->index.swap(entries);
+	r->indexed_to = hdr.indexed_to;
+	r->next_seq = hdr.next_seq;
+	r->index_dirty = false;
+}
+
+extern "C"
+intptr_t LogReaderOpen(const char** filename, int flags)
+{
+	int fd = open(*filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		int err = errno;
+		std::cerr << "Could not open log " << *filename << ": " << strerror(err) << std::endl;
+		errno = err;
+		return 0;
+	}
+	AdvLogReader* r = new AdvLogReader();
+	r->path = *filename;
+	r->fd = fd;
+	r->flags = flags;
+	if (!Map(r)) {
+		int err = errno;
+		close(fd);
+		delete r;
+		errno = err;
+		return 0;
+	}
+	if (!(flags & ADV_LOGREAD_NO_INDEX)) LoadIndex(r);
+	return (intptr_t)r;
+}
+
+extern "C"
+int64_t LogReaderRefresh(intptr_t reader)
+{
+	AdvLogReader* r = ToReader(reader);
+	Map(r);
+	// Shrunk, or replaced: start the index over.
+	if (r->indexed_to > r->size) ResetIndex(r);
+	return r->size;
+}
+
+extern "C"
+int64_t LogReaderSize(intptr_t reader)
+{
+	return ToReader(reader)->size;
+}
+
+extern "C"
+int LogReaderFirst(intptr_t reader, AdvLogRecord* rec)
+{
+	AdvLogReader* r = ToReader(reader);
+	return ParseAt(r, 0, rec, Verify(r));
+}
+
+extern "C"
+int LogReaderNext(intptr_t reader, AdvLogRecord* rec)
+{
+	AdvLogReader* r = ToReader(reader);
+	AdvLogRecord next;
+	if (!ParseAt(r, rec->next, &next, Verify(r)) || next.seq_id != rec->seq_id + 1) return 0;
+	*rec = next;
+	return 1;
+}
+
+extern "C"
+int LogReaderRecordAt(intptr_t reader, int64_t offset, AdvLogRecord* rec)
+{
+	AdvLogReader* r = ToReader(reader);
+	return ParseAt(r, offset, rec, Verify(r));
+}
+
+extern "C"
+int LogReaderSeek(intptr_t reader, int64_t seq_id, AdvLogRecord* rec)
+{
+	AdvLogReader* r = ToReader(reader);
+	if (seq_id < 0) return 0;
+	if (r->next_seq <= seq_id) ExtendIndex(r, seq_id);
+	// The last entry at or before seq_id.
+	auto it = std::upper_bound(r->index.begin(), r->index.end(), seq_id,
+		[](int64_t seq, const IndexEntry& e) { return seq < e.seq_id; });
+	if (it == r->index.begin()) return 0;
+	--it;
+	AdvLogRecord cur, next;
+	if (!ParseAt(r, it->offset, &cur, false)) return 0;
+	while (cur.seq_id < seq_id) {
+		if (!ParseAt(r, cur.next, &next, false) || next.seq_id != cur.seq_id + 1) return 0;
+		cur = next;
+	}
+	// Only the record found needs verifying.
+	if (Verify(r) && !ParseAt(r, cur.offset, &cur, true)) return 0;
+	*rec = cur;
+	return 1;
+}
+
+extern "C"
+int64_t LogReaderEnd(intptr_t reader, int64_t* next_seq_id)
+{
+	AdvLogReader* r = ToReader(reader);
+	ExtendIndex(r, -1);
+	if (next_seq_id != nullptr) *next_seq_id = r->next_seq;
+	return r->indexed_to;
+}
+
+extern "C"
+void LogReaderIndexStats(intptr_t reader, int64_t* entries, int64_t* indexed_to)
+{
+	AdvLogReader* r = ToReader(reader);
+	*entries = (int64_t)r->index.size();
+	*indexed_to = r->indexed_to;
+}
+
+extern "C"
+int LogReaderSaveIndex(intptr_t reader)
+{
+	AdvLogReader* r = ToReader(reader);
+	if (r->index.empty()) return 1;
+	IndexFileHeader hdr;
+	memcpy(hdr.magic, kIndexMagic, sizeof(kIndexMagic));
+	hdr.stride = kIndexStride;
+	hdr.indexed_to = r->indexed_to;
+	hdr.next_seq = r->next_seq;
+	hdr.count = (int64_t)r->index.size();
+
+	// Written aside and renamed, so a reader never sees half an index.
+	std::string path = IndexPath(r);
+	std::string tmp = path + ".tmp." + std::to_string((long long)getpid());
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return 0;
+	ssize_t bytes = (ssize_t)(sizeof(IndexEntry) * r->index.size());
+	bool ok = write(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) &&
+		write(fd, r->index.data(), (size_t)bytes) == bytes;
+	ok = close(fd) == 0 && ok;
+	if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+	if (!ok) {
+		int err = errno;
+		unlink(tmp.c_str());
+		errno = err;
+		return 0;
+	}
+	r->index_dirty = false;
+	return 1;
+}
+
+extern "C"
+void LogReaderClose(intptr_t reader)
+{
+	AdvLogReader* r = ToReader(reader);
+	// The index is only a cache: if it cannot be saved (a read-only
+	// directory, say), the next reader rebuilds it.
+	if (r->index_dirty && !(r->flags & ADV_LOGREAD_NO_INDEX)) LogReaderSaveIndex(reader);
+	if (r->base != nullptr) munmap((void*)r->base, (size_t)r->size);
+	close(r->fd);
+	delete r;
+}
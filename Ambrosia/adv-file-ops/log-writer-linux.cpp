@@ -0,0 +1,682 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// An append-only log file with asynchronous, aligned writes and group
+// commit.  See adv-file-ops.h for the ABI.
+//
+// Appending threads copy their bytes into a fill buffer and return.  One
+// I/O thread per log swaps that buffer out and writes it, as block
+// aligned direct I/O chunks, followed by a single fdatasync.  The swap
+// takes everything appended so far.  So every flush request that arrives
+// while a sync is in flight is satisfied by the next one.  N concurrent
+// commits cost two syncs at most, not N.
+//
+// The writes and the sync go through io_uring (raw system calls; no
+// liburing), submitted together with the sync drained behind the writes,
+// so a round costs one system call.  If io_uring is unavailable (a
+// kernel before 5.6, which has no IORING_OP_WRITE, or a seccomp policy
+// that blocks it) or AMBROSIA_NO_IO_URING=1 is set, the I/O thread uses
+// pwrite and fdatasync instead.
+//
+// Direct I/O needs whole blocks.  The block holding the end of the log
+// is written padded with zeros, and rewritten by the next round when
+// more has been appended to it.
+//
+// The two buffers come from a buffer pool (huge pages, prefaulted), and
+// are registered with the ring, so the kernel does not pin and unpin
+// their pages on every write.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "adv-file-ops.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int64_t kDefaultBufferSize = 4 << 20;
+static const int64_t kMinBufferSize = 64 << 10;
+static const int64_t kMaxWrite = 1 << 20; // Bytes per write request.
+
+// ----------------------------------------------------------------------------
+// Minimal io_uring
+// ----------------------------------------------------------------------------
+
+struct Uring {
+	int fd = -1;
+	unsigned entries = 0;
+	bool registered = false;       // The log's buffers are fixed buffer 0.
+	char* registered_base = nullptr;
+	unsigned* sq_head; unsigned* sq_tail; unsigned* sq_mask; unsigned* sq_array;
+	unsigned* cq_head; unsigned* cq_tail; unsigned* cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sq_ptr = MAP_FAILED; size_t sq_size = 0;
+	void* cq_ptr = MAP_FAILED; size_t cq_size = 0;
+	size_t sqes_size = 0;
+};
+
+static void UringFree(Uring* u) {
+	if (u->sqes_size) munmap(u->sqes, u->sqes_size);
+	if (u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr) munmap(u->cq_ptr, u->cq_size);
+	if (u->sq_ptr != MAP_FAILED) munmap(u->sq_ptr, u->sq_size);
+	if (u->fd >= 0) close(u->fd);
+	*u = Uring();
+}
+
+static bool UringInit(Uring* u, unsigned entries) {
+#ifdef __NR_io_uring_setup
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	u->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (u->fd < 0) return false;
+	u->entries = p.sq_entries;
+
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_size > u->sq_size) u->sq_size = u->cq_size;
+		u->cq_size = u->sq_size;
+	}
+	u->sq_ptr = mmap(0, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+		IORING_OFF_SQ_RING);
+	if (u->sq_ptr == MAP_FAILED) { UringFree(u); return false; }
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ptr = u->sq_ptr;
+	} else {
+		u->cq_ptr = mmap(0, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+			IORING_OFF_CQ_RING);
+		if (u->cq_ptr == MAP_FAILED) { UringFree(u); return false; }
+	}
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = (struct io_uring_sqe*)mmap(0, u->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) { u->sqes_size = 0; UringFree(u); return false; }
+
+	char* sq = (char*)u->sq_ptr;
+	char* cq = (char*)u->cq_ptr;
+	u->sq_head  = (unsigned*)(sq + p.sq_off.head);
+	u->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+	u->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned*)(sq + p.sq_off.array);
+	u->cq_head  = (unsigned*)(cq + p.cq_off.head);
+	u->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+	u->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+	u->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return true;
+#else
+	(void)u; (void)entries;
+	errno = ENOSYS;
+	return false;
+#endif
+}
+
+// Whether the kernel knows every opcode the log submits.  io_uring
+// itself dates from 5.1, but IORING_OP_WRITE (and the probe) only from
+// 5.6; older kernels fail the probe, and the log uses pwrite there.
+static bool UringSupportsLogOps(Uring* u) {
+#ifdef __NR_io_uring_register
+	const unsigned nops = 64;
+	std::vector<char> mem(sizeof(struct io_uring_probe) + nops * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe* probe = (struct io_uring_probe*)mem.data();
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PROBE, probe, nops) != 0) return false;
+	for (int op : { IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_FSYNC }) {
+		if (op > probe->last_op || op >= probe->ops_len) return false;
+		if (!(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+	}
+	return true;
+#else
+	(void)u;
+	return false;
+#endif
+}
+
+// Register [base, base + size) as fixed buffer 0.  This can fail under
+// a small RLIMIT_MEMLOCK on older kernels; writes then use plain
+// IORING_OP_WRITE.
+static void UringRegister(Uring* u, char* base, int64_t size) {
+#ifdef __NR_io_uring_register
+	struct iovec iov;
+	iov.iov_base = base;
+	iov.iov_len = (size_t)size;
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0) {
+		u->registered = true;
+		u->registered_base = base;
+	}
+#else
+	(void)u; (void)base; (void)size;
+#endif
+}
+
+// The next free submission entry.  Only the I/O thread submits, and never
+// more than the ring holds at once, so there is always one.
+static struct io_uring_sqe* UringGetSqe(Uring* u) {
+	unsigned tail = *u->sq_tail;
+	unsigned index = tail & *u->sq_mask;
+	struct io_uring_sqe* sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[index] = index;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+// Submit the n queued entries and wait for all n completions.  Each
+// completion's result is stored at results[user_data].
+static bool UringSubmitAndWait(Uring* u, unsigned n, int64_t* results) {
+	unsigned to_submit = n, done = 0;
+	while (done < n) {
+		int r = (int)syscall(__NR_io_uring_enter, u->fd, to_submit, n - done,
+			IORING_ENTER_GETEVENTS, nullptr, 0);
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		to_submit = (unsigned)r >= to_submit ? 0 : to_submit - (unsigned)r;
+		unsigned head = *u->cq_head;
+		unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++, done++) {
+			struct io_uring_cqe* cqe = &u->cqes[head & *u->cq_mask];
+			results[cqe->user_data] = cqe->res;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// The log
+// ----------------------------------------------------------------------------
+
+struct FlushCallback {
+	int64_t upto;
+	LogFileCallback callback;
+	intptr_t context;
+};
+
+struct AdvLogFile {
+	int fd;
+	int64_t block;
+	int64_t capacity;
+	Uring ring;
+	intptr_t pool;                 // Holds fill and spare.
+	std::thread io_thread;
+
+	std::mutex mutex;
+	std::condition_variable work;  // Wakes the I/O thread.
+	std::condition_variable done;  // Wakes flushers and appenders waiting for room.
+	char* fill;                    // Appends go here ...
+	char* spare;                   // ... while this one is written.
+	int64_t fill_base;             // File offset of fill[0] (block aligned).
+	int64_t fill_len;
+	int64_t written = 0;           // On disk, perhaps not yet synced.
+	int64_t durable = 0;           // On disk and synced.
+	int64_t sync_target = 0;       // Largest offset a flusher is waiting for.
+	bool closing = false;
+	int error = 0;                 // Sticky: the first I/O errno.
+	std::vector<FlushCallback> callbacks;
+	int64_t syncs = 0;
+	int64_t flushes = 0;
+};
+
+static bool WriteSync(AdvLogFile* log, const char* buf, int64_t len, int64_t offset) {
+	while (len > 0) {
+		ssize_t n = pwrite(log->fd, buf, (size_t)len, (off_t)offset);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		buf += n; len -= n; offset += n;
+	}
+	return true;
+}
+
+// Write len bytes (block aligned) at offset, then sync if asked.
+// RETURN: 0, or an errno.
+static int WriteRound(AdvLogFile* log, const char* buf, int64_t len, int64_t offset, bool sync) {
+	if (log->ring.fd < 0) {
+		if (!WriteSync(log, buf, len, offset)) return errno;
+		if (sync && fdatasync(log->fd) != 0) return errno;
+		return 0;
+	}
+	int64_t results[64];
+	int64_t lengths[64];
+	unsigned n = 0;
+	for (int64_t pos = 0; pos < len; pos += kMaxWrite, n++) {
+		int64_t chunk = len - pos < kMaxWrite ? len - pos : kMaxWrite;
+		struct io_uring_sqe* sqe = UringGetSqe(&log->ring);
+		if (log->ring.registered) {
+			sqe->opcode = IORING_OP_WRITE_FIXED;
+			sqe->buf_index = 0;
+		} else {
+			sqe->opcode = IORING_OP_WRITE;
+		}
+		sqe->fd = log->fd;
+		sqe->addr = (uint64_t)(uintptr_t)(buf + pos);
+		sqe->len = (uint32_t)chunk;
+		sqe->off = (uint64_t)(offset + pos);
+		sqe->user_data = n;
+		lengths[n] = chunk;
+	}
+	if (sync) {
+		// Drained: it starts only once the writes above have completed.
+		struct io_uring_sqe* sqe = UringGetSqe(&log->ring);
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = log->fd;
+		sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+		sqe->flags = IOSQE_IO_DRAIN;
+		sqe->user_data = n;
+	}
+	if (!UringSubmitAndWait(&log->ring, n + (sync ? 1 : 0), results)) return errno;
+
+	// Should the probe have missed an opcode the kernel cannot run, give
+	// up on the ring and redo the round with pwrite:
+	for (unsigned i = 0; i < n + (sync ? 1 : 0); i++) {
+		if (results[i] == -EINVAL || results[i] == -EOPNOTSUPP) {
+			std::cerr << "WARNING: io_uring rejected a log request (" << strerror((int)-results[i])
+				<< "); using pwrite instead" << std::endl;
+			UringFree(&log->ring);
+			return WriteRound(log, buf, len, offset, sync);
+		}
+	}
+
+	bool resync = false;
+	for (unsigned i = 0; i < n; i++) {
+		if (results[i] < 0) return (int)-results[i];
+		if (results[i] < lengths[i]) {
+			// Short write (e.g. nearly out of space): finish it directly.
+			int64_t pos = (int64_t)i * kMaxWrite + results[i];
+			if (!WriteSync(log, buf + pos, lengths[i] - results[i], offset + pos)) return errno;
+			resync = true;
+		}
+	}
+	if (sync) {
+		if (results[n] < 0) return (int)-results[n];
+		if (resync && fdatasync(log->fd) != 0) return errno;
+	}
+	return 0;
+}
+
+static void IoThread(AdvLogFile* log) {
+	std::unique_lock<std::mutex> lock(log->mutex);
+	for (;;) {
+		log->work.wait(lock, [log] {
+			return log->closing || log->error ||
+				log->sync_target > log->durable ||
+				log->fill_len >= log->capacity / 2;
+		});
+		if (log->error) break;
+		int64_t base = log->fill_base, len = log->fill_len;
+		bool sync = log->sync_target > log->durable || log->closing;
+		if (!sync && base + len == log->written) {
+			if (log->closing) break;
+			continue;
+		}
+
+		// Swap buffers, carrying the partial last block over.
+		char* buf = log->fill;
+		int64_t keep = len - len % log->block;
+		memcpy(log->spare, buf + keep, (size_t)(len - keep));
+		log->fill = log->spare;
+		log->spare = buf;
+		log->fill_base = base + keep;
+		log->fill_len = len - keep;
+		log->done.notify_all(); // There is room again.
+		lock.unlock();
+
+		int64_t padded = (len + log->block - 1) / log->block * log->block;
+		memset(buf + len, 0, (size_t)(padded - len));
+		int err = WriteRound(log, buf, padded, base, sync);
+
+		lock.lock();
+		if (err) {
+			log->error = err;
+			std::cerr << "Log write failed with error: " << strerror(err) << std::endl;
+		} else {
+			log->written = base + len;
+			if (sync) {
+				log->durable = base + len;
+				log->syncs++;
+			}
+		}
+		// Run the callbacks that are now satisfied, outside the lock.
+		std::vector<FlushCallback> ready;
+		for (size_t i = 0; i < log->callbacks.size(); ) {
+			if (log->error || log->callbacks[i].upto <= log->durable) {
+				ready.push_back(log->callbacks[i]);
+				log->callbacks[i] = log->callbacks.back();
+				log->callbacks.pop_back();
+			} else {
+				i++;
+			}
+		}
+		int64_t durable = log->durable;
+		int ok = log->error == 0;
+		log->done.notify_all();
+		if (!ready.empty()) {
+			lock.unlock();
+			for (auto& c : ready) c.callback(c.context, durable, ok);
+			lock.lock();
+		}
+		if (log->closing && log->durable == log->fill_base + log->fill_len) break;
+	}
+	// On error, release everyone still waiting.
+	std::vector<FlushCallback> rest;
+	rest.swap(log->callbacks);
+	int64_t durable = log->durable;
+	log->done.notify_all();
+	lock.unlock();
+	for (auto& c : rest) c.callback(c.context, durable, 0);
+}
+
+// Finding the end of a log of records after a crash.  Each record is a
+// 24-byte header (int32 commitID, int32 totalSize, int64 checksum, int64
+// seqID), the payload, and then the committer's input and trim watermark
+// lists.  The checksum is the XOR of the payload as little-endian 64-bit
+// words, the last one zero padded.  seqIDs go up by one per record.
+
+static const int64_t kRecordHeaderSize = 24;
+
+// A zig-zag varint, as StreamCommunicator.ReadInt reads it.
+static bool ReadRecordVarint(const uint8_t*& p, const uint8_t* end, int32_t* value) {
+	uint32_t result = 0;
+	for (int i = 0; i < 5; i++) {
+		if (p >= end) return false;
+		uint32_t b = *p++;
+		result |= (b & 0x7f) << (7 * i);
+		if (!(b & 0x80)) {
+			*value = (int32_t)((0 - (result & 1)) ^ ((result >> 1) & 0x7fffffff));
+			return true;
+		}
+	}
+	return false;
+}
+
+// Skip a watermark list: a count, then per entry a name (length and
+// bytes) and entry_size bytes of values.
+static bool SkipRecordWatermarks(const uint8_t*& p, const uint8_t* end, int64_t entry_size) {
+	int32_t count;
+	if (!ReadRecordVarint(p, end, &count) || count < 0) return false;
+	for (int32_t i = 0; i < count; i++) {
+		int32_t name_len;
+		if (!ReadRecordVarint(p, end, &name_len) || name_len < 0) return false;
+		if (end - p < name_len + entry_size) return false;
+		p += name_len + entry_size;
+	}
+	return true;
+}
+
+static int64_t RecordChecksum(const uint8_t* p, int64_t len) {
+	uint64_t x = 0;
+	int64_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		x ^= w;
+	}
+	if (i < len) {
+		uint64_t tail = 0;
+		memcpy(&tail, p + i, (size_t)(len - i));
+		x ^= tail;
+	}
+	return (int64_t)x;
+}
+
+// The end of the last complete record, with a valid checksum and in
+// sequence, in the first size bytes of the file.
+// RETURN: the offset, or -1.
+static int64_t LogRecordsEnd(int fd, int64_t size) {
+	void* map = mmap(nullptr, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		std::cerr << "mmap of the log failed with error: " << strerror(errno) << std::endl;
+		return -1;
+	}
+	const uint8_t* base = (const uint8_t*)map;
+	const uint8_t* end = base + size;
+	int64_t offset = 0, next_seq = -1;
+	while (size - offset >= kRecordHeaderSize) {
+		const uint8_t* h = base + offset;
+		int32_t total_size;
+		int64_t checksum, seq_id;
+		memcpy(&total_size, h + 4, sizeof(total_size)); // Records are not aligned.
+		memcpy(&checksum, h + 8, sizeof(checksum));
+		memcpy(&seq_id, h + 16, sizeof(seq_id));
+		if (total_size < kRecordHeaderSize || size - offset < total_size) break;
+		if (next_seq >= 0 && seq_id != next_seq) break;
+		const uint8_t* p = h + total_size;
+		if (!SkipRecordWatermarks(p, end, 16) || !SkipRecordWatermarks(p, end, 8)) break;
+		if (RecordChecksum(h + kRecordHeaderSize, total_size - kRecordHeaderSize) != checksum) break;
+		offset = p - base;
+		next_seq = seq_id + 1;
+	}
+	munmap(map, (size_t)size);
+	return offset;
+}
+
+static AdvLogFile* ToLog(intptr_t log) {
+	return (AdvLogFile*)log;
+}
+
+extern "C"
+intptr_t LogFileOpen(const char** filename, int mode, int64_t prealloc_size, int32_t buffer_size)
+{
+	intptr_t fd = OpenFileDirect(filename, 1);
+	if (fd < 0) return 0;
+
+	struct stat st;
+	if (fstat((int)fd, &st) != 0) {
+		std::cerr << "fstat failed with error: " << strerror(errno) << std::endl;
+		close((int)fd);
+		return 0;
+	}
+	int64_t start = mode == ADV_LOG_APPEND ? st.st_size : 0;
+	if (mode == ADV_LOG_APPEND_RECORDS && st.st_size > 0) {
+		// After a crash the size is no guide: the last round was padded to
+		// a block, and a segment is preallocated.  Replay stops at the first
+		// bad record, so continue there, and clear what follows so that no
+		// stale record can turn up after the new ones.
+		start = LogRecordsEnd((int)fd, st.st_size);
+		if (start < 0 || !ZeroFileRange(fd, start, st.st_size, 0)) {
+			close((int)fd);
+			return 0;
+		}
+	}
+	if (mode == ADV_LOG_TRUNCATE && st.st_size > 0 && ftruncate((int)fd, 0) != 0) {
+		std::cerr << "ftruncate failed with error: " << strerror(errno) << std::endl;
+		close((int)fd);
+		return 0;
+	}
+	if (mode == ADV_LOG_TRUNCATE) st.st_size = 0;
+	// Allocate ahead but keep the size: a reopen after a crash must not
+	// take the preallocated space for log.
+	if (prealloc_size > st.st_size && !SetFileSizeEx(fd, prealloc_size, ADV_KEEP_SIZE)) {
+		close((int)fd);
+		return 0;
+	}
+
+	AdvLogFile* log = new AdvLogFile();
+	log->fd = (int)fd;
+	log->block = GetLogicalBlockSize(fd);
+	int64_t cap = buffer_size > 0 ? buffer_size : kDefaultBufferSize;
+	if (cap < kMinBufferSize) cap = kMinBufferSize;
+	if (cap > 60 * kMaxWrite) cap = 60 * kMaxWrite;
+	log->capacity = (cap + log->block - 1) / log->block * log->block;
+	log->pool = BufferPoolCreate(log->capacity + log->block, 2, 0);
+	if (log->pool == 0) {
+		close(log->fd);
+		delete log;
+		return 0;
+	}
+
+	// Appending: reload the partial last block, which will be rewritten.
+	log->fill = (char*)BufferPoolLease(log->pool, 0);
+	log->spare = (char*)BufferPoolLease(log->pool, 0);
+	log->fill_base = start - start % log->block;
+	log->fill_len = start - log->fill_base;
+	if (log->fill_len > 0 &&
+		pread(log->fd, log->fill, (size_t)log->block, (off_t)log->fill_base) < log->fill_len) {
+		std::cerr << "Reading the end of the log failed with error: " << strerror(errno) << std::endl;
+		BufferPoolDestroy(log->pool);
+		close(log->fd);
+		delete log;
+		return 0;
+	}
+	log->written = log->durable = log->sync_target = start;
+
+	const char* v = getenv("AMBROSIA_NO_IO_URING");
+	if (v == nullptr || atoi(v) == 0) {
+		// Enough entries for a full buffer of writes plus the sync.
+		unsigned entries = 8;
+		while (entries < log->capacity / kMaxWrite + 3) entries *= 2;
+		if (UringInit(&log->ring, entries) && !UringSupportsLogOps(&log->ring))
+			UringFree(&log->ring);
+		if (log->ring.fd >= 0) {
+			void* base;
+			int64_t size;
+			int huge;
+			BufferPoolRegion(log->pool, &base, &size, &huge);
+			UringRegister(&log->ring, (char*)base, size);
+		}
+	}
+	log->io_thread = std::thread(IoThread, log);
+	return (intptr_t)log;
+}
+
+extern "C"
+int64_t LogFileAppend(intptr_t handle, const void* buf, int64_t len)
+{
+	AdvLogFile* log = ToLog(handle);
+	const char* src = (const char*)buf;
+	std::unique_lock<std::mutex> lock(log->mutex);
+	while (len > 0) {
+		if (log->error) {
+			errno = log->error;
+			return -1;
+		}
+		int64_t room = log->capacity - log->fill_len;
+		if (room == 0) {
+			log->work.notify_one();
+			log->done.wait(lock);
+			continue;
+		}
+		int64_t n = len < room ? len : room;
+		memcpy(log->fill + log->fill_len, src, (size_t)n);
+		log->fill_len += n;
+		src += n; len -= n;
+		if (log->fill_len >= log->capacity / 2) log->work.notify_one();
+	}
+	return log->fill_base + log->fill_len;
+}
+
+// Ask for a sync up to upto (everything appended, if negative).
+// RETURN: the target.  The caller holds the mutex.
+static int64_t RequestSync(AdvLogFile* log, int64_t upto) {
+	int64_t tail = log->fill_base + log->fill_len;
+	if (upto < 0 || upto > tail) upto = tail;
+	log->flushes++;
+	if (upto > log->sync_target) {
+		log->sync_target = upto;
+		log->work.notify_one();
+	}
+	return upto;
+}
+
+extern "C"
+int LogFileFlush(intptr_t handle, int64_t upto)
+{
+	AdvLogFile* log = ToLog(handle);
+	std::unique_lock<std::mutex> lock(log->mutex);
+	upto = RequestSync(log, upto);
+	log->done.wait(lock, [log, upto] { return log->error || log->durable >= upto; });
+	if (log->error) {
+		errno = log->error;
+		return 0;
+	}
+	return 1;
+}
+
+extern "C"
+int LogFileFlushAsync(intptr_t handle, int64_t upto, LogFileCallback callback, intptr_t context)
+{
+	AdvLogFile* log = ToLog(handle);
+	std::unique_lock<std::mutex> lock(log->mutex);
+	if (log->error) {
+		errno = log->error;
+		return 0;
+	}
+	upto = RequestSync(log, upto);
+	if (log->durable >= upto) {
+		int64_t durable = log->durable;
+		lock.unlock();
+		callback(context, durable, 1);
+		return 1;
+	}
+	log->callbacks.push_back(FlushCallback{ upto, callback, context });
+	return 1;
+}
+
+extern "C"
+int64_t LogFileSize(intptr_t handle)
+{
+	AdvLogFile* log = ToLog(handle);
+	std::lock_guard<std::mutex> lock(log->mutex);
+	return log->fill_base + log->fill_len;
+}
+
+extern "C"
+int64_t LogFileDurable(intptr_t handle)
+{
+	AdvLogFile* log = ToLog(handle);
+	std::lock_guard<std::mutex> lock(log->mutex);
+	return log->durable;
+}
+
+extern "C"
+void LogFileGetStats(intptr_t handle, int64_t* flushes, int64_t* syncs, int* using_io_uring)
+{
+	AdvLogFile* log = ToLog(handle);
+	std::lock_guard<std::mutex> lock(log->mutex);
+	*flushes = log->flushes;
+	*syncs = log->syncs;
+	*using_io_uring = log->ring.fd < 0 ? 0 : log->ring.registered ? 2 : 1;
+}
+
+extern "C"
+int LogFileClose(intptr_t handle)
+{
+	AdvLogFile* log = ToLog(handle);
+	{
+		std::lock_guard<std::mutex> lock(log->mutex);
+		log->closing = true;
+		log->work.notify_one();
+	}
+	log->io_thread.join();
+
+	int ok = log->error == 0;
+	int64_t size = log->fill_base + log->fill_len;
+	if (ok && ftruncate(log->fd, (off_t)size) != 0) {
+		std::cerr << "ftruncate failed with error: " << strerror(errno) << std::endl;
+		ok = 0;
+	}
+	int err = ok ? 0 : (log->error ? log->error : errno);
+	UringFree(&log->ring);
+	close(log->fd);
+	BufferPoolDestroy(log->pool);
+	delete log;
+	errno = err;
+	return ok;
+}
@@ -0,0 +1,311 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Preallocated log segments, kept ready in the background.  See
+// adv-file-ops.h for the ABI.
+//
+// A new log file normally pays for its creation and extent allocation
+// just as the service switches to it, which shows up as a latency spike
+// at every rollover.  The segment manager keeps a few spare files next
+// to the log, already allocated to the segment size (and optionally
+// pre-zeroed), and rollover takes one with a single rename.  Trimmed
+// files are recycled into spares rather than deleted: their extents are
+// zeroed in place (FALLOC_FL_ZERO_RANGE), which is far cheaper than
+// freeing them and allocating new ones.
+//
+// Spares are named <prefix>.spare.<owner>.<n>, and are built under a
+// .tmp name and renamed once complete, so a crash never leaves a partial
+// spare that looks ready.  The owner is <host>-<pid> of the manager that
+// made it.  Active/active replicas share the log directory, and each runs
+// a manager: ready spares are shared (a take that loses a race moves on),
+// but .tmp and recycling files belong to their owner.  A new manager
+// cleans up only those whose owner is a dead process on this host.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "adv-file-ops.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct AdvSegmentManager {
+	std::string dir;               // Directory of the segments.
+	std::string prefix;            // Full path prefix of spare names.
+	std::string owner;             // <host>-<pid>, in file names.
+	int64_t segment_size;
+	int32_t spares;
+	int flags;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::condition_variable work;  // Wakes the background thread.
+	std::condition_variable ready_cv;
+	std::deque<std::string> ready;     // Spares ready to take.
+	std::deque<std::string> recycling; // Files waiting to be zeroed.
+	bool stopping = false;
+	int64_t next_id = 0;
+	int64_t taken = 0;
+	int64_t recycled = 0;
+	int64_t missed = 0;
+};
+
+static AdvSegmentManager* ToManager(intptr_t mgr) {
+	return (AdvSegmentManager*)mgr;
+}
+
+// Make renames and creations in the directory durable.
+static void SyncDirectory(const std::string& dir) {
+	int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) return;
+	fsync(fd);
+	close(fd);
+}
+
+// A unique name for the next spare or recycled file.  Holds the mutex.
+static std::string NextName(AdvSegmentManager* mgr, const char* kind) {
+	return mgr->prefix + kind + mgr->owner + "." + std::to_string((long long)mgr->next_id++);
+}
+
+static std::string Hostname() {
+	char host[256];
+	if (gethostname(host, sizeof(host)) != 0) return "localhost";
+	host[sizeof(host) - 1] = 0;
+	std::string name = host;
+	for (char& c : name) {
+		if (c == '.' || c == '/') c = '_'; // Keep <owner>.<n> parseable.
+	}
+	return name;
+}
+
+// Whether the manager that named a file <kind><owner>.<n>[.tmp] (rest is
+// what follows kind) may still be using it.  Another host's processes
+// cannot be checked, so they count as alive.
+static bool OwnerAlive(AdvSegmentManager* mgr, const std::string& rest) {
+	size_t dot = rest.find('.');
+	std::string owner = rest.substr(0, dot);
+	size_t dash = owner.rfind('-');
+	if (dot == std::string::npos || dash == std::string::npos) return true;
+	if (owner.compare(0, dash, mgr->owner, 0, mgr->owner.rfind('-')) != 0) return true;
+	pid_t pid = (pid_t)atol(owner.c_str() + dash + 1);
+	if (pid <= 0) return true;
+	// This process: an earlier manager, stopped (its thread joined).
+	if (pid == getpid()) return false;
+	return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// Bring the file at path to the segment size with its contents zeroed,
+// allocated and synced.
+static bool PrepareSegment(AdvSegmentManager* mgr, const std::string& path, bool create) {
+	const char* name = path.c_str();
+	intptr_t fd = OpenFileDirect(&name, create ? 1 : 0);
+	if (fd < 0) return false;
+	struct stat st;
+	bool ok = fstat((int)fd, &st) == 0;
+	int64_t old_size = ok ? st.st_size : 0;
+	if (ok && old_size > 0) {
+		int64_t keep = old_size < mgr->segment_size ? old_size : mgr->segment_size;
+		if (old_size > mgr->segment_size) ok = SetFileSizeEx(fd, mgr->segment_size, 0) != 0;
+		if (ok) ok = ZeroFileRange(fd, 0, keep, mgr->flags) != 0;
+	}
+	if (ok) ok = SetFileSizeEx(fd, mgr->segment_size, mgr->flags) != 0;
+	if (ok && fsync((int)fd) != 0) {
+		std::cerr << "fsync of segment " << path << " failed: " << strerror(errno) << std::endl;
+		ok = false;
+	}
+	close((int)fd);
+	return ok;
+}
+
+static void SegmentThread(AdvSegmentManager* mgr) {
+	std::unique_lock<std::mutex> lock(mgr->mutex);
+	for (;;) {
+		mgr->work.wait(lock, [mgr] {
+			return mgr->stopping || !mgr->recycling.empty() ||
+				(int32_t)mgr->ready.size() < mgr->spares;
+		});
+		if (mgr->stopping) return;
+
+		bool recycle = !mgr->recycling.empty();
+		std::string source;
+		if (recycle) {
+			source = mgr->recycling.front();
+			mgr->recycling.pop_front();
+		}
+		std::string tmp = NextName(mgr, ".spare.") + ".tmp";
+		lock.unlock();
+
+		bool ok;
+		if (recycle) {
+			ok = rename(source.c_str(), tmp.c_str()) == 0 && PrepareSegment(mgr, tmp, false);
+		} else {
+			ok = PrepareSegment(mgr, tmp, true);
+		}
+		std::string spare = tmp.substr(0, tmp.size() - 4);
+		if (ok && rename(tmp.c_str(), spare.c_str()) != 0) ok = false;
+		if (ok) SyncDirectory(mgr->dir);
+		if (!ok) {
+			unlink(tmp.c_str());
+			if (recycle) unlink(source.c_str());
+		}
+
+		lock.lock();
+		if (ok) {
+			mgr->ready.push_back(spare);
+			if (recycle) mgr->recycled++;
+			mgr->ready_cv.notify_all();
+		} else if (!recycle) {
+			// Out of space, most likely.  Try again later rather than spin.
+			lock.unlock();
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			lock.lock();
+		}
+	}
+}
+
+// Adopt the ready spares in the directory, and clean up after managers
+// that died.
+static void AdoptSpares(AdvSegmentManager* mgr) {
+	std::string base = mgr->prefix.substr(mgr->dir.size() + 1);
+	std::string spare = base + ".spare.", recycle = base + ".recycle.";
+	DIR* d = opendir(mgr->dir.c_str());
+	if (d == nullptr) return;
+	while (struct dirent* e = readdir(d)) {
+		std::string name = e->d_name;
+		std::string path = mgr->dir + "/" + name;
+		if (name.compare(0, spare.size(), spare) == 0) {
+			bool alive = OwnerAlive(mgr, name.substr(spare.size()));
+			if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+				if (!alive) unlink(path.c_str());
+			} else {
+				struct stat st;
+				if (stat(path.c_str(), &st) == 0 && st.st_size == mgr->segment_size)
+					mgr->ready.push_back(path);
+				else if (!alive)
+					mgr->recycling.push_back(path);
+			}
+		} else if (name.compare(0, recycle.size(), recycle) == 0) {
+			if (!OwnerAlive(mgr, name.substr(recycle.size()))) mgr->recycling.push_back(path);
+		}
+	}
+	closedir(d);
+}
+
+extern "C"
+intptr_t SegmentManagerCreate(const char** prefix, int64_t segment_size, int32_t spares, int flags)
+{
+	if (segment_size <= 0 || spares < 0) {
+		errno = EINVAL;
+		return 0;
+	}
+	AdvSegmentManager* mgr = new AdvSegmentManager();
+	mgr->prefix = *prefix;
+	size_t slash = mgr->prefix.rfind('/');
+	mgr->dir = slash == std::string::npos ? "." : mgr->prefix.substr(0, slash);
+	if (slash == std::string::npos) mgr->prefix = "./" + mgr->prefix;
+	mgr->segment_size = segment_size;
+	mgr->spares = spares;
+	mgr->flags = flags;
+	mgr->owner = Hostname() + "-" + std::to_string((long long)getpid());
+	AdoptSpares(mgr);
+	mgr->thread = std::thread(SegmentThread, mgr);
+	return (intptr_t)mgr;
+}
+
+extern "C"
+int SegmentManagerTake(intptr_t handle, const char** path, int wait)
+{
+	AdvSegmentManager* mgr = ToManager(handle);
+	std::unique_lock<std::mutex> lock(mgr->mutex);
+	for (;;) {
+		if (wait && mgr->spares > 0)
+			mgr->ready_cv.wait(lock, [mgr] { return !mgr->ready.empty() || mgr->stopping; });
+		if (mgr->ready.empty()) {
+			mgr->missed++;
+			return 0;
+		}
+		std::string spare = mgr->ready.front();
+		mgr->ready.pop_front();
+		mgr->work.notify_one();
+		lock.unlock();
+
+		// Replaces any file already at path.
+		if (rename(spare.c_str(), *path) == 0) {
+			SyncDirectory(mgr->dir);
+			lock.lock();
+			mgr->taken++;
+			return 1;
+		}
+		int err = errno;
+		lock.lock();
+		if (err != ENOENT) {
+			// ENOENT: another process took this one.  Otherwise give up.
+			std::cerr << "Renaming segment " << spare << " to " << *path << " failed: " << strerror(err) << std::endl;
+			mgr->missed++;
+			errno = err;
+			return 0;
+		}
+	}
+}
+
+extern "C"
+int SegmentManagerRecycle(intptr_t handle, const char** path)
+{
+	AdvSegmentManager* mgr = ToManager(handle);
+	std::unique_lock<std::mutex> lock(mgr->mutex);
+	// Keep up to twice the spares, so that in a steady state of taking and
+	// recycling no new segment is ever allocated.
+	if ((int32_t)(mgr->ready.size() + mgr->recycling.size()) >= 2 * mgr->spares) {
+		lock.unlock();
+		if (unlink(*path) != 0 && errno != ENOENT) return 0;
+		return 1;
+	}
+	// Renamed right away, so the caller's name is free for reuse at once.
+	std::string name = NextName(mgr, ".recycle.");
+	lock.unlock();
+	if (rename(*path, name.c_str()) != 0) return errno == ENOENT;
+	lock.lock();
+	mgr->recycling.push_back(name);
+	mgr->work.notify_one();
+	return 1;
+}
+
+extern "C"
+void SegmentManagerGetStats(intptr_t handle, int64_t* ready, int64_t* taken, int64_t* recycled, int64_t* missed)
+{
+	AdvSegmentManager* mgr = ToManager(handle);
+	std::lock_guard<std::mutex> lock(mgr->mutex);
+	*ready = (int64_t)mgr->ready.size();
+	*taken = mgr->taken;
+	*recycled = mgr->recycled;
+	*missed = mgr->missed;
+}
+
+extern "C"
+void SegmentManagerDestroy(intptr_t handle)
+{
+	AdvSegmentManager* mgr = ToManager(handle);
+	{
+		std::lock_guard<std::mutex> lock(mgr->mutex);
+		mgr->stopping = true;
+		mgr->work.notify_one();
+		mgr->ready_cv.notify_all();
+	}
+	mgr->thread.join();
+	delete mgr;
+}
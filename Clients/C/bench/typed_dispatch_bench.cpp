@@ -0,0 +1,164 @@
+
+// Compare the compile-time typed proxy/dispatcher (ambrosia/interface.hpp)
+// against the hand-written switch and manual byte packing used by the
+// C examples.  Both paths encode the same stream of messages into
+// memory and decode it again, so any difference is down to the code
+// generated for serialization and dispatch.
+//
+// Usage: typed_dispatch_bench.exe [messages]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#include "ambrosia/interface.hpp"
+#include "ambrosia/internal/bits.h" // amb_current_time_seconds
+
+// Handlers shared by both paths:
+// ------------------------------------------------------------
+
+static int64_t g_sum = 0;
+
+static void on_tick(int32_t round) { g_sum += round; }
+static void on_point(int32_t x, int64_t y, double z) { g_sum += x + y + (int64_t)z; }
+static void on_payload(int32_t round, ambrosia::bytes b) { g_sum += round + b.size + b.data[0]; }
+
+enum MethodTable { TICK_ID=40, POINT_ID=41, PAYLOAD_ID=42 };
+
+using bench_iface = ambrosia::interface<
+  ambrosia::method<TICK_ID,    &on_tick>,
+  ambrosia::method<POINT_ID,   &on_point>,
+  ambrosia::method<PAYLOAD_ID, &on_payload> >;
+
+static_assert(bench_iface::id_of<&on_point> == POINT_ID, "constexpr method IDs");
+
+// The hand-written path, as in service.c:
+// ------------------------------------------------------------
+
+static char* hand_encode(char* cur, char* dest, int32_t destLen, int i, const char* payload, int plen) {
+  switch (i % 3) {
+  case 0: {
+    int32_t round = i;
+    cur = (char*)amb_write_outgoing_rpc_hdr(cur, dest, destLen, 0, TICK_ID, 1, 4);
+    memcpy(cur, &round, 4); cur += 4;
+    break; }
+  case 1: {
+    int32_t x = i; int64_t y = 2*i; double z = 0.5*i;
+    cur = (char*)amb_write_outgoing_rpc_hdr(cur, dest, destLen, 0, POINT_ID, 1, 20);
+    memcpy(cur, &x, 4); cur += 4;
+    memcpy(cur, &y, 8); cur += 8;
+    memcpy(cur, &z, 8); cur += 8;
+    break; }
+  default: {
+    int32_t round = i;
+    cur = (char*)amb_write_outgoing_rpc_hdr(cur, dest, destLen, 0, PAYLOAD_ID, 1, 4 + plen);
+    memcpy(cur, &round, 4); cur += 4;
+    memcpy(cur, payload, plen); cur += plen;
+    break; }
+  }
+  return cur;
+}
+
+static void hand_dispatch(int32_t methodID, void* args, int argsLen) {
+  char* a = (char*)args;
+  switch (methodID) {
+  case TICK_ID: {
+    int32_t round; memcpy(&round, a, 4);
+    on_tick(round);
+    break; }
+  case POINT_ID: {
+    int32_t x; int64_t y; double z;
+    memcpy(&x, a, 4); memcpy(&y, a+4, 8); memcpy(&z, a+12, 8);
+    on_point(x, y, z);
+    break; }
+  case PAYLOAD_ID: {
+    int32_t round; memcpy(&round, a, 4);
+    on_payload(round, ambrosia::bytes{ a+4, argsLen-4 });
+    break; }
+  default:
+    fprintf(stderr, "ERROR: cannot dispatch unknown method ID: %d\n", methodID);
+    abort();
+  }
+}
+
+// The typed path:
+// ------------------------------------------------------------
+
+static char* typed_encode(char* cur, char* dest, int32_t destLen, int i, const char* payload, int plen) {
+  using P = ambrosia::proxy<bench_iface>;
+  switch (i % 3) {
+  case 0:  return P::encode<&on_tick>(cur, dest, destLen, i);
+  case 1:  return P::encode<&on_point>(cur, dest, destLen, i, (int64_t)2*i, 0.5*i);
+  default: return P::encode<&on_payload>(cur, dest, destLen, i, ambrosia::bytes{ payload, plen });
+  }
+}
+
+static void typed_dispatch(int32_t methodID, void* args, int argsLen) {
+  if (!bench_iface::dispatch(methodID, args, argsLen)) {
+    fprintf(stderr, "ERROR: cannot dispatch method ID %d with %d bytes\n", methodID, argsLen);
+    abort();
+  }
+}
+
+// Callbacks required by libambrosia (unused, nothing is sent here):
+extern "C" void amb_dispatch_method(int32_t methodID, void* args, int argsLen) {
+  typed_dispatch(methodID, args, argsLen);
+}
+extern "C" void send_dummy_checkpoint(int upfd) { (void)upfd; }
+
+// Driver
+// ------------------------------------------------------------
+
+// Walk a buffer of outgoing messages and hand each to the dispatcher.
+template <typename D>
+static void decode_all(char* buf, char* limit, D dispatch) {
+  char* cur = buf;
+  while (cur < limit) {
+    int32_t size, destLen, methodID;
+    cur = (char*)read_zigzag_int(cur, &size);
+    char* end = cur + size;
+    cur++;                                     // Type
+    cur = (char*)read_zigzag_int(cur, &destLen);
+    cur += destLen + 1;                        // Dest, RPC_or_RetVal
+    cur = (char*)read_zigzag_int(cur, &methodID);
+    cur++;                                     // Fire and forget
+    dispatch(methodID, cur, (int)(end - cur));
+    cur = end;
+  }
+}
+
+template <typename E, typename D>
+static void run(const char* label, long msgs, E encode, D dispatch) {
+  char dest[] = "bench";
+  char payload[64];
+  for (int i = 0; i < (int)sizeof(payload); i++) payload[i] = (char)(i+1);
+  std::vector<char> buf(msgs * 128);
+
+  g_sum = 0;
+  double t0 = amb_current_time_seconds();
+  char* cur = buf.data();
+  for (long i = 0; i < msgs; i++)
+    cur = encode(cur, dest, 5, (int)i, payload, (int)sizeof(payload));
+  double t1 = amb_current_time_seconds();
+  decode_all(buf.data(), cur, dispatch);
+  double t2 = amb_current_time_seconds();
+
+  printf("%-6s  encode %6.2lf ns/msg   decode+dispatch %6.2lf ns/msg   bytes %ld  checksum %lld\n",
+         label, (t1-t0) * 1e9 / msgs, (t2-t1) * 1e9 / msgs,
+         (long)(cur - buf.data()), (long long)g_sum);
+}
+
+int main(int argc, char** argv)
+{
+  long msgs = 10 * 1000 * 1000;
+  if (argc >= 2) msgs = atol(argv[1]);
+
+  for (int trial = 0; trial < 3; trial++) {
+    run("hand",  msgs, hand_encode,  hand_dispatch);
+    run("typed", msgs, typed_encode, typed_dispatch);
+  }
+  return 0;
+}
@@ -0,0 +1,547 @@
+
+// A workload-driven throughput and latency benchmark for the client
+// runtime.
+//
+// One DRIVER client sends WORK messages to one or more SINK clients,
+// which answer each one with an ACK.  The driver measures the time
+// from each message's (intended) send time to its ACK.  Each workload
+// is one line of "key=value" settings:
+//
+//   name=small-closed size=fixed:64 mode=closed concurrency=32 duration=5
+//   name=open-10k     size=uniform:16:4096 mode=open rate=10000 fanout=2 duration=5
+//
+//   size=        fixed:N | uniform:MIN:MAX | bimodal:SMALL:LARGE:PCT_LARGE |
+//                pow2:MIN:MAX  (argument bytes per message; at least 12;
+//                               pow2 needs a power of two in range)
+//   mode=        closed (keep `concurrency` messages outstanding) or
+//                open (send at `rate` messages/second, whatever the replies do)
+//   fanout=N     spread messages round-robin over the first N destinations
+//   duration=S   stop sending after S seconds, and/or
+//   bytes=N, messages=N   stop after this much work
+//   warmup=S     don't measure the first S seconds (default 1)
+//
+// In open mode, latency is measured from the time each message was
+// scheduled to be sent, so time spent queued behind a slow sender
+// counts against the runtime.
+//
+// Each workload prints one JSON object (or CSV row, with -o csv):
+// throughput, latency percentiles, process CPU time per message, and
+// the send() calls made by the runtimes in this process.
+//
+// Usage:
+//   workload_bench.exe [-w WORKLOAD]... [-f FILE] [-d DEST]... [-o json|csv] [-b BUFSZ]
+//                      driver:upport:downport [sink:upport:downport ...]
+//   workload_bench.exe -S sink:upport:downport
+//
+// Sinks listed after the driver run inside this process; -d names
+// sinks running elsewhere (started with -S).  Every client needs its
+// own coordinator ports, e.g. from bin/mock_coordinator.exe.
+
+// Linux only.
+
+#define _GNU_SOURCE // ppoll
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "ambrosia/client.h"
+#include "ambrosia/histogram.h"
+#include "ambrosia/internal/bits.h" // amb_monotonic_ns
+
+// STARTUP_ID is the call the runtime puts in every InitialMessage.
+enum MethodTable { STARTUP_ID=32, HELLO_ID=50, WORK_ID=51, ACK_ID=52, BYE_ID=53 };
+
+#define MAX_DESTS 64
+#define MAX_WORKLOADS 256
+
+// Workloads
+//------------------------------------------------------------------------------
+
+enum size_dist { SIZE_FIXED, SIZE_UNIFORM, SIZE_BIMODAL, SIZE_POW2 };
+
+struct workload {
+  char    name[64];
+  char    size_spec[64];
+  int     dist;
+  int     size_a, size_b, size_pct;
+  int     open;         // Open loop (rate) instead of closed loop (concurrency).
+  int     concurrency;
+  double  rate;
+  int     fanout;
+  double  duration;
+  double  warmup;
+  int64_t byte_budget;
+  int64_t msg_budget;
+};
+
+static int parse_size(struct workload* w, const char* spec) {
+  snprintf(w->size_spec, sizeof(w->size_spec), "%s", spec);
+  w->size_pct = 0;
+  if (sscanf(spec, "fixed:%d", &w->size_a) == 1) {
+    w->dist = SIZE_FIXED; w->size_b = w->size_a;
+  } else if (sscanf(spec, "uniform:%d:%d", &w->size_a, &w->size_b) == 2) {
+    w->dist = SIZE_UNIFORM;
+  } else if (sscanf(spec, "bimodal:%d:%d:%d", &w->size_a, &w->size_b, &w->size_pct) == 3) {
+    w->dist = SIZE_BIMODAL;
+  } else if (sscanf(spec, "pow2:%d:%d", &w->size_a, &w->size_b) == 2) {
+    w->dist = SIZE_POW2;
+  } else return -1;
+  if (w->size_a < 12) w->size_a = 12; // Room for the timestamp and size.
+  if (w->size_b < w->size_a) w->size_b = w->size_a;
+  if (w->dist == SIZE_POW2) {
+    // Reject a range with no power of two in it (say pow2:12:14).
+    int64_t p = 1;
+    while (p < w->size_a) p <<= 1;
+    if (p > w->size_b) return -1;
+  }
+  return 0;
+}
+
+// Parse "key=value key=value ...".  RETURN: 0, or -1 on a bad setting.
+static int parse_workload(struct workload* w, char* line) {
+  memset(w, 0, sizeof(*w));
+  snprintf(w->name, sizeof(w->name), "workload");
+  parse_size(w, "fixed:64");
+  w->concurrency = 1;
+  w->fanout = 1;
+  w->warmup = 1.0;
+  for (char* tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+    char* val = strchr(tok, '=');
+    if (val == NULL) return -1;
+    *val++ = 0;
+    if      (strcmp(tok, "name") == 0)        snprintf(w->name, sizeof(w->name), "%s", val);
+    else if (strcmp(tok, "size") == 0)        { if (parse_size(w, val)) return -1; }
+    else if (strcmp(tok, "mode") == 0)        w->open = strcmp(val, "open") == 0;
+    else if (strcmp(tok, "concurrency") == 0) w->concurrency = atoi(val);
+    else if (strcmp(tok, "rate") == 0)        w->rate = atof(val);
+    else if (strcmp(tok, "fanout") == 0)      w->fanout = atoi(val);
+    else if (strcmp(tok, "duration") == 0)    w->duration = atof(val);
+    else if (strcmp(tok, "warmup") == 0)      w->warmup = atof(val);
+    else if (strcmp(tok, "bytes") == 0)       w->byte_budget = atoll(val);
+    else if (strcmp(tok, "messages") == 0)    w->msg_budget = atoll(val);
+    else return -1;
+  }
+  if (w->open && w->rate <= 0) return -1;
+  if (w->concurrency < 1 || w->fanout < 1) return -1;
+  if (w->duration <= 0 && w->byte_budget <= 0 && w->msg_budget <= 0) w->duration = 5;
+  return 0;
+}
+
+static uint64_t g_rng = 88172645463325252ULL;
+
+static inline uint64_t next_random() {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 7;
+  g_rng ^= g_rng << 17;
+  return g_rng;
+}
+
+static int draw_size(const struct workload* w) {
+  switch (w->dist) {
+  case SIZE_UNIFORM:
+    return w->size_a + (int)(next_random() % (uint64_t)(w->size_b - w->size_a + 1));
+  case SIZE_BIMODAL:
+    return (int)(next_random() % 100) < w->size_pct ? w->size_b : w->size_a;
+  case SIZE_POW2: {
+    int lo = 0, hi = 0;
+    while ((1 << lo) < w->size_a) lo++;
+    while (((int64_t)1 << (hi + 1)) <= w->size_b) hi++;
+    int s = 1 << (lo + (int)(next_random() % (uint64_t)(hi - lo + 1)));
+    return s < w->size_a ? w->size_a : s;
+  }
+  default:
+    return w->size_a;
+  }
+}
+
+
+// Sinks
+//------------------------------------------------------------------------------
+
+struct sink {
+  char  spec[128];
+  char  reply_to[128];
+  int   reply_len;
+  amb_client_t* client;
+  pthread_t thread;
+};
+
+static void sink_checkpoint(amb_client_t* c, int upfd) {
+  (void)upfd;
+  amb_client_send_checkpoint(c, "sink", 4);
+}
+
+static void sink_dispatch(amb_client_t* c, int32_t methodID, void* args, int argsLen) {
+  struct sink* s = (struct sink*)amb_client_user_data(c);
+  switch (methodID) {
+  case STARTUP_ID:
+    break;
+  case HELLO_ID:
+    s->reply_len = argsLen < (int)sizeof(s->reply_to) ? argsLen : (int)sizeof(s->reply_to);
+    memcpy(s->reply_to, args, s->reply_len);
+    amb_client_attach_if_needed(c, s->reply_to, s->reply_len);
+    break;
+  case WORK_ID: {
+    // Echo the timestamp, and say how big the message was:
+    char ack[12];
+    memcpy(ack, args, 8);
+    memcpy(ack + 8, &argsLen, 4);
+    char buf[256];
+    char* end = amb_write_outgoing_rpc(buf, s->reply_to, s->reply_len, 0, ACK_ID, 1, ack, sizeof(ack));
+    amb_client_send_bytes(c, buf, end - buf);
+    break;
+  }
+  case BYE_ID:
+    amb_client_shutdown(c);
+    break;
+  default:
+    fprintf(stderr, "ERROR: sink cannot dispatch method %d\n", methodID);
+    abort();
+  }
+}
+
+static void parse_endpoint(const char* spec, char* name, int* up, int* down) {
+  if (sscanf(spec, "%63[^:]:%d:%d", name, up, down) != 3) {
+    fprintf(stderr, "ERROR: expected name:upport:downport, got '%s'\n", spec);
+    exit(1);
+  }
+}
+
+static void run_sink(struct sink* s, int bufsz) {
+  char name[64];
+  int up, down;
+  parse_endpoint(s->spec, name, &up, &down);
+  s->client = amb_client_new();
+  amb_client_set_callbacks(s->client, sink_dispatch, sink_checkpoint, s);
+  amb_client_initialize(s->client, up, down, bufsz);
+  amb_client_processing_loop(s->client);
+}
+
+static int g_bufsz = 0;
+
+static void* sink_thread(void* arg) {
+  run_sink((struct sink*)arg, g_bufsz);
+  return NULL;
+}
+
+
+// The driver
+//------------------------------------------------------------------------------
+
+static amb_client_t* g_driver;
+static char  g_dests[MAX_DESTS][64];
+static int   g_ndests = 0;
+static struct sink g_sinks[MAX_DESTS];
+static int   g_nsinks = 0;
+
+// Per-workload progress, updated by ACKs:
+static struct amb_histogram g_hist;
+static int64_t g_outstanding;
+static int64_t g_measure_from;  // ACKs for messages stamped before this are warmup.
+static int64_t g_acked, g_acked_bytes, g_last_ack;
+
+static void driver_checkpoint(amb_client_t* c, int upfd) {
+  (void)upfd;
+  amb_client_send_checkpoint(c, "driver", 6);
+}
+
+static void driver_dispatch(amb_client_t* c, int32_t methodID, void* args, int argsLen) {
+  (void)c;
+  (void)argsLen;
+  if (methodID == STARTUP_ID) return;
+  if (methodID != ACK_ID) {
+    fprintf(stderr, "ERROR: driver cannot dispatch method %d\n", methodID);
+    abort();
+  }
+  int64_t stamp;
+  int32_t size;
+  memcpy(&stamp, args, 8);
+  memcpy(&size, (char*)args + 8, 4);
+  int64_t now = amb_monotonic_ns();
+  g_outstanding--;
+  if (stamp < g_measure_from) return;
+  amb_hist_record(&g_hist, now - stamp);
+  g_acked++;
+  g_acked_bytes += size;
+  g_last_ack = now;
+}
+
+static void send_to(int dest, int32_t methodID, const void* args, int argsLen) {
+  char buf[256];
+  char* end = amb_write_outgoing_rpc(buf, g_dests[dest], strlen(g_dests[dest]), 0,
+                                     methodID, 1, (void*)args, argsLen);
+  amb_client_send_bytes(g_driver, buf, end - buf);
+}
+
+// Build a WORK message directly in the ring.
+static void send_work(int dest, int size, int64_t stamp) {
+  int destLen = strlen(g_dests[dest]);
+  char* start = amb_client_reserve(g_driver, size + destLen + 32);
+  char* cur = (char*)amb_write_outgoing_rpc_hdr(start, g_dests[dest], destLen, 0, WORK_ID, 1, size);
+  memcpy(cur, &stamp, 8);
+  memset(cur + 8, 0, 4);
+  cur += size;
+  amb_client_release(g_driver, cur - start);
+  g_outstanding++;
+}
+
+// One step of the event loop: flush, wait up to timeout_ns for either
+// socket, and handle what arrived.
+static void pump(int64_t timeout_ns) {
+  int pending = amb_poll_send(g_driver);
+  struct pollfd fds[2] = {
+    { amb_client_recv_fd(g_driver), POLLIN, 0 },
+    { amb_client_send_fd(g_driver), POLLOUT, 0 },
+  };
+  struct timespec ts = { timeout_ns / 1000000000, timeout_ns % 1000000000 };
+  ppoll(fds, pending ? 2 : 1, &ts, NULL);
+  if (amb_poll_recv(g_driver, 64) < 0) {
+    fprintf(stderr, "ERROR: the coordinator closed the driver's connection\n");
+    exit(1);
+  }
+}
+
+static int64_t process_cpu_ns() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ((int64_t)ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000
+       + ((int64_t)ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+}
+
+static int64_t context_switches() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+static int64_t send_calls() {
+  struct amb_flush_stats st;
+  amb_client_flush_stats(g_driver, &st);
+  int64_t n = st.sends;
+  for (int i = 0; i < g_nsinks; i++) {
+    amb_client_flush_stats(g_sinks[i].client, &st);
+    n += st.sends;
+  }
+  return n;
+}
+
+struct result {
+  double  seconds;
+  int64_t cpu_ns, sends, switches;
+};
+
+static void run_workload(const struct workload* w, struct result* r) {
+  int fanout = w->fanout < g_ndests ? w->fanout : g_ndests;
+  int64_t start = amb_monotonic_ns();
+  int64_t warm_end = start + (int64_t)(w->warmup * 1e9);
+  int64_t stop = w->duration > 0 ? warm_end + (int64_t)(w->duration * 1e9) : INT64_MAX;
+  int64_t interval = w->open ? (int64_t)(1e9 / w->rate) : 0;
+  int64_t next_send = start;
+  int64_t stopped_at = 0;
+  int64_t sent = 0, sent_bytes = 0;
+  int measuring = 0, issuing = 1, dest = 0;
+  int64_t cpu0 = 0, sends0 = 0, switches0 = 0;
+
+  amb_hist_reset(&g_hist);
+  g_measure_from = warm_end;
+  g_acked = g_acked_bytes = 0;
+  g_last_ack = warm_end;
+
+  while (issuing || g_outstanding > 0) {
+    int64_t now = amb_monotonic_ns();
+    if (!measuring && now >= warm_end) {
+      measuring = 1;
+      cpu0 = process_cpu_ns(); sends0 = send_calls(); switches0 = context_switches();
+    }
+    if (issuing && (now >= stop ||
+                    (w->byte_budget > 0 && sent_bytes >= w->byte_budget) ||
+                    (w->msg_budget > 0 && sent >= w->msg_budget)))
+      issuing = 0;
+    if (!issuing && stopped_at == 0) stopped_at = now;
+    if (!issuing && now - stopped_at > 30 * (int64_t)1000000000) {
+      fprintf(stderr, "WARNING: %s: gave up on %lld outstanding messages\n",
+              w->name, (long long)g_outstanding);
+      break;
+    }
+    int64_t timeout = 1000000;
+    if (issuing) {
+      if (w->open) {
+        while (next_send <= now && issuing) {
+          int size = draw_size(w);
+          send_work(dest, size, next_send); // Latency counts from the intended time.
+          dest = (dest + 1) % fanout;
+          next_send += interval;
+          sent++; sent_bytes += size;
+          if (w->byte_budget > 0 && sent_bytes >= w->byte_budget) issuing = 0;
+          if (w->msg_budget > 0 && sent >= w->msg_budget) issuing = 0;
+        }
+        timeout = next_send - now > 0 ? next_send - now : 0;
+      } else {
+        while (g_outstanding < w->concurrency) {
+          int size = draw_size(w);
+          send_work(dest, size, amb_monotonic_ns());
+          dest = (dest + 1) % fanout;
+          sent++; sent_bytes += size;
+        }
+      }
+    }
+    pump(timeout);
+  }
+  if (!measuring) { // The budget ran out during warmup.
+    cpu0 = process_cpu_ns(); sends0 = send_calls(); switches0 = context_switches();
+  }
+  r->seconds  = (double)(g_last_ack - warm_end) / 1e9;
+  r->cpu_ns   = process_cpu_ns() - cpu0;
+  r->sends    = send_calls() - sends0;
+  r->switches = context_switches() - switches0;
+}
+
+static void report(const struct workload* w, const struct result* r, int csv, int first) {
+  double secs = r->seconds > 0 ? r->seconds : 1e-9;
+  double us = 1000.0;
+  int fanout = w->fanout < g_ndests ? w->fanout : g_ndests;
+  double cpu_per_msg = g_acked ? (double)r->cpu_ns / us / (double)g_acked : 0;
+  if (csv) {
+    if (first)
+      printf("workload,mode,size,fanout,concurrency,rate,messages,bytes,seconds,msgs_per_sec,mib_per_sec,"
+             "lat_mean_us,lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us,"
+             "cpu_us_per_msg,send_calls,context_switches\n");
+    printf("%s,%s,%s,%d,%d,%.0f,%lld,%lld,%.3f,%.1f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%lld,%lld\n",
+           w->name, w->open ? "open" : "closed", w->size_spec, fanout, w->concurrency, w->rate,
+           (long long)g_acked, (long long)g_acked_bytes, secs,
+           g_acked / secs, g_acked_bytes / secs / (1024.0 * 1024.0),
+           amb_hist_mean(&g_hist) / us,
+           amb_hist_percentile(&g_hist, 50) / us, amb_hist_percentile(&g_hist, 90) / us,
+           amb_hist_percentile(&g_hist, 99) / us, amb_hist_percentile(&g_hist, 99.9) / us,
+           g_hist.max / us, cpu_per_msg, (long long)r->sends, (long long)r->switches);
+  } else {
+    printf("{\"workload\":\"%s\",\"mode\":\"%s\",\"size\":\"%s\",\"fanout\":%d,\"concurrency\":%d,"
+           "\"rate\":%.0f,\"messages\":%lld,\"bytes\":%lld,\"seconds\":%.3f,"
+           "\"msgs_per_sec\":%.1f,\"mib_per_sec\":%.2f,"
+           "\"latency_us\":{\"mean\":%.2f,\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"p999\":%.2f,\"max\":%.2f},"
+           "\"cpu_us_per_msg\":%.3f,\"send_calls\":%lld,\"context_switches\":%lld}\n",
+           w->name, w->open ? "open" : "closed", w->size_spec, fanout, w->concurrency, w->rate,
+           (long long)g_acked, (long long)g_acked_bytes, secs,
+           g_acked / secs, g_acked_bytes / secs / (1024.0 * 1024.0),
+           amb_hist_mean(&g_hist) / us,
+           amb_hist_percentile(&g_hist, 50) / us, amb_hist_percentile(&g_hist, 90) / us,
+           amb_hist_percentile(&g_hist, 99) / us, amb_hist_percentile(&g_hist, 99.9) / us,
+           g_hist.max / us, cpu_per_msg, (long long)r->sends, (long long)r->switches);
+  }
+  fflush(stdout);
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-w WORKLOAD]... [-f FILE] [-d DEST]... [-o json|csv] [-b BUFSZ]\n"
+          "          driver:upport:downport [sink:upport:downport ...]\n"
+          "       %s -S sink:upport:downport\n"
+          "  A WORKLOAD is a line such as:\n"
+          "    name=x size=uniform:16:4096 mode=open rate=20000 fanout=2 duration=5\n"
+          "  (see the top of bench/workload_bench.c for every setting)\n", prog, prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  static struct workload workloads[MAX_WORKLOADS];
+  int nworkloads = 0;
+  int csv = 0;
+  char line[1024];
+  int opt;
+  while ((opt = getopt(argc, argv, "w:f:d:o:b:S:")) != -1) {
+    switch (opt) {
+    case 'w':
+      snprintf(line, sizeof(line), "%s", optarg);
+      if (nworkloads == MAX_WORKLOADS || parse_workload(&workloads[nworkloads++], line)) {
+        fprintf(stderr, "ERROR: bad workload: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'f': {
+      FILE* f = fopen(optarg, "r");
+      if (f == NULL) { perror(optarg); return 1; }
+      while (fgets(line, sizeof(line), f) != NULL) {
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == 0) continue;
+        if (nworkloads == MAX_WORKLOADS || parse_workload(&workloads[nworkloads++], p)) {
+          fprintf(stderr, "ERROR: bad workload in %s: %s\n", optarg, line);
+          return 1;
+        }
+      }
+      fclose(f);
+      break;
+    }
+    case 'd':
+      if (g_ndests == MAX_DESTS) usage(argv[0]);
+      snprintf(g_dests[g_ndests++], 64, "%s", optarg);
+      break;
+    case 'o': csv = strcmp(optarg, "csv") == 0; break;
+    case 'b': g_bufsz = atoi(optarg); break;
+    case 'S': {
+      struct sink* s = &g_sinks[0];
+      snprintf(s->spec, sizeof(s->spec), "%s", optarg);
+      run_sink(s, g_bufsz);
+      return 0;
+    }
+    default: usage(argv[0]);
+    }
+  }
+  if (optind == argc) usage(argv[0]);
+  if (nworkloads == 0) {
+    snprintf(line, sizeof(line), "name=default size=fixed:64 mode=closed concurrency=16 duration=5");
+    parse_workload(&workloads[nworkloads++], line);
+  }
+
+  // In-process sinks connect on their own threads, so the coordinator
+  // may accept the clients in any order.
+  for (int i = optind + 1; i < argc && g_ndests < MAX_DESTS; i++) {
+    struct sink* s = &g_sinks[g_nsinks++];
+    snprintf(s->spec, sizeof(s->spec), "%s", argv[i]);
+    int up, down;
+    parse_endpoint(argv[i], g_dests[g_ndests++], &up, &down);
+    pthread_create(&s->thread, NULL, sink_thread, s);
+  }
+  if (g_ndests == 0) {
+    fprintf(stderr, "ERROR: no destinations; list sinks after the driver, or use -d\n");
+    return 1;
+  }
+
+  char name[64];
+  int up, down;
+  parse_endpoint(argv[optind], name, &up, &down);
+  g_driver = amb_client_new();
+  amb_client_set_callbacks(g_driver, driver_dispatch, driver_checkpoint, NULL);
+  amb_client_initialize_polled(g_driver, up, down, g_bufsz);
+  for (int i = 0; i < g_nsinks; i++) // Wait until every sink is up.
+    while (g_sinks[i].client == NULL || amb_client_send_fd(g_sinks[i].client) < 0)
+      amb_sleep_seconds(0.001);
+
+  // Introduce ourselves to every destination:
+  for (int i = 0; i < g_ndests; i++) {
+    char attach[128];
+    int len = strlen(g_dests[i]);
+    char* cur = (char*)write_zigzag_int(attach, len + 1);
+    *cur++ = AttachTo;
+    memcpy(cur, g_dests[i], len);
+    amb_client_send_control(g_driver, attach, cur + len - attach);
+    send_to(i, HELLO_ID, name, strlen(name));
+  }
+
+  for (int i = 0; i < nworkloads; i++) {
+    struct result r;
+    run_workload(&workloads[i], &r);
+    report(&workloads[i], &r, csv, i == 0);
+  }
+
+  for (int i = 0; i < g_ndests; i++) send_to(i, BYE_ID, NULL, 0);
+  while (amb_poll_send(g_driver)) pump(10000000);
+  for (int i = 0; i < g_nsinks; i++) pthread_join(g_sinks[i].thread, NULL);
+  return 0;
+}
@@ -0,0 +1,106 @@
+
+// -----------------------------------------------------------------------------
+// A "hello world" for the C++20 coroutine layer (ambrosia/coroutine.hpp):
+// on startup, a coroutine awaits a chain of async/await RPCs to this
+// same instance and checks every reply.
+// -----------------------------------------------------------------------------
+
+// Against the stand-in coordinator (this is what "make coro-check" runs):
+//
+//   bin/mock_coordinator.exe coro:1500:1501 &
+//   bin/coro_hello.exe coro 1500 1501
+
+// Linux only.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ambrosia/client.h"
+#include "ambrosia/coroutine.hpp"
+
+enum MethodTable { STARTUP_MSG_ID=32, ADD_ID=40 };
+
+static char g_name[64];
+static int  g_failed = 1; // Until the chain of calls completes.
+
+// The callee: add two int32s and return the sum to the caller.
+static void add(int32_t a, int32_t b) {
+  int32_t sum = a + b;
+  amb_send_return_value(ReturnValue, &sum, sizeof(sum));
+}
+
+// The caller: one async/await RPC, suspended until its reply is
+// dispatched from the log.
+static ambrosia::task<int32_t> remote_add(int32_t a, int32_t b) {
+  int32_t args[2] = { a, b };
+  ambrosia::reply r = co_await ambrosia::call(g_name, (int32_t)strlen(g_name), ADD_ID,
+                                              args, sizeof(args));
+  if (r.type != ReturnValue || r.size != sizeof(int32_t)) {
+    fprintf(stderr, "ERROR: unexpected reply (type %d, %d bytes)\n", r.type, r.size);
+    abort();
+  }
+  int32_t sum;
+  memcpy(&sum, r.data, sizeof(sum));
+  co_return sum;
+}
+
+static ambrosia::task<void> startup() {
+  int32_t total = 0;
+  for (int32_t i = 1; i <= 10; i++) total = co_await remote_add(total, i);
+  printf("Sum of 1..10 through awaited calls: %d\n", total);
+  g_failed = total != 55;
+  amb_shutdown_client_runtime();
+}
+
+// Everything in this section should, in principle, be automatically GENERATED:
+//------------------------------------------------------------------------------
+
+static void dispatch(amb_client_t* client, int32_t methodID, void* args, int argsLen) {
+  (void)client;
+  switch (methodID) {
+  case STARTUP_MSG_ID:
+    ambrosia::spawn(startup());
+    break;
+  case ADD_ID: {
+    int32_t ab[2];
+    if (argsLen != (int)sizeof(ab)) {
+      fprintf(stderr, "ERROR: add expects %d bytes of arguments, got %d\n", (int)sizeof(ab), argsLen);
+      abort();
+    }
+    memcpy(ab, args, sizeof(ab));
+    add(ab[0], ab[1]);
+    break;
+  }
+  default:
+    fprintf(stderr, "ERROR: cannot dispatch unknown method ID: %d\n", methodID);
+    abort();
+  }
+}
+
+static void checkpoint(amb_client_t* client, int upfd) {
+  (void)upfd;
+  amb_client_send_checkpoint(client, "dummyckpt", 9);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s NAME UPPORT DOWNPORT\n", argv[0]);
+    return 2;
+  }
+  snprintf(g_name, sizeof(g_name), "%s", argv[1]);
+
+  amb_client_t* client = amb_client_new();
+  amb_client_set_callbacks(client, dispatch, checkpoint, NULL);
+  amb_client_set_instance_name(client, g_name);
+  amb_client_initialize(client, atoi(argv[2]), atoi(argv[3]), 0);
+
+  // Coroutine frames and resumptions belong to the processing thread:
+  ambrosia::runtime rt;
+  amb_client_processing_loop(client);
+  amb_client_close(client);
+
+  printf(g_failed ? "FAILED\n" : "coroutine check passed\n");
+  return g_failed;
+}
@@ -3,6 +3,8 @@
 #define AMBROSIA_CLIENT_HEADER
 
 #include <stdint.h>
+#include "ambrosia/histogram.h"
+#include "ambrosia/log.h"
 
 #ifdef _WIN32
   // #pragma comment(lib,"ws2_32.lib") //Winsock Library
@@ -13,6 +15,10 @@
 
 // #include "ambrosia/internal/bits.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // -------------------------------------------------
 // Data formats used by the AMBROSIA "wire protocol"
 // -------------------------------------------------
@@ -45,6 +51,21 @@ enum MsgType { RPC=0,                       //
 	       UpgradeService=12                  // no data
 };
 
+// The first data byte of an RPC message says whether it is a call or
+// a return value, and if the latter, what kind of return value.
+enum ReturnValueType { NotReturnValue=0,          // An ordinary call
+                       ReturnValue=1,             // Serialized value follows
+                       EmptyReturnValue=2,        // void method completed
+                       ExceptionReturnValue=3     // Serialized error follows
+};
+
+// The byte following the methodID of a call.  Async/await calls carry
+// a return address and a call ID so the callee can reply.
+enum RpcType { AsyncRPC=0,
+               FireAndForgetRPC=1,
+               ImpulseRPC=2
+};
+
 
 // Print extremely verbose debug output to stdout:
 #define amb_dbg_fd stderr
@@ -53,8 +74,19 @@ enum MsgType { RPC=0,                       //
 //------------------------------------------------------------------------------
 
 // FIXME: these should become PRIVATE to the library:
+// (They mirror the sockets of the default client.)
 extern int g_to_immortal_coord, g_from_immortal_coord;
 
+// One client runtime: its coordinator connections, outgoing ring,
+// network progress thread and application callbacks.  A process may
+// create any number of these, each hosting a separate immortal.
+typedef struct amb_client amb_client_t;
+
+// Application callbacks, registered per client.  The client is passed
+// back so one set of handlers can serve several instances.
+typedef void (*amb_dispatch_fn)(amb_client_t* client, int32_t methodID, void* args, int argsLen);
+typedef void (*amb_checkpoint_fn)(amb_client_t* client, int upfd);
+
 
 // Communicates with the server to establish normal operation.
 //
@@ -89,8 +121,27 @@ void* amb_write_outgoing_rpc_hdr(void* buf, char* dest, int32_t destLen, char RP
 void* amb_write_outgoing_rpc(void* buf, char* dest, int32_t destLen, char RPC_or_RetVal,
 			     int32_t methodID, char fireForget, void* args, int argsLen);
 
+// Write the header of an outgoing async/await call.  In addition to
+// the fields of a fire-and-forget call, this carries our own instance
+// name (the return address) and the call ID the reply will refer to.
+//
+// RETURN: a pointer to the byte following the bytes just written.
+void* amb_write_outgoing_async_rpc_hdr(void* buf, char* dest, int32_t destLen, int32_t methodID,
+                                       char* retAddr, int32_t retAddrLen, int64_t callID,
+                                       int argsLen);
+
+// Write the header of an outgoing return value, sent back to the
+// caller (dest) of the async/await call identified by callID.
+// retType is one of ReturnValue, EmptyReturnValue, ExceptionReturnValue.
+//
+// RETURN: a pointer to the byte following the bytes just written.
+void* amb_write_return_value_hdr(void* buf, char* dest, int32_t destLen, char retType,
+                                 char* retAddr, int32_t retAddrLen, int64_t callID,
+                                 int retLen);
+
 // Deprecated:
-// Send an RPC without any extra copies of the args.  Performs TWO send syscalls.
+// Send an RPC by copying its header and args into the current client's
+// outgoing ring.
 void amb_send_outgoing_rpc(void* tempbuf, char* dest, int32_t destLen, char RPC_or_RetVal,
 			   int32_t methodID, char fireForget, void* args, int argsLen);
 
@@ -101,15 +152,349 @@ void amb_recv_log_hdr(int sockfd, struct log_hdr* hdr);
 
 //------------------------------------------------------------------------------
 
-// USER DEFINED: FIXME: REPLACE W CALLBACK
+// USER DEFINED: the callbacks of the default client.  Only needed by
+// applications that use the default client; others register callbacks
+// with amb_client_set_callbacks.
+//
+// Checkpoint callbacks should write with amb_client_send_checkpoint
+// rather than to upfd: once the runtime is up, the network progress
+// thread is the only writer of that socket.
 extern void send_dummy_checkpoint(int upfd);
-
-// USER-DEFINED: FIXME: turn into a callback (currently defined by application):
 extern void amb_dispatch_method(int32_t methodID, void* args, int argsLen);
 
 
 // TEMP - audit me - need to add a hash table to track attached destinations:
 void attach_if_needed(char* dest, int destLen);
+void amb_client_attach_if_needed(amb_client_t* client, char* dest, int destLen);
+
+//------------------------------------------------------------------------------
+
+// Async/await RPCs
+//------------------------------------------------------------------------------
+
+// Called from the processing loop (on the processing thread) when the
+// reply to an async/await RPC arrives.  The retval bytes point into
+// the received log record and are only valid for the duration of the
+// call.
+typedef void (*amb_continuation_t)(void* closure, int64_t callID, char retType,
+                                   void* retval, int retLen);
+
+// Set the name of this instance, which is used as the return address
+// of async/await calls.  If never called, the AMBROSIA_INSTANCE_NAME
+// environment variable is used.
+void amb_set_instance_name(const char* name);
+
+// Send an async/await RPC through the outgoing buffer.  The
+// continuation fires once the return value is delivered.  Any number
+// of calls may be outstanding at once.  Call it on the processing
+// thread (from a handler or continuation), where replies are taken.
+//
+// RETURNS: the call ID of this request.
+int64_t amb_send_async_rpc(char* dest, int32_t destLen, int32_t methodID,
+                           void* args, int argsLen,
+                           amb_continuation_t k, void* closure);
+
+// Inside amb_dispatch_method: if the call being dispatched is an
+// async/await call, write its return address and call ID into the
+// output parameters and return 1, otherwise return 0.  The sender
+// string points into the received log record; copy it to reply later.
+int amb_current_call(char** sender, int32_t* senderLen, int64_t* callID);
+
+// Reply to the async/await call identified by (dest, callID).
+void amb_send_return_value_to(char* dest, int32_t destLen, int64_t callID,
+                              char retType, void* retval, int retLen);
+
+// Reply to the async/await call currently being dispatched.  This is
+// a no-op for fire-and-forget calls.
+void amb_send_return_value(char retType, void* retval, int retLen);
+
+// Number of async/await calls still waiting for a reply.
+int64_t amb_outstanding_calls();
+
+// Per-client versions of the above:
+void    amb_client_set_instance_name(amb_client_t* client, const char* name);
+int64_t amb_client_send_async_rpc(amb_client_t* client, char* dest, int32_t destLen,
+                                  int32_t methodID, void* args, int argsLen,
+                                  amb_continuation_t k, void* closure);
+int     amb_client_current_call(amb_client_t* client, char** sender, int32_t* senderLen,
+                                int64_t* callID);
+void    amb_client_send_return_value_to(amb_client_t* client, char* dest, int32_t destLen,
+                                        int64_t callID, char retType, void* retval, int retLen);
+void    amb_client_send_return_value(amb_client_t* client, char retType, void* retval, int retLen);
+int64_t amb_client_outstanding_calls(amb_client_t* client);
+
+// Client runtimes
+//------------------------------------------------------------------------------
+
+// Allocate a new, unconnected client.  It has no callbacks until
+// amb_client_set_callbacks is called.
+amb_client_t* amb_client_new();
+
+// The client used by the original global API (amb_initialize_client_runtime
+// and friends), whose callbacks are amb_dispatch_method and
+// send_dummy_checkpoint.
+amb_client_t* amb_default_client();
+
+// The client whose processing loop is running on the calling thread,
+// or the default client if there is none.  The global API entrypoints
+// (amb_send_async_rpc, attach_if_needed, ...) act on this client.
+amb_client_t* amb_current_client();
+
+// Register the application callbacks, plus an opaque pointer that the
+// callbacks can retrieve with amb_client_user_data.
+void amb_client_set_callbacks(amb_client_t* client, amb_dispatch_fn dispatch,
+                              amb_checkpoint_fn checkpoint, void* user);
+void* amb_client_user_data(amb_client_t* client);
+
+// Per-client versions of the three phases below.  Each client must be
+// driven by its own processing thread.
+void amb_client_initialize(amb_client_t* client, int upport, int downport, int bufSz);
+void amb_client_processing_loop(amb_client_t* client);
+void amb_client_shutdown(amb_client_t* client);
+
+// A drain barrier: block until every byte released so far (on the
+// calling, producing thread) has been handed to the kernel.  Waits at
+// most timeout_ms, or indefinitely if it is negative.  A client with
+// neither a network thread nor polled sends returns at once.
+//
+// RETURN: 1 once everything has been sent, 0 on timeout or if bytes
+// remain that nothing will send.
+int amb_client_flush(amb_client_t* client, int timeout_ms);
+
+// Tear a client down: flush it (for up to 10 s), stop and join its
+// network thread, free its rings and close its sockets.
+// amb_client_processing_loop does this on its way out; polled clients
+// call it themselves once amb_poll_recv returns -1.  If the flush
+// times out, the network thread is left to exit on its own and
+// nothing is freed.
+void amb_client_close(amb_client_t* client);
+
+// Execute the startup protocol for a client over already-connected
+// sockets (see amb_startup_protocol).
+void amb_client_startup_protocol(amb_client_t* client, int upfd, int downfd);
+
+// Write bytes directly into a client's outgoing ring (see
+// spsc_rring.h): reserve an upper bound, then release what was used.
+// When the ring is full, reserve waits for the network thread.
+//
+// A reservation as large as the whole ring is served from a separate
+// spill buffer instead; its release copies the bytes through the ring
+// in pieces (waiting as needed).
+//
+// The ring is allocated by amb_client_initialize (or its polled
+// variant); calling these, or amb_client_send_bytes, before that aborts.
+char* amb_client_reserve(amb_client_t* client, int len);
+void  amb_client_release(amb_client_t* client, int len);
+
+// Like amb_client_reserve, but never waits for ring space.
+//
+// RETURN: NULL if the ring is too full right now ("would block").
+// Oversized reservations still succeed through the spill buffer.
+char* amb_try_reserve(amb_client_t* client, int len);
+
+// Called on the processing thread once the ring has drained to the
+// low watermark after an amb_try_reserve returned NULL.  It fires once
+// per such failure.
+typedef void (*amb_writable_fn)(amb_client_t* client, void* arg);
+
+// Register the "writable again" callback.  A non-positive watermark
+// selects a quarter of the ring.  While the callback is pending, the
+// processing loop checks the ring between incoming records and while
+// waiting for them.
+void amb_client_on_writable(amb_client_t* client, amb_writable_fn fn, void* arg,
+                            int low_watermark);
+
+// Copy bytes of any length into the outgoing ring, in order with
+// everything else written there.  Larger writes are split into
+// ring-sized pieces.
+void amb_client_send_bytes(amb_client_t* client, const void* buf, int64_t len);
+
+// Send complete control messages (e.g. AttachTo) on the priority lane.
+// The network thread sends these ahead of bulk data already in the
+// ring, so only use it for messages that may overtake earlier sends.
+void amb_client_send_control(amb_client_t* client, const void* buf, int len);
+
+// Send a Checkpoint message followed by the checkpoint bytes.  It is
+// ordered after every message written before it.  During the startup
+// protocol (before the ring exists) it writes the socket directly.
+void amb_client_send_checkpoint(amb_client_t* client, const void* ckpt, int64_t len);
+
+// Latency profiles
+//------------------------------------------------------------------------------
+
+// Where a client's threads run, and how its sockets are tuned.  The
+// defaults change nothing.
+struct amb_latency_profile {
+  int processing_cpu;      // Pin the processing thread to this CPU (-1: don't).
+  int network_cpu;         // Pin the network progress thread to this CPU (-1: don't).
+  int numa_node;           // Confine threads without a CPU to this node (-1: don't).
+  int tcp_nodelay;         // Disable Nagle's algorithm.
+  int tcp_quickack;        // ACK every receive immediately (Linux; re-armed when a read drains the socket).
+  int busy_poll_usec;      // SO_BUSY_POLL budget for blocking reads (Linux; 0: off).
+  int size_socket_buffers; // Set SO_SNDBUF/SO_RCVBUF to the ring size.
+  int busy_poll_reads;     // Spin on non-blocking reads instead of sleeping in recv.
+};
+
+// Fill in the defaults, then apply the environment:
+//   AMBROSIA_LATENCY_PROFILE=low   selects amb_latency_profile_low_latency
+//   AMBROSIA_PROCESSING_CPU, AMBROSIA_NETWORK_CPU, AMBROSIA_NUMA_NODE
+void amb_latency_profile_init(struct amb_latency_profile* profile);
+
+// Turn on every socket option above, plus busy-polling reads.  Leaves
+// thread placement alone.
+void amb_latency_profile_low_latency(struct amb_latency_profile* profile);
+
+// Use this profile instead of the one from the environment.  Call it
+// before the client is initialized.
+void amb_client_set_latency_profile(amb_client_t* client, const struct amb_latency_profile* profile);
+const struct amb_latency_profile* amb_client_latency_profile(amb_client_t* client);
+
+// Pin the calling thread as the client's processing thread.  The
+// processing loop does this itself; applications that drive a client
+// from their own thread can call it directly.
+void amb_client_pin_processing_thread(amb_client_t* client);
+
+// Read exactly len bytes from the coordinator, blocking or busy-polling
+// according to the profile.  Aborts if the connection is interrupted.
+void amb_client_recv(amb_client_t* client, void* buf, int len);
+
+// Flush policy
+//------------------------------------------------------------------------------
+
+// When the network progress thread sends what it finds in the ring.
+// A slice is sent once min_bytes are buffered, or max_delay_usec after
+// the first unsent byte appeared, whichever comes first.  With adaptive
+// set, bytes arriving after an idle period (no sends for max_delay_usec)
+// go out at once, so batching only applies under load.  With cork set,
+// the socket is corked (TCP_CORK, Linux) while batching and uncorked
+// whenever the ring drains.
+//
+// Non-positive min_bytes or max_delay_usec send every slice immediately
+// (the default).
+struct amb_flush_policy {
+  int min_bytes;
+  int max_delay_usec;
+  int adaptive;
+  int cork;
+};
+
+// What the network progress thread has sent, and why.  (For a polled
+// client, amb_poll_send counts only sends and bytes.)
+struct amb_flush_stats {
+  int64_t sends;            // send() calls
+  int64_t bytes;
+  int64_t idle_flushes;     // Sent at once: immediate policy, or after an idle period.
+  int64_t size_flushes;     // Reached min_bytes (or the end of the ring).
+  int64_t deadline_flushes; // Reached max_delay_usec.
+};
+
+// Fill in the defaults, then apply the environment:
+//   AMBROSIA_FLUSH_BYTES, AMBROSIA_FLUSH_USEC, AMBROSIA_FLUSH_ADAPTIVE, AMBROSIA_FLUSH_CORK
+void amb_flush_policy_init(struct amb_flush_policy* policy);
+
+// Use this policy instead of the one from the environment.  Call it
+// before the client is initialized.
+void amb_client_set_flush_policy(amb_client_t* client, const struct amb_flush_policy* policy);
+
+// Copy out the client's flush counters.
+void amb_client_flush_stats(amb_client_t* client, struct amb_flush_stats* out);
+
+// Runtime statistics
+//------------------------------------------------------------------------------
+
+// Always-on counters.  Each field is written by exactly one thread
+// (noted below), without locks.  A reader loads each one atomically,
+// so no value is torn, but the fields are not from a single instant:
+// treat a snapshot as approximate.
+struct amb_stats {
+  // The sending thread (network progress thread, or amb_poll_send):
+  int64_t bytes_sent;
+  int64_t send_calls;      // send() system calls
+  int64_t yield_calls;     // Idle sched_yield()s (network thread)
+  // The application thread writing the ring:
+  int64_t msgs_sent;       // Messages into the ring or priority lane (split ones count once).
+  int64_t ring_high_water; // The most bytes ever buffered in the ring.
+  int64_t ring_stalls;     // Reservations that waited for ring space.
+  int64_t ring_stall_ns;   // The time they spent waiting.
+  // The processing thread:
+  int64_t bytes_received;
+  int64_t records_received; // Log records
+  int64_t msgs_received;    // Messages dispatched: RPCs and return values.
+  int64_t recv_calls;       // recv() system calls, including empty busy polls.
+  int64_t quickack_calls;   // setsockopt() calls re-arming TCP_QUICKACK.
+};
+
+// Always-on latency histograms, in nanoseconds.  These are large (~60 KB
+// each), so they are copied only on request.
+struct amb_stats_histograms {
+  struct amb_histogram stall_latency;    // Each ring stall (the ring's producer).
+  struct amb_histogram dispatch_latency; // A log record's arrival to each of its messages' dispatch.
+};
+
+// Copy out the client's counters.
+void amb_client_get_stats(amb_client_t* client, struct amb_stats* out);
+
+// Copy out the client's histograms.  Their threads keep recording
+// meanwhile, so a bucket may be a value or two ahead of the count.
+// Don't put the struct on a small stack.
+void amb_client_get_stats_histograms(amb_client_t* client, struct amb_stats_histograms* out);
+
+// The same, for the current client.
+void amb_get_stats(struct amb_stats* out);
+void amb_get_stats_histograms(struct amb_stats_histograms* out);
+
+// If AMBROSIA_STATS_SHM names a shared memory object, the sending thread
+// republishes the statistics there every AMBROSIA_STATS_MS (default
+// 1000) milliseconds, for an external tool (such as bin/amb_stats.exe)
+// to read.  On Linux the object is /dev/shm/NAME; on Windows it is the
+// file mapping Local\NAME.  Further clients in the same process use
+// NAME.1, NAME.2, and so on.  The page is a seqlock: the writer makes
+// seq odd, updates the stats, then makes it even again, so a reader
+// copies the stats and retries if seq was odd or changed meanwhile.
+// A histogram is only rewritten when its count has changed, and then
+// only up to the bucket of its maximum.
+#define AMB_STATS_MAGIC 0x53424d41 // "AMBS"
+
+struct amb_stats_page {
+  uint32_t magic;
+  uint32_t size;   // sizeof(struct amb_stats_page), as a version check.
+  int64_t  pid;
+  volatile int64_t seq;
+  int64_t  updated_ns; // The writer's monotonic clock at the last update.
+  struct amb_stats stats;
+  struct amb_stats_histograms histograms;
+};
+
+// Event-loop integration
+//------------------------------------------------------------------------------
+
+// Like amb_client_initialize, but start no network thread.  Instead the
+// application drives the client from its own (level-triggered) event
+// loop, with the two step functions below.  The legacy ring functions
+// (reserve_buffer, ...) must not be used with such a client; use
+// amb_client_reserve/amb_client_release, which flush the ring inline
+// when it is full.
+void amb_client_initialize_polled(amb_client_t* client, int upport, int downport, int bufSz);
+
+// The sockets to watch: readable for amb_poll_recv, and writable for
+// amb_poll_send while it reports pending bytes.
+int amb_client_recv_fd(amb_client_t* client);
+int amb_client_send_fd(amb_client_t* client);
+
+// Send as much of the outgoing ring as the socket takes without blocking.
+//
+// RETURN: 1 if bytes remain (wait for the send fd to become writable),
+// 0 if the ring is empty.
+int amb_poll_send(amb_client_t* client);
+
+// Read what is available without blocking, and dispatch at most
+// max_records complete log records on the calling thread.
+//
+// RETURN: the number of records processed, or -1 once the client is
+// shut down or the coordinator closes the connection.  When it returns
+// max_records, more records may already be buffered: call it again
+// before waiting on the recv fd.
+int amb_poll_recv(amb_client_t* client, int max_records);
 
 //------------------------------------------------------------------------------
 
@@ -155,9 +540,18 @@ void amb_normal_processing_loop();
 //
 // It does NOT transfer control away from the current function
 // (longjmp), rather it returns to the caller, which is expected to
-// return normally to the event handler loop.
+// return normally to the event handler loop.  Once the loop exits it
+// flushes the outgoing messages, joins the network thread and frees
+// the ring (see amb_client_close).
 void amb_shutdown_client_runtime();
 
+// amb_client_flush on the current client: wait (up to timeout_ms, or
+// forever if negative) until every message sent so far has been
+// handed to the kernel.  For example, before exit().
+//
+// RETURN: 1 once everything has been sent, 0 on timeout.
+int amb_flush(int timeout_ms);
+
 
 // ------------------------------------------------------------
 
@@ -181,35 +575,29 @@ void* read_zigzag_int(void* ptr, int32_t* ret);
 // This is very useful for determining how much space is needed for a size field.
 int zigzag_int_size(int32_t value);
 
+// The 64-bit versions of the above, taking 1-10 bytes:
+void* write_zigzag_long(void* ptr, int64_t value);
+void* read_zigzag_long(void* ptr, int64_t* ret);
+int zigzag_long_size(int64_t value);
 
-// Debugging
-//------------------------------------------------------------------------------
 
-#ifdef AMBCLIENT_DEBUG
-extern volatile int64_t amb_debug_lock;
+// Log record check bytes
+// ----------------------
 
-extern void amb_sleep_seconds(double n);
+// The checksum stored in a log header: the XOR of the record's payload
+// (everything after the header), read as little-endian 64-bit words,
+// with the last partial word zero-padded.  This matches the
+// coordinator's Committer.CheckBytes.
+int64_t amb_check_bytes(const void* buf, int64_t len);
 
-static inline void amb_debug_log(const char *format, ...)
-{
-    va_list args;
-    va_start(args, format);
-    amb_sleep_seconds((double)(rand()%1000) * 0.00001); // .01 - 10 ms
-#ifdef _WIN32      
-    while ( 1 == InterlockedCompareExchange64(&amb_debug_lock, 1, 0) ) { }
-#else
-    while ( 1 == __sync_val_compare_and_swap(&amb_debug_lock, 1, 0) ) { }
-#endif    
-    fprintf(amb_dbg_fd," [AMBCLIENT] ");
-    vfprintf(amb_dbg_fd,format, args);
-    fflush(amb_dbg_fd);
-    amb_debug_lock = 0;
-    va_end(args);
-}
-#else
-// inline void amb_debug_log(const char *format, ...) { }
-#define amb_debug_log(...) {}
-#endif
+
+// Debugging
+//------------------------------------------------------------------------------
+
+// Verbose tracing of the protocol, at AMB_LOG_DEBUG (see ambrosia/log.h).
+// Off unless AMBROSIA_LOG=debug, or the library was built with
+// -DAMBCLIENT_DEBUG.
+#define amb_debug_log(...) amb_log(AMB_LOG_DEBUG, __VA_ARGS__)
 
 
 // ------------------------------------------------------------
@@ -218,4 +606,8 @@ static inline void amb_debug_log(const char *format, ...)
 // the last error message from a system call.
 char* amb_get_error_string();
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
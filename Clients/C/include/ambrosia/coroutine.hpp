@@ -0,0 +1,418 @@
+
+// A header-only C++20 coroutine layer over the native client runtime.
+//
+// This wraps the async/await RPCs of client.h so that a chain of calls
+// reads as sequential code:
+//
+//     ambrosia::task<int> add(int a, int b) {
+//       auto r = co_await ambrosia::call(dest, destLen, ADD_ID, args, len);
+//       co_return decode(r.data, r.size);
+//     }
+//
+// Coroutine frames come from a pool owned by the runtime rather than
+// from the heap, and every resumption happens on the processing thread
+// in the order the replies appear in the log, so execution stays
+// deterministic under replay.
+
+#ifndef AMBROSIA_COROUTINE_HEADER
+#define AMBROSIA_COROUTINE_HEADER
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "ambrosia/client.h"
+
+namespace ambrosia {
+
+// Frame allocation
+//------------------------------------------------------------------------------
+
+// A size-class free-list allocator for coroutine frames.  Frames are
+// carved out of large slabs and recycled on destruction, so steady-state
+// awaiting does no heap allocation at all.  Frames larger than the
+// biggest size class fall back to operator new.
+//
+// Not thread-safe: frames are created and destroyed on the processing
+// thread.
+class frame_pool {
+public:
+  static constexpr std::size_t granule   = 64;
+  static constexpr std::size_t num_classes = 64;       // Up to 4 KiB frames.
+  static constexpr std::size_t slab_bytes  = 64 * 1024;
+
+  frame_pool() = default;
+  frame_pool(const frame_pool&) = delete;
+  frame_pool& operator=(const frame_pool&) = delete;
+
+  ~frame_pool() {
+    while (slabs_ != nullptr) {
+      slab* next = slabs_->next;
+      ::operator delete(slabs_);
+      slabs_ = next;
+    }
+  }
+
+  void* allocate(std::size_t sz) {
+    std::size_t cls = (sz + granule - 1) / granule;
+    if (cls >= num_classes) return ::operator new(sz);
+    free_block* b = free_[cls];
+    if (b != nullptr) {
+      free_[cls] = b->next;
+      return b;
+    }
+    return carve(cls * granule);
+  }
+
+  void deallocate(void* p, std::size_t sz) noexcept {
+    std::size_t cls = (sz + granule - 1) / granule;
+    if (cls >= num_classes) { ::operator delete(p); return; }
+    free_block* b = static_cast<free_block*>(p);
+    b->next = free_[cls];
+    free_[cls] = b;
+  }
+
+private:
+  struct free_block { free_block* next; };
+  struct slab { slab* next; };
+
+  void* carve(std::size_t bytes) {
+    if (cursor_ + bytes > limit_) {
+      // The tail of the old slab is abandoned; it is at most one frame.
+      char* mem = static_cast<char*>(::operator new(slab_bytes));
+      slab* s = reinterpret_cast<slab*>(mem);
+      s->next = slabs_;
+      slabs_ = s;
+      cursor_ = mem + granule;   // Keep the slab header granule-aligned.
+      limit_  = mem + slab_bytes;
+    }
+    void* p = cursor_;
+    cursor_ += bytes;
+    return p;
+  }
+
+  free_block* free_[num_classes] = {};
+  slab* slabs_ = nullptr;
+  char* cursor_ = nullptr;
+  char* limit_  = nullptr;
+};
+
+// Execution
+//------------------------------------------------------------------------------
+
+// A FIFO of coroutines ready to resume.  Replies are delivered by the
+// processing loop in log order; each one enqueues its waiter and the
+// queue is drained before control returns to the loop, so resumption
+// order is a pure function of the log.
+class executor {
+public:
+  void post(std::coroutine_handle<> h) {
+    node* n = alloc_node();
+    n->h = h;
+    n->next = nullptr;
+    if (tail_ != nullptr) tail_->next = n; else head_ = n;
+    tail_ = n;
+    if (!draining_) drain();
+  }
+
+  // Resume queued coroutines until none are left.
+  void drain() {
+    draining_ = true;
+    while (head_ != nullptr) {
+      node* n = head_;
+      head_ = n->next;
+      if (head_ == nullptr) tail_ = nullptr;
+      std::coroutine_handle<> h = n->h;
+      n->next = spare_;
+      spare_ = n;
+      h.resume();
+    }
+    draining_ = false;
+  }
+
+  ~executor() {
+    while (spare_ != nullptr) { node* n = spare_->next; delete spare_; spare_ = n; }
+  }
+
+private:
+  struct node { std::coroutine_handle<> h; node* next; };
+
+  node* alloc_node() {
+    if (spare_ == nullptr) return new node;
+    node* n = spare_;
+    spare_ = n->next;
+    return n;
+  }
+
+  node* head_ = nullptr;
+  node* tail_ = nullptr;
+  node* spare_ = nullptr;
+  bool draining_ = false;
+};
+
+// The per-runtime state used by the coroutine layer.  Construct one
+// (on the processing thread) after amb_initialize_client_runtime and
+// keep it alive for as long as coroutines may run.
+class runtime {
+public:
+  runtime()  { current() = this; }
+  ~runtime() { if (current() == this) current() = nullptr; }
+  runtime(const runtime&) = delete;
+  runtime& operator=(const runtime&) = delete;
+
+  frame_pool& pool() { return pool_; }
+  executor&   exec() { return exec_; }
+
+  static runtime*& current() {
+    static thread_local runtime* rt = nullptr;
+    return rt;
+  }
+
+private:
+  frame_pool pool_;
+  executor   exec_;
+};
+
+namespace detail {
+
+// Every frame is prefixed by the pool it came from, so that it can be
+// returned to the right pool even if the runtime pointer has changed.
+struct frame_header {
+  frame_pool* pool;
+  std::size_t pad; // Preserve 16-byte alignment of the frame itself.
+};
+
+inline void* allocate_frame(std::size_t sz) {
+  runtime* rt = runtime::current();
+  std::size_t total = sz + sizeof(frame_header);
+  frame_header* hdr;
+  if (rt != nullptr) {
+    hdr = static_cast<frame_header*>(rt->pool().allocate(total));
+    hdr->pool = &rt->pool();
+  } else {
+    hdr = static_cast<frame_header*>(::operator new(total));
+    hdr->pool = nullptr;
+  }
+  return hdr + 1;
+}
+
+inline void deallocate_frame(void* p, std::size_t sz) noexcept {
+  frame_header* hdr = static_cast<frame_header*>(p) - 1;
+  if (hdr->pool != nullptr) hdr->pool->deallocate(hdr, sz + sizeof(frame_header));
+  else ::operator delete(hdr);
+}
+
+struct promise_base {
+  std::coroutine_handle<> continuation = nullptr;
+  std::exception_ptr error = nullptr;
+  bool detached = false;
+
+  static void* operator new(std::size_t sz) { return allocate_frame(sz); }
+  static void  operator delete(void* p, std::size_t sz) noexcept { deallocate_frame(p, sz); }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct final_awaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+      promise_base& p = h.promise();
+      if (p.detached) {
+        // Nobody will await us; reclaim the frame now.
+        if (p.error) std::terminate();
+        h.destroy();
+        return std::noop_coroutine();
+      }
+      if (p.continuation) return p.continuation;
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+  final_awaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { error = std::current_exception(); }
+};
+
+} // namespace detail
+
+// Tasks
+//------------------------------------------------------------------------------
+
+// A lazily started coroutine producing a T.  Awaiting a task starts it
+// and resumes the awaiter (by symmetric transfer) when it completes.
+template <typename T = void>
+class task;
+
+template <typename T>
+class task {
+public:
+  struct promise_type : detail::promise_base {
+    alignas(T) unsigned char storage[sizeof(T)];
+    bool has_value = false;
+
+    task get_return_object() {
+      return task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    template <typename U>
+    void return_value(U&& v) {
+      ::new (static_cast<void*>(storage)) T(std::forward<U>(v));
+      has_value = true;
+    }
+    T& value() { return *std::launder(reinterpret_cast<T*>(storage)); }
+    ~promise_type() { if (has_value) value().~T(); }
+  };
+
+  task(task&& o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+  task& operator=(task&& o) noexcept {
+    if (this != &o) { if (h_) h_.destroy(); h_ = std::exchange(o.h_, nullptr); }
+    return *this;
+  }
+  ~task() { if (h_) h_.destroy(); }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+    h_.promise().continuation = awaiter;
+    return h_;
+  }
+  T await_resume() {
+    promise_type& p = h_.promise();
+    if (p.error) std::rethrow_exception(p.error);
+    return std::move(p.value());
+  }
+
+  std::coroutine_handle<promise_type> release() { return std::exchange(h_, nullptr); }
+
+private:
+  explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+  std::coroutine_handle<promise_type> h_;
+};
+
+template <>
+class task<void> {
+public:
+  struct promise_type : detail::promise_base {
+    task get_return_object() {
+      return task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    void return_void() {}
+  };
+
+  task(task&& o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+  task& operator=(task&& o) noexcept {
+    if (this != &o) { if (h_) h_.destroy(); h_ = std::exchange(o.h_, nullptr); }
+    return *this;
+  }
+  ~task() { if (h_) h_.destroy(); }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+    h_.promise().continuation = awaiter;
+    return h_;
+  }
+  void await_resume() {
+    if (h_.promise().error) std::rethrow_exception(h_.promise().error);
+  }
+
+  std::coroutine_handle<promise_type> release() { return std::exchange(h_, nullptr); }
+
+private:
+  explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+  std::coroutine_handle<promise_type> h_;
+};
+
+// Start a task without awaiting it, e.g. from amb_dispatch_method.  It
+// runs until its first suspension point before spawn returns, and its
+// frame is reclaimed when it finishes.  An escaping exception terminates.
+template <typename T>
+inline void spawn(task<T>&& t) {
+  auto h = t.release();
+  h.promise().detached = true;
+  h.resume();
+}
+
+// RPCs
+//------------------------------------------------------------------------------
+
+// The reply to an async/await call.  The bytes point into the received
+// log record and stay valid only until the awaiting coroutine next
+// suspends; copy out anything needed beyond that.
+struct reply {
+  char        type = NotReturnValue;   // enum ReturnValueType
+  const char* data = nullptr;
+  int         size = 0;
+};
+
+// Awaitable for a single outgoing async/await call.  The request is
+// written to the outgoing buffer when the awaiting coroutine suspends.
+class call {
+public:
+  call(char* dest, int32_t destLen, int32_t methodID, const void* args, int argsLen)
+    : dest_(dest), destLen_(destLen), methodID_(methodID), args_(args), argsLen_(argsLen) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    waiter_ = h;
+    callID_ = amb_send_async_rpc(dest_, destLen_, methodID_,
+                                 const_cast<void*>(args_), argsLen_,
+                                 &call::on_reply, this);
+  }
+
+  reply await_resume() const noexcept { return reply_; }
+
+  int64_t id() const noexcept { return callID_; }
+
+private:
+  static void on_reply(void* closure, int64_t, char retType, void* retval, int retLen) {
+    call* self = static_cast<call*>(closure);
+    self->reply_.type = retType;
+    self->reply_.data = static_cast<const char*>(retval);
+    self->reply_.size = retLen;
+    runtime* rt = runtime::current();
+    if (rt != nullptr) rt->exec().post(self->waiter_);
+    else self->waiter_.resume();
+  }
+
+  char*       dest_;
+  int32_t     destLen_;
+  int32_t     methodID_;
+  const void* args_;
+  int         argsLen_;
+  int64_t     callID_ = 0;
+  std::coroutine_handle<> waiter_ = nullptr;
+  reply       reply_;
+};
+
+// The identity of the async/await call being dispatched, captured so
+// that a coroutine can reply after it has suspended.
+struct caller {
+  std::string name;
+  int64_t     callID = 0;
+
+  explicit operator bool() const noexcept { return callID != 0; }
+
+  void reply(char retType, const void* retval, int retLen) const {
+    amb_send_return_value_to(const_cast<char*>(name.data()), (int32_t)name.size(), callID,
+                             retType, const_cast<void*>(retval), retLen);
+  }
+};
+
+// Capture the current caller.  Must be called before the handler's
+// first suspension point.
+inline caller current_caller() {
+  caller c;
+  char* sender;
+  int32_t senderLen;
+  if (amb_current_call(&sender, &senderLen, &c.callID))
+    c.name.assign(sender, senderLen);
+  return c;
+}
+
+} // namespace ambrosia
+
+#endif
@@ -0,0 +1,78 @@
+
+// A fixed-size, log-linear latency histogram in the style of HDR
+// histograms.
+//
+// Values (typically nanoseconds) are counted in buckets that keep
+// AMB_HIST_SUB_BITS significant bits, so every recorded value is
+// reported to within 1/2^(AMB_HIST_SUB_BITS-1) (under 1%), from 1 up to
+// 2^63.  Recording is a handful of instructions and never allocates,
+// so it is safe on the hot path; the memory cost is a fixed ~60 KB.
+//
+// A histogram is owned by one thread.  Merge per-thread histograms
+// with amb_hist_merge to report on them together.
+
+#ifndef AMBROSIA_HISTOGRAM_HEADER
+#define AMBROSIA_HISTOGRAM_HEADER
+
+#include <stdint.h>
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AMB_HIST_SUB_BITS 8
+#define AMB_HIST_SUB_COUNT (1 << AMB_HIST_SUB_BITS)
+#define AMB_HIST_HALF      (AMB_HIST_SUB_COUNT / 2)
+#define AMB_HIST_BUCKETS   (AMB_HIST_SUB_COUNT + (64 - AMB_HIST_SUB_BITS) * AMB_HIST_HALF)
+
+struct amb_histogram {
+  int64_t count;
+  int64_t min;
+  int64_t max;
+  double  sum;
+  int64_t counts[AMB_HIST_BUCKETS];
+};
+
+// Clear all counts.
+void amb_hist_reset(struct amb_histogram* h);
+
+// Add the counts of src into dst.
+void amb_hist_merge(struct amb_histogram* dst, const struct amb_histogram* src);
+
+// The value below which the given percentage (0-100) of the recorded
+// values fall, reported as the upper end of its bucket.  0 if empty.
+int64_t amb_hist_percentile(const struct amb_histogram* h, double percentile);
+
+static inline double amb_hist_mean(const struct amb_histogram* h) {
+  return h->count ? h->sum / (double)h->count : 0.0;
+}
+
+static inline int amb_hist_bucket(int64_t value) {
+  if (value < AMB_HIST_SUB_COUNT) return value < 0 ? 0 : (int)value;
+#ifdef _MSC_VER
+  unsigned long msb;
+  _BitScanReverse64(&msb, (uint64_t)value);
+#else
+  int msb = 63 - __builtin_clzll((uint64_t)value);
+#endif
+  int shift = (int)msb - (AMB_HIST_SUB_BITS - 1);
+  return AMB_HIST_SUB_COUNT + (shift - 1) * AMB_HIST_HALF
+         + (int)((value >> shift) - AMB_HIST_HALF);
+}
+
+static inline void amb_hist_record(struct amb_histogram* h, int64_t value) {
+  h->counts[amb_hist_bucket(value)]++;
+  if (h->count == 0 || value < h->min) h->min = value;
+  if (value > h->max) h->max = value;
+  h->count++;
+  h->sum += (double)value;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
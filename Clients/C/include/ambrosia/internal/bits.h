@@ -1,30 +1,35 @@
 // Small helpers and potentially reusable bits.
 
+#include "ambrosia/internal/platform.h" // amb_monotonic_ns, and <time.h>
+
 
 // Internal helper: try repeatedly on a socket until all bytes are sent.
 // 
 // The Linux man pages are vague on when send on a (blocking) socket
 // can return less than the requested number of bytes.  This little
 // helper simply retries.
+//
+// RETURN: the number of send calls it took.
 static inline
-void amb_socket_send_all(int sock, const void* buf, size_t len, int flags) {
+int amb_socket_send_all(int sock, const void* buf, size_t len, int flags) {
   char* cur = (char*)buf;
   int remaining = len;
+  int calls = 0;
   while (remaining > 0) {
     int n = send(sock, cur, remaining, flags);
+    calls++;
     if (n < 0) {
       char* err = amb_get_error_string();
       fprintf(stderr,"\nERROR: failed send (%d bytes, of %d) which left errno = %s\n",
 	      remaining, (int)len, err);
-      abort();
+      amb_abort();
     }
     cur += n;
     remaining -= n;
-#ifdef AMBCLIENT_DEBUG
     if (remaining > 0)
       amb_debug_log(" Warning: socket send didn't get all bytes across (%d of %d), retrying.\n", n, remaining);
-#endif
   }
+  return calls;
 }
 
 static inline
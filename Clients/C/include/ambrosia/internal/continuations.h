@@ -0,0 +1,64 @@
+
+// A table of pending continuations for outstanding async/await RPCs,
+// keyed by the (monotonically increasing) call ID of each request.
+
+// Call IDs are handed out in order and retired roughly in order, so
+// the table is a power-of-two array indexed by (id & mask) rather than
+// a general hash table.  Each slot stores the ID that owns it, which
+// lets a lookup validate the hit without any locking.  If a new call
+// would land on a slot that is still occupied by an older outstanding
+// call, the table doubles in size.
+//
+// The table has a single owner, the processing thread: replies are
+// taken there, and async calls are sent from there too, as the one
+// producer of the client's SPSC ring.  So register, take and grow
+// never race, and there is no lock.
+
+#ifndef AMBROSIA_CONTINUATIONS_HEADER
+#define AMBROSIA_CONTINUATIONS_HEADER
+
+#include <stdint.h>
+#include "ambrosia/client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct amb_continuation_slot {
+  int64_t            callID;   // 0 when the slot is free.
+  amb_continuation_t callback;
+  void*              closure;
+};
+
+struct amb_continuation_table {
+  struct amb_continuation_slot* slots;
+  int64_t capacity;      // Always a power of two.
+  int64_t next_callID;   // The next ID to hand out; IDs start at 1.
+  int64_t outstanding;   // Number of occupied slots.
+};
+
+// Allocate the slot array.  A non-positive capacity selects the default.
+void amb_continuations_init(struct amb_continuation_table* tbl, int64_t capacity);
+
+// Release the slot array.  Any pending continuations are dropped.
+void amb_continuations_free(struct amb_continuation_table* tbl);
+
+// Allocate a fresh call ID and register its continuation.
+//
+// RETURN: the new (positive) call ID.
+int64_t amb_continuations_register(struct amb_continuation_table* tbl,
+                                   amb_continuation_t callback, void* closure);
+
+// Remove the continuation registered for a call ID, writing it to the
+// output parameters.
+//
+// RETURN: 1 if the ID was outstanding, 0 otherwise (including when the
+// table was never initialized).
+int amb_continuations_take(struct amb_continuation_table* tbl, int64_t callID,
+                           amb_continuation_t* callback, void** closure);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
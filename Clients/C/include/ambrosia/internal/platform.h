@@ -0,0 +1,74 @@
+// Portable low-level helpers shared by the runtime's source files:
+// thread-local storage, a monotonic clock, a full memory fence, thread
+// IDs, and a lock-free push onto a list of per-thread buffers.
+//
+// Unlike bits.h, this header is self-contained.
+
+#ifndef AMBROSIA_PLATFORM_HEADER
+#define AMBROSIA_PLATFORM_HEADER
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #define AMB_THREAD_LOCAL __declspec(thread)
+#else
+  #include <unistd.h>
+  #include <sys/syscall.h>
+  #define AMB_THREAD_LOCAL __thread
+#endif
+
+// Nanoseconds on a monotonic clock (for intervals, not wall time).
+static inline int64_t amb_monotonic_ns()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, current;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&current);
+  return (int64_t)((double)current.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void amb_full_fence()
+{
+#ifdef _WIN32
+  MemoryBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+// The OS thread ID of the caller (as shown by top, perf, ...), or 0
+// where there is none to be had.
+static inline int64_t amb_thread_id()
+{
+#ifdef _WIN32
+  return (int64_t)GetCurrentThreadId();
+#elif defined(SYS_gettid)
+  return (int64_t)syscall(SYS_gettid);
+#else
+  return 0;
+#endif
+}
+
+// Push node onto the front of a list that many threads push to and
+// nobody removes from.  link is the node's next field.
+static inline void amb_push_node(void* volatile* head, void* node, void** link)
+{
+  void* old;
+  do {
+    old = *head;
+    *link = old;
+#ifdef _WIN32
+  } while (InterlockedCompareExchangePointer((PVOID volatile*)head, node, old) != old);
+#else
+  } while (!__sync_bool_compare_and_swap(head, old, node));
+#endif
+}
+
+#endif
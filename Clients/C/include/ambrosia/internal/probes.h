@@ -0,0 +1,99 @@
+
+// USDT (user-level statically defined tracing) probes, for perf,
+// bpftrace and SystemTap.
+//
+// Each probe is a single nop in the code, plus an ELF note
+// (.note.stapsdt) recording its address and where to find its
+// arguments.  Nothing happens at runtime until a tracer attaches and
+// patches the nop into a breakpoint.  So the probes stay compiled into
+// production builds, and a running immortal can be traced without a
+// rebuild or restart:
+//
+//   bpftrace -l 'usdt:./service.exe:ambrosia:*'
+//
+// The probes, all in the "ambrosia" provider (arguments in order):
+//
+//   ring_reserve(bytes)                  producer reserved ring space
+//   ring_stall(bytes, ns)                ... after waiting ns for it
+//   ring_release(bytes)                  producer released a message
+//   ring_pop(bytes)                      sender consumed bytes
+//   send(bytes)                          one socket send of a slice
+//   log_header(seqID, bytes)             a log record header arrived
+//   dispatch_start(methodID, seqID, argbytes)
+//   dispatch_end(methodID, seqID)        methodID -1: a return value
+//   checkpoint_begin(seqID)
+//   checkpoint_end(seqID)
+//
+// <sys/sdt.h> (systemtap-sdt-dev) is used when it is installed.
+// Otherwise, on x86-64 with GCC or Clang, the notes are emitted
+// directly, in the same (version 3) format.  Elsewhere, or with
+// -DAMBROSIA_NO_PROBES, the probes compile to nothing.
+
+#ifndef AMBROSIA_PROBES_HEADER
+#define AMBROSIA_PROBES_HEADER
+
+#include <stdint.h>
+
+#if !defined(AMBROSIA_NO_PROBES) && !defined(_WIN32) && defined(__has_include)
+  #if __has_include(<sys/sdt.h>)
+    #define AMB_PROBES_SDT
+  #elif defined(__GNUC__) && defined(__x86_64__)
+    #define AMB_PROBES_NOTES
+  #endif
+#endif
+
+#if defined(AMB_PROBES_SDT)
+
+#include <sys/sdt.h>
+#define AMB_PROBE1(name, a)       DTRACE_PROBE1(ambrosia, name, a)
+#define AMB_PROBE2(name, a, b)    DTRACE_PROBE2(ambrosia, name, a, b)
+#define AMB_PROBE3(name, a, b, c) DTRACE_PROBE3(ambrosia, name, a, b, c)
+
+#elif defined(AMB_PROBES_NOTES)
+
+// The note: the probe's address, the (link-time) address of
+// .stapsdt.base for prelink adjustment, no semaphore, then the
+// provider, name and argument descriptions.  Every argument is passed
+// as a signed 64-bit value, "-8@<operand>".
+#define AMB_PROBE_ASM(name, args, ...)                                   \
+  __asm__ __volatile__ (                                                  \
+    "990: nop\n"                                                          \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                         \
+    ".balign 4\n"                                                         \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                    \
+    "991: .asciz \"stapsdt\"\n"                                           \
+    "992: .balign 4\n"                                                    \
+    "993: .8byte 990b\n"                                                  \
+    ".8byte _.stapsdt.base\n"                                             \
+    ".8byte 0\n"                                                          \
+    ".asciz \"ambrosia\"\n"                                               \
+    ".asciz \"" #name "\"\n"                                              \
+    ".asciz \"" args "\"\n"                                               \
+    "994: .balign 4\n"                                                    \
+    ".popsection\n"                                                       \
+    ".ifndef _.stapsdt.base\n"                                            \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n"                                              \
+    ".hidden _.stapsdt.base\n"                                            \
+    "_.stapsdt.base: .space 1\n"                                          \
+    ".size _.stapsdt.base, 1\n"                                           \
+    ".popsection\n"                                                       \
+    ".endif\n"                                                            \
+    :: __VA_ARGS__)
+
+#define AMB_PROBE1(name, a) \
+  AMB_PROBE_ASM(name, "-8@%0", "nor" ((int64_t)(a)))
+#define AMB_PROBE2(name, a, b) \
+  AMB_PROBE_ASM(name, "-8@%0 -8@%1", "nor" ((int64_t)(a)), "nor" ((int64_t)(b)))
+#define AMB_PROBE3(name, a, b, c) \
+  AMB_PROBE_ASM(name, "-8@%0 -8@%1 -8@%2", "nor" ((int64_t)(a)), "nor" ((int64_t)(b)), "nor" ((int64_t)(c)))
+
+#else
+
+#define AMB_PROBE1(name, a)       do { } while (0)
+#define AMB_PROBE2(name, a, b)    do { } while (0)
+#define AMB_PROBE3(name, a, b, c) do { } while (0)
+
+#endif
+
+#endif
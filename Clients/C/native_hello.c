@@ -47,29 +47,10 @@ void startup(int64_t n) {
 
 void send_dummy_checkpoint(int upfd) {
   const char* dummy_checkpoint = "dummyckpt";
-  int strsize = strlen(dummy_checkpoint);
-
-  // New protocol, the payload is just a 64 bit size:
-  int   msgsize = 1 + 8;
-  char* buf = alloca(msgsize + 5 + strsize);
-  char* bufcur = write_zigzag_int(buf, msgsize); // Size (including type tag)
-  *bufcur++ = Checkpoint;                        // Type
-  *((int64_t*)bufcur) = strsize;                 // 8 byte size
-  bufcur += 8;
-  
-  assert(bufcur-buf == 9 + zigzag_int_size(msgsize)); 
-
-  // Then write the checkpoint itself AFTER the regular message:
-  bufcur += sprintf(bufcur, "%s", dummy_checkpoint); // Dummy checkpoint.
-
-  amb_socket_send_all(upfd, buf, bufcur-buf, 0);
-  
-#ifdef AMBCLIENT_DEBUG  
-  amb_debug_log("  Trivial checkpoint message sent to coordinator (%lld bytes), checkpoint %d bytes\n",
-                (int64_t)(bufcur-buf), strsize);
-  amb_debug_log("    Message was: ");
-  print_hex_bytes(amb_dbg_fd,buf, bufcur-buf); fprintf(amb_dbg_fd,"\n");
-#endif
+  // The runtime writes the Checkpoint message (whose payload is just a
+  // 64 bit size) and then the checkpoint itself, in order with our
+  // other outgoing messages:
+  amb_client_send_checkpoint(amb_current_client(), dummy_checkpoint, strlen(dummy_checkpoint));
 }
 
 
@@ -1,6 +1,10 @@
 
 // See client.h header for function-level documentation.
 
+#ifndef _WIN32
+  #define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -22,28 +26,65 @@
   #include <netdb.h> // gethostbyname
   #include <sched.h>  // sched_yield
   #include <pthread.h> 
+  #include <poll.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h> // TCP_NODELAY, TCP_QUICKACK
+  #include <sys/mman.h>    // shm_open
+  #include <fcntl.h>
+  #include <unistd.h>
 #endif
 
 #include "ambrosia/client.h"
 #include "ambrosia/internal/bits.h"
+#include "ambrosia/internal/platform.h"
 
 // For network progress thread only:
 #include "ambrosia/internal/spsc_rring.h"
+#include "ambrosia/internal/continuations.h"
+
+#include "ambrosia/internal/client_state.h"
+#include "ambrosia/trace.h"
+#include "ambrosia/internal/probes.h"
+
+#ifndef _WIN32
+  // The default client's callbacks are optional when the application
+  // only uses clients of its own:
+  #pragma weak amb_dispatch_method
+  #pragma weak send_dummy_checkpoint
+#endif
 
 // Library-level (private) global variables:
 // --------------------------------------------------
 
-// FIXME: looks like we need a hashtable after all...
-int g_attached = 0;  // For now, ONE destination.
+// Mirrors of the default client's sockets, for legacy callers.
+int g_to_immortal_coord = -1, g_from_immortal_coord = -1;
+
+// The default client's priority lane.
+static struct spsc_rring g_control_rring = { .end = -1, .orig_end = -1, .last_reserved = -1 };
+
+// The size of each client's priority lane.  Control messages are tiny.
+#define AMB_CONTROL_LANE_SIZE (64 * 1024)
 
-// Global variables that should be initialized once for the library.
-// We can ONLY ever have ONE reliability coordinator.
-int g_to_immortal_coord, g_from_immortal_coord;
+// The capacity each client's (elastic) ring starts from, unless
+// AMBROSIA_RING_INITIAL says otherwise.
+#define AMB_RING_INITIAL_SIZE (64 * 1024)
 
+static void default_dispatch(amb_client_t* client, int32_t methodID, void* args, int argsLen);
+static void default_checkpoint(amb_client_t* client, int upfd);
 
-// An INTERNAL global representing whether the client is terminating
-// this AMBROSIA instance/network-endpoint.
-int g_amb_client_terminating = 0;
+// The client behind the original single-instance API.
+static struct amb_client g_default_client = {
+  .to_coord      = -1,
+  .from_coord    = -1,
+  .ring          = &g_rring,
+  .control       = &g_control_rring,
+  .continuations = { .next_callID = 1 },
+  .dispatch      = default_dispatch,
+  .checkpoint    = default_checkpoint,
+};
+
+// The client whose processing loop runs on this thread (if any).
+static AMB_THREAD_LOCAL amb_client_t* t_current_client = NULL;
 
 #ifdef IPV4
 const char* coordinator_host = "127.0.0.1";
@@ -53,10 +94,6 @@ const char* coordinator_host = "::1";
 #error "Preprocessor: Expected IPV4 or IPV6 to be defined."
 #endif
 
-#ifdef AMBCLIENT_DEBUG
-volatile int64_t amb_debug_lock = 0;
-#endif
-
 
 // Reusable code for interacting with AMBROSIA
 // ==============================================================================
@@ -80,8 +117,8 @@ void amb_sleep_seconds(double n) {
 #ifdef _WIN32
   Sleep((int)(n * 1000));
 #else
-  int64_t nanos = (int64_t)(10e9 * n);
-  const struct timespec ts = {0, nanos};
+  int64_t nanos = (int64_t)(1e9 * n);
+  const struct timespec ts = { (time_t)(nanos / 1000000000), (long)(nanos % 1000000000) };
   nanosleep(&ts, NULL);
 #endif
 }
@@ -136,6 +173,44 @@ int zigzag_int_size(int32_t value) {
   return retVal+1;
 }
 
+void* write_zigzag_long(void* ptr, int64_t value) {
+  char* bytes = (char*)ptr;
+  uint64_t zigZagEncoded = (uint64_t)((value << 1) ^ (value >> 63));
+  while ((zigZagEncoded & ~0x7FULL) != 0) {
+    *bytes++ = (char)((zigZagEncoded | 0x80) & 0xFF);
+    zigZagEncoded >>= 7;
+  }
+  *bytes++ = (char)zigZagEncoded;
+  return bytes;
+}
+
+void* read_zigzag_long(void* ptr, int64_t* ret) {
+  char* bytes = (char*)ptr;
+  uint64_t currentByte = (unsigned char)*bytes; bytes++;
+  char read = 1;
+  uint64_t result = currentByte & 0x7FULL;
+  int32_t  shift = 7;
+  while ((currentByte & 0x80) != 0) {
+    currentByte = (unsigned char)*bytes; bytes++;
+    read++;
+    result |= (currentByte & 0x7FULL) << shift;
+    shift += 7;
+    if (read > 10) return NULL; // Invalid encoding.
+  }
+  *ret = (int64_t) ((-(result & 1)) ^ ((result >> 1) & 0x7FFFFFFFFFFFFFFFULL));
+  return (void*)bytes;
+}
+
+int zigzag_long_size(int64_t value) {
+  int retVal = 0;
+  uint64_t zigZagEncoded = (uint64_t)((value << 1) ^ (value >> 63));
+  while ((zigZagEncoded & ~0x7FULL) != 0) {
+      retVal++;
+      zigZagEncoded >>= 7;
+  }
+  return retVal+1;
+}
+
 
 // AMBROSIA-specific messaging utilities
 // -------------------------------------
@@ -149,6 +224,23 @@ int32_t checksum(int32_t initial, char* buf, int n) {
   return acc;
 }
 
+int64_t amb_check_bytes(const void* buf, int64_t len) {
+  const char* p = (const char*)buf;
+  int64_t acc = 0;
+  int64_t word;
+  int64_t i;
+  for (i = 0; i + 8 <= len; i += 8) {
+    memcpy(&word, p + i, 8);
+    acc ^= word;
+  }
+  if (i < len) { // The last partial word is zero-padded.
+    word = 0;
+    memcpy(&word, p + i, len - i);
+    acc ^= word;
+  }
+  return acc;
+}
+
 // CONVENTIONS:
 //
 // "linear cursors" - the functions that write to buffers here take a
@@ -203,6 +295,49 @@ void* amb_write_outgoing_rpc(void* buf, char* dest, int32_t destLen, char RPC_or
   return (void*)cursor;
 }
 
+void* amb_write_outgoing_async_rpc_hdr(void* buf, char* dest, int32_t destLen, int32_t methodID,
+                                       char* retAddr, int32_t retAddrLen, int64_t callID,
+                                       int argsLen) {
+  char* cursor = (char*)buf;
+  int totalSize = 1 // type tag
+    + zigzag_int_size(destLen) + destLen + 1 // RPC_or_RetVal
+    + zigzag_int_size(methodID) + 1 // rpc type
+    + zigzag_int_size(retAddrLen) + retAddrLen
+    + zigzag_long_size(callID)
+    + argsLen;
+  cursor = write_zigzag_int(cursor, totalSize); // Size (message header)
+  *cursor++ = RPC;                            // Type (message header)
+  cursor = write_zigzag_int(cursor, destLen);   // Destination string size
+  memcpy(cursor, dest, destLen); cursor += destLen; // Registered name of dest service
+  *cursor++ = NotReturnValue;                       // 1 byte
+  cursor = write_zigzag_int(cursor, methodID);        // 1-5 bytes
+  *cursor++ = AsyncRPC;                             // 1 byte
+  cursor = write_zigzag_int(cursor, retAddrLen);      // Return address size
+  memcpy(cursor, retAddr, retAddrLen); cursor += retAddrLen; // Our own name
+  cursor = write_zigzag_long(cursor, callID);         // 1-10 bytes
+  return (void*)cursor;
+}
+
+void* amb_write_return_value_hdr(void* buf, char* dest, int32_t destLen, char retType,
+                                 char* retAddr, int32_t retAddrLen, int64_t callID,
+                                 int retLen) {
+  char* cursor = (char*)buf;
+  int totalSize = 1 // type tag
+    + zigzag_int_size(destLen) + destLen + 1 // return value type
+    + zigzag_int_size(retAddrLen) + retAddrLen
+    + zigzag_long_size(callID)
+    + retLen;
+  cursor = write_zigzag_int(cursor, totalSize); // Size (message header)
+  *cursor++ = RPC;                            // Type (message header)
+  cursor = write_zigzag_int(cursor, destLen);   // Destination string size
+  memcpy(cursor, dest, destLen); cursor += destLen; // The original caller
+  *cursor++ = retType;                              // 1 byte
+  cursor = write_zigzag_int(cursor, retAddrLen);      // Return address size
+  memcpy(cursor, retAddr, retAddrLen); cursor += retAddrLen; // Our own name
+  cursor = write_zigzag_long(cursor, callID);         // 1-10 bytes
+  return (void*)cursor;
+}
+
 // Direct socket sends/recvs
 // ------------------------------
 
@@ -222,9 +357,10 @@ void amb_send_outgoing_rpc(void* tempbuf, char* dest, int32_t destLen, char RPC_
   cursor = write_zigzag_int(cursor, methodID);        // 1-5 bytes
   *cursor++ = fireForget;                           // 1 byte
 
-  // This version makes even *more* syscalls, but it doesn't copy:
-  amb_socket_send_all(g_to_immortal_coord, tempbuf, cursor-cursor0, 0);
-  amb_socket_send_all(g_to_immortal_coord, args, argsLen, 0);  
+  // The network thread owns the socket, so this copies after all:
+  amb_client_t* client = amb_current_client();
+  amb_client_send_bytes(client, tempbuf, cursor-cursor0);
+  amb_client_send_bytes(client, args, argsLen);
   return;
 }
 
@@ -239,10 +375,12 @@ void amb_recv_log_hdr(int sockfd, struct log_hdr* hdr) {
       print_hex_bytes(amb_dbg_fd,(char*)hdr, num); fprintf(amb_dbg_fd,"\n");
     }
     fprintf(stderr,"\nERROR: failed recv (logheader), which left errno = %s\n", err);
-    abort();
+    amb_abort();
   }
+  AMB_TRACE(AMB_TRACE_RECV_HDR, hdr->seqID, hdr->totalSize, 0);
+  AMB_PROBE2(log_header, hdr->seqID, hdr->totalSize);
   amb_debug_log("Read log header: { commit %d, sz %d, checksum %lld, seqid %lld }\n",
-                hdr->commitID, hdr->totalSize, hdr->checksum, hdr->seqID );
+                hdr->commitID, hdr->totalSize, (long long)hdr->checksum, (long long)hdr->seqID );
   // printf("Hex: "); print_hex_bytes((char*)hdr,AMBROSIA_HEADERSIZE); printf("\n");  
   return;
 }
@@ -253,26 +391,381 @@ void amb_recv_log_hdr(int sockfd, struct log_hdr* hdr) {
 // Manage the state of the client (networking/connections)
 // ==============================================================================
 
-void attach_if_needed(char* dest, int destLen) {
+amb_client_t* amb_client_new() {
+  amb_client_t* c = (amb_client_t*)calloc(1, sizeof(struct amb_client));
+  c->to_coord   = -1;
+  c->from_coord = -1;
+  c->ring = (struct spsc_rring*)calloc(1, sizeof(struct spsc_rring));
+  c->control = (struct spsc_rring*)calloc(1, sizeof(struct spsc_rring));
+  c->continuations.next_callID = 1;
+  return c;
+}
+
+// Legacy callers may set up the default client by hand (connecting,
+// then assigning g_to_immortal_coord/g_from_immortal_coord themselves).
+static amb_client_t* resolve_client(void* arg) {
+  amb_client_t* c = arg != NULL ? (amb_client_t*)arg : &g_default_client;
+  if (c == &g_default_client && c->to_coord < 0) {
+    c->to_coord   = g_to_immortal_coord;
+    c->from_coord = g_from_immortal_coord;
+  }
+  return c;
+}
+
+amb_client_t* amb_default_client() {
+  return &g_default_client;
+}
+
+amb_client_t* amb_current_client() {
+  return t_current_client != NULL ? t_current_client : resolve_client(NULL);
+}
+
+void amb_client_set_callbacks(amb_client_t* client, amb_dispatch_fn dispatch,
+                              amb_checkpoint_fn checkpoint, void* user) {
+  client->dispatch   = dispatch;
+  client->checkpoint = checkpoint;
+  client->user       = user;
+}
+
+void* amb_client_user_data(amb_client_t* client) {
+  return client->user;
+}
+
+static void default_dispatch(amb_client_t* client, int32_t methodID, void* args, int argsLen) {
+  (void)client;
+#ifndef _WIN32
+  if (amb_dispatch_method == NULL) {
+    fprintf(stderr, "\nERROR: the default client needs amb_dispatch_method to be defined\n");
+    amb_abort();
+  }
+#endif
+  amb_dispatch_method(methodID, args, argsLen);
+}
+
+static void default_checkpoint(amb_client_t* client, int upfd) {
+  (void)client;
+#ifndef _WIN32
+  if (send_dummy_checkpoint == NULL) {
+    fprintf(stderr, "\nERROR: the default client needs send_dummy_checkpoint to be defined\n");
+    amb_abort();
+  }
+#endif
+  send_dummy_checkpoint(upfd);
+}
+
+static void drain_ring(amb_client_t* client);
+static int  poll_send(amb_client_t* client);
+static void publish_stats_if_due(amb_client_t* client);
+static int  wait_socket(int fd, int for_write, int timeout_ms);
+
+// Reserve space in one of the client's rings (bulk or control).
+static char* reserve_in(amb_client_t* client, struct spsc_rring* r, int len) {
+  if (!client->polled)
+    return rring_reserve(r, len);
+  // Without a network thread, nobody else will free up space:
+  if (len >= rring_max_capacity(r)) {
+    fprintf(stderr,"\nERROR: amb_client_reserve request bigger than allocated buffer itself! %d", len);
+    amb_abort();
+  }
+  char* ptr = rring_try_reserve(r, len);
+  if (ptr != NULL) return ptr;
+  int64_t start = amb_monotonic_ns();
+  while ((ptr = rring_try_reserve(r, len)) == NULL)
+    drain_ring(client);
+  rring_count_stall(r, amb_monotonic_ns() - start);
+  return ptr;
+}
+
+// The send ring only exists once the startup protocol has run; before
+// that its capacity is zero and a reservation could never be served.
+static void require_started(amb_client_t* client, const char* what) {
+  if (client->ring->buffer == NULL) {
+    fprintf(stderr,"\nERROR: %s called before the client started (no send ring yet)\n", what);
+    amb_abort();
+  }
+}
+
+// Serve a reservation that can never fit in the ring.
+static char* reserve_spill(amb_client_t* client, int len) {
+  if (len > client->spill_cap) {
+    free(client->spill);
+    client->spill = (char*)malloc(len);
+    if (client->spill == NULL) {
+      fprintf(stderr,"\nERROR: could not allocate a %d byte spill buffer\n", len);
+      amb_abort();
+    }
+    client->spill_cap = len;
+  }
+  client->spilling = 1;
+  amb_debug_log("Reservation of %d bytes exceeds the ring, using the spill buffer\n", len);
+  return client->spill;
+}
+
+char* amb_client_reserve(amb_client_t* client, int len) {
+  require_started(client, "amb_client_reserve");
+  if (len >= rring_max_capacity(client->ring))
+    return reserve_spill(client, len);
+  return reserve_in(client, client->ring, len);
+}
+
+char* amb_try_reserve(amb_client_t* client, int len) {
+  require_started(client, "amb_try_reserve");
+  if (len >= rring_max_capacity(client->ring))
+    return reserve_spill(client, len);
+  char* ptr = rring_try_reserve(client->ring, len);
+  if (ptr == NULL && client->polled) {
+    poll_send(client); // Does not block either.
+    ptr = rring_try_reserve(client->ring, len);
+  }
+  if (ptr == NULL && client->writable_fn != NULL)
+    client->writable_armed = 1;
+  return ptr;
+}
+
+void amb_client_release(amb_client_t* client, int len) {
+  if (client->spilling) {
+    client->spilling = 0;
+    amb_client_send_bytes(client, client->spill, len);
+    return;
+  }
+  rring_release(client->ring, len);
+  if (client->bulk_depth == 0) client->msgs_sent++;
+}
+
+void amb_client_on_writable(amb_client_t* client, amb_writable_fn fn, void* arg,
+                            int low_watermark) {
+  client->writable_fn    = fn;
+  client->writable_arg   = arg;
+  client->low_watermark  = low_watermark;
+  client->writable_armed = 0;
+}
+
+// Fire the "writable again" callback if it is armed and the ring has
+// drained far enough.  Processing thread only.
+static void check_writable(amb_client_t* client) {
+  if (!client->writable_armed) return;
+  int wm = client->low_watermark > 0 ? client->low_watermark : rring_max_capacity(client->ring) / 4;
+  if (rring_used(client->ring) > wm) return;
+  client->writable_armed = 0;
+  client->writable_fn(client, client->writable_arg);
+}
+
+// A message that reaches the ring in several releases is open from
+// the first to the last of them.  bulk_seq is odd meanwhile, which
+// keeps the consumer from sending control messages into its middle
+// (see note_bulk_peek).  Producer only; these nest.
+static void begin_bulk_message(amb_client_t* client) {
+  if (client->bulk_depth++ > 0) return;
+  client->bulk_seq++;
+  amb_full_fence(); // Before any of its bytes are released.
+}
+
+static void end_bulk_message(amb_client_t* client) {
+  if (--client->bulk_depth > 0) return;
+  amb_full_fence();
+  client->bulk_seq++;
+  client->msgs_sent++;
+}
+
+// (Consumer) Whether the end of the ring's released bytes is a message
+// boundary: no multi-release message was open at any point between
+// seq0 (read before the peek) and now.
+static int bulk_end_is_boundary(amb_client_t* client, int64_t seq0) {
+  amb_full_fence();
+  return (seq0 & 1) == 0 && client->bulk_seq == seq0;
+}
+
+// (Consumer) Account for a peek of numbytes from the ring, of which
+// sent have now gone out.  Control messages may only follow a whole
+// message, so the lane stays closed while a partly sent slice or an
+// open message sits at the head of the stream.
+static void note_bulk_peek(amb_client_t* client, int64_t seq0, int numbytes, int sent) {
+  if (sent < numbytes) client->bulk_mid_message = 1;
+  else if (bulk_end_is_boundary(client, seq0)) client->bulk_mid_message = 0;
+  else if (numbytes > 0) client->bulk_mid_message = 1;
+}
+
+void amb_client_send_bytes(amb_client_t* client, const void* buf, int64_t len) {
+  const char* cur = (const char*)buf;
+  require_started(client, "amb_client_send_bytes");
+  // Leave the ring room to hold a piece while another is in flight:
+  int piece = rring_max_capacity(client->ring) / 2;
+  int pieces = len > piece;
+  if (pieces) begin_bulk_message(client);
+  while (len > 0) {
+    int n = len < piece ? (int)len : piece;
+    char* dst = amb_client_reserve(client, n);
+    memcpy(dst, cur, n);
+    amb_client_release(client, n);
+    cur += n;
+    len -= n;
+  }
+  if (pieces) end_bulk_message(client);
+}
+
+void amb_client_send_control(amb_client_t* client, const void* buf, int len) {
+  if (client->control->buffer == NULL) {
+    // Not started yet: no network thread is writing the socket.
+    amb_socket_send_all(client->to_coord, buf, len, 0);
+    return;
+  }
+  char* dst = reserve_in(client, client->control, len);
+  memcpy(dst, buf, len);
+  rring_release(client->control, len);
+  client->msgs_sent++;
+}
+
+void amb_client_send_checkpoint(amb_client_t* client, const void* ckpt, int64_t len) {
+  // The payload is just a 64 bit size; the checkpoint bytes follow the message.
+  char hdr[16];
+  char* cur = write_zigzag_int(hdr, 1 + 8); // Size (including type tag)
+  *cur++ = Checkpoint;                      // Type
+  memcpy(cur, &len, 8);                     // 8 byte size
+  cur += 8;
+  if (client->ring->buffer == NULL) {
+    // Startup protocol: no network thread is writing the socket yet.
+    amb_socket_send_all(client->to_coord, hdr, cur - hdr, 0);
+    amb_socket_send_all(client->to_coord, ckpt, len, 0);
+  } else {
+    begin_bulk_message(client); // The header and the checkpoint are one message.
+    amb_client_send_bytes(client, hdr, cur - hdr);
+    amb_client_send_bytes(client, ckpt, len);
+    end_bulk_message(client);
+  }
+  amb_debug_log("  Checkpoint message sent to coordinator, checkpoint %lld bytes\n", (long long)len);
+}
+
+void amb_client_attach_if_needed(amb_client_t* client, char* dest, int destLen) {
   // HACK: only working for one dest atm...
-  if (!g_attached && destLen != 0) // If destName=="" we are sending to OURSELF and don't need attach.
+  if (!client->attached && destLen != 0) // If destName=="" we are sending to OURSELF and don't need attach.
   {
-      amb_debug_log("Sending attach message re: dest = %s...\n", dest);
+      amb_debug_log("Sending attach message re: dest = %.*s...\n", destLen, dest);
       char sendbuf[128];
       char* cur = sendbuf;
-      int dest_len = strlen(dest);
+      int dest_len = destLen; // dest may point into a received record, not NUL-terminated.
       cur = (char*)write_zigzag_int(cur, dest_len + 1); // Size
       *cur++ = (char)AttachTo;                        // Type
       memcpy(cur, dest, dest_len); cur+=dest_len;
-#ifdef AMBCLIENT_DEBUG
-      amb_debug_log("  Attach message: ", dest);
-      print_hex_bytes(amb_dbg_fd, sendbuf, cur-sendbuf);
-      fprintf(amb_dbg_fd,"\n");
-#endif
-      amb_socket_send_all(g_to_immortal_coord, sendbuf, cur-sendbuf, 0);
-      g_attached = 1;
-      amb_debug_log("  attach message sent (%d bytes)\n", cur-sendbuf);
+      amb_log_hex(AMB_LOG_DEBUG, "  Attach message: ", sendbuf, (int)(cur-sendbuf));
+      amb_client_send_control(client, sendbuf, cur-sendbuf);
+      client->attached = 1;
+      amb_debug_log("  attach message sent (%d bytes)\n", (int)(cur-sendbuf));
+  }
+}
+
+void attach_if_needed(char* dest, int destLen) {
+  amb_client_attach_if_needed(amb_current_client(), dest, destLen);
+}
+
+// Async/await RPCs
+// ------------------------------
+
+void amb_client_set_instance_name(amb_client_t* client, const char* name) {
+  free(client->instance_name);
+  client->instance_name_len = strlen(name);
+  client->instance_name = (char*)malloc(client->instance_name_len + 1);
+  memcpy(client->instance_name, name, client->instance_name_len + 1);
+}
+
+static void ensure_instance_name(amb_client_t* client) {
+  if (client->instance_name != NULL) return;
+  char* env = getenv("AMBROSIA_INSTANCE_NAME");
+  if (env == NULL) {
+    fprintf(stderr, "\nERROR: async/await RPCs need a return address: call amb_set_instance_name"
+            " or set AMBROSIA_INSTANCE_NAME\n");
+    amb_abort();
   }
+  amb_client_set_instance_name(client, env);
+}
+
+int64_t amb_client_send_async_rpc(amb_client_t* client, char* dest, int32_t destLen,
+                                  int32_t methodID, void* args, int argsLen,
+                                  amb_continuation_t k, void* closure) {
+  ensure_instance_name(client);
+  require_started(client, "amb_client_send_async_rpc");
+  int64_t callID = amb_continuations_register(&client->continuations, k, closure);
+
+  amb_client_attach_if_needed(client, dest, destLen);
+  int sizeBound = 5 + 1                   // size, type tag
+    + 5 + destLen + 1                     // RPC_or_RetVal
+    + 5 + 1                               // rpc type
+    + 5 + client->instance_name_len + 10  // return address, call ID
+    + argsLen;
+  char* start = amb_client_reserve(client, sizeBound);
+  char* cur = amb_write_outgoing_async_rpc_hdr(start, dest, destLen, methodID,
+                                               client->instance_name, client->instance_name_len,
+                                               callID, argsLen);
+  memcpy(cur, args, argsLen); cur += argsLen;
+  amb_client_release(client, cur - start);
+  amb_debug_log("Sent async RPC %lld to method %d (%d bytes of args)\n",
+                (long long)callID, methodID, argsLen);
+  return callID;
+}
+
+int amb_client_current_call(amb_client_t* client, char** sender, int32_t* senderLen,
+                            int64_t* callID) {
+  if (client->current_callID == 0) return 0;
+  *sender    = client->current_sender;
+  *senderLen = client->current_sender_len;
+  *callID    = client->current_callID;
+  return 1;
+}
+
+void amb_client_send_return_value_to(amb_client_t* client, char* dest, int32_t destLen,
+                                     int64_t callID, char retType, void* retval, int retLen) {
+  ensure_instance_name(client);
+  amb_client_attach_if_needed(client, dest, destLen);
+  int sizeBound = 5 + 1                   // size, type tag
+    + 5 + destLen + 1                     // return value type
+    + 5 + client->instance_name_len + 10  // return address, call ID
+    + retLen;
+  char* start = amb_client_reserve(client, sizeBound);
+  char* cur = amb_write_return_value_hdr(start, dest, destLen, retType,
+                                         client->instance_name, client->instance_name_len,
+                                         callID, retLen);
+  memcpy(cur, retval, retLen); cur += retLen;
+  amb_client_release(client, cur - start);
+}
+
+void amb_client_send_return_value(amb_client_t* client, char retType, void* retval, int retLen) {
+  if (client->current_callID == 0) return; // Fire-and-forget: nobody is waiting.
+  amb_client_send_return_value_to(client, client->current_sender, client->current_sender_len,
+                                  client->current_callID, retType, retval, retLen);
+}
+
+int64_t amb_client_outstanding_calls(amb_client_t* client) {
+  return client->continuations.outstanding;
+}
+
+// The global API acts on the current client:
+
+void amb_set_instance_name(const char* name) {
+  amb_client_set_instance_name(amb_current_client(), name);
+}
+
+int64_t amb_send_async_rpc(char* dest, int32_t destLen, int32_t methodID,
+                           void* args, int argsLen,
+                           amb_continuation_t k, void* closure) {
+  return amb_client_send_async_rpc(amb_current_client(), dest, destLen, methodID,
+                                   args, argsLen, k, closure);
+}
+
+int amb_current_call(char** sender, int32_t* senderLen, int64_t* callID) {
+  return amb_client_current_call(amb_current_client(), sender, senderLen, callID);
+}
+
+void amb_send_return_value_to(char* dest, int32_t destLen, int64_t callID,
+                              char retType, void* retval, int retLen) {
+  amb_client_send_return_value_to(amb_current_client(), dest, destLen, callID,
+                                  retType, retval, retLen);
+}
+
+void amb_send_return_value(char retType, void* retval, int retLen) {
+  amb_client_send_return_value(amb_current_client(), retType, retval, retLen);
+}
+
+int64_t amb_outstanding_calls() {
+  return amb_client_outstanding_calls(amb_current_client());
 }
 
 // Hacky busy-wait by thread-yielding for now:
@@ -287,6 +780,404 @@ void amb_yield_thread() {
 }
 
 
+// Latency profiles
+//------------------------------------------------------------------------------
+
+void amb_latency_profile_low_latency(struct amb_latency_profile* p) {
+  p->tcp_nodelay         = 1;
+  p->tcp_quickack        = 1;
+  p->busy_poll_usec      = 50;
+  p->size_socket_buffers = 1;
+  p->busy_poll_reads     = 1;
+}
+
+static int env_int(const char* name, int dflt) {
+  char* v = getenv(name);
+  return (v != NULL && *v != 0) ? atoi(v) : dflt;
+}
+
+void amb_latency_profile_init(struct amb_latency_profile* p) {
+  memset(p, 0, sizeof(*p));
+  p->processing_cpu = env_int("AMBROSIA_PROCESSING_CPU", -1);
+  p->network_cpu    = env_int("AMBROSIA_NETWORK_CPU", -1);
+  p->numa_node      = env_int("AMBROSIA_NUMA_NODE", -1);
+  char* prof = getenv("AMBROSIA_LATENCY_PROFILE");
+  if (prof != NULL && strcmp(prof, "low") == 0)
+    amb_latency_profile_low_latency(p);
+}
+
+static struct amb_latency_profile* get_profile(amb_client_t* client) {
+  if (!client->profile_set) {
+    amb_latency_profile_init(&client->profile);
+    client->profile_set = 1;
+  }
+  return &client->profile;
+}
+
+void amb_client_set_latency_profile(amb_client_t* client, const struct amb_latency_profile* profile) {
+  client->profile = *profile;
+  client->profile_set = 1;
+}
+
+const struct amb_latency_profile* amb_client_latency_profile(amb_client_t* client) {
+  return get_profile(client);
+}
+
+// Pin the calling thread to one CPU, or else to the CPUs of a NUMA node.
+// Failures only warn: placement is a performance hint.
+static void pin_current_thread(int cpu, int numa_node) {
+  if (cpu < 0 && numa_node < 0) return;
+#ifdef _WIN32
+  ULONGLONG mask = 0;
+  if (cpu >= 0) mask = (ULONGLONG)1 << cpu;
+  else if (!GetNumaNodeProcessorMask((UCHAR)numa_node, &mask)) mask = 0;
+  if (mask == 0 || SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) == 0)
+    fprintf(stderr, "WARNING: could not pin thread (cpu %d, numa node %d)\n", cpu, numa_node);
+#else
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (cpu >= 0) CPU_SET(cpu, &set);
+  else {
+    // No libnuma dependency: sysfs lists the node's CPUs as ranges, e.g. "0-7,16-23".
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+    FILE* f = fopen(path, "r");
+    int lo, hi;
+    char sep;
+    while (f != NULL && fscanf(f, "%d", &lo) == 1) {
+      hi = lo;
+      if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+        if (fscanf(f, "%d", &hi) != 1) break;
+        if (fscanf(f, "%c", &sep) != 1) sep = 0;
+      }
+      for (int i = lo; i <= hi && i < CPU_SETSIZE; i++) CPU_SET(i, &set);
+      if (sep != ',') break;
+    }
+    if (f != NULL) fclose(f);
+  }
+  if (CPU_COUNT(&set) == 0 ||
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    fprintf(stderr, "WARNING: could not pin thread (cpu %d, numa node %d)\n", cpu, numa_node);
+#endif
+}
+
+void amb_client_pin_processing_thread(amb_client_t* client) {
+  struct amb_latency_profile* p = get_profile(client);
+  pin_current_thread(p->processing_cpu, p->numa_node);
+}
+
+static void set_socket_option(int fd, int level, int opt, int val, const char* name) {
+  if (setsockopt(fd, level, opt, (const char*)&val, sizeof(val)) != 0)
+    fprintf(stderr, "WARNING: could not set %s=%d on socket: %s\n", name, val, amb_get_error_string());
+}
+
+// Raise a socket buffer to the ring size.  Never shrink it: a small
+// ring should not throttle the TCP window.  (The kernel also caps it,
+// e.g. at net.core.wmem_max.)
+static void grow_socket_buffer(int fd, int opt, int sz, const char* name) {
+  int cur = 0;
+#ifdef _WIN32
+  int len = sizeof(cur);
+#else
+  socklen_t len = sizeof(cur);
+#endif
+  if (getsockopt(fd, SOL_SOCKET, opt, (char*)&cur, &len) == 0 && cur >= sz) return;
+  set_socket_option(fd, SOL_SOCKET, opt, sz, name);
+}
+
+// Apply the socket half of a profile to freshly connected sockets.
+static void tune_sockets(amb_client_t* client, int upfd, int downfd, int bufSz) {
+  struct amb_latency_profile* p = get_profile(client);
+  if (p->tcp_nodelay) {
+    set_socket_option(upfd,   IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    set_socket_option(downfd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+  }
+  if (p->size_socket_buffers) {
+    grow_socket_buffer(upfd,   SO_SNDBUF, bufSz, "SO_SNDBUF");
+    grow_socket_buffer(downfd, SO_RCVBUF, bufSz, "SO_RCVBUF");
+  }
+#ifdef __linux__
+  if (p->tcp_quickack)
+    set_socket_option(downfd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+  if (p->busy_poll_usec > 0)
+    set_socket_option(downfd, SOL_SOCKET, SO_BUSY_POLL, p->busy_poll_usec, "SO_BUSY_POLL");
+#endif
+}
+
+// Linux leaves quick-ack mode on its own once the connection looks
+// interactive again.  Turning it back on is a system call, so do it
+// only after a read drained the socket: the next segment to arrive is
+// then the one whose ACK a delayed-ACK timer would hold back.
+static void rearm_quickack(amb_client_t* client) {
+#ifdef __linux__
+  set_socket_option(client->from_coord, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+  client->quickack_calls++;
+#else
+  (void)client;
+#endif
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+void amb_client_recv(amb_client_t* client, void* buf, int len) {
+  struct amb_latency_profile* p = get_profile(client);
+  int fd = client->from_coord;
+  char* cur = (char*)buf;
+  int got = 0;
+  int drained = 0; // A read found less than we wanted.
+  while (got < len) {
+#ifdef _WIN32
+    int n = recv(fd, cur + got, len - got, MSG_WAITALL);
+    client->recv_calls++;
+#else
+    int n = recv(fd, cur + got, len - got, p->busy_poll_reads ? MSG_DONTWAIT : MSG_WAITALL);
+    client->recv_calls++;
+    if (n < 0 && p->busy_poll_reads && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      drained = 1;
+      cpu_relax();
+      continue;
+    }
+#endif
+    if (n <= 0) {
+      fprintf(stderr,"\nERROR: connection interrupted. Received %d of %d bytes, errno = %s\n",
+              got, len, n < 0 ? amb_get_error_string() : "(closed)");
+      amb_abort();
+    }
+    if (n < len - got) drained = 1;
+    got += n;
+  }
+  if (p->tcp_quickack && drained)
+    rearm_quickack(client);
+}
+
+
+// Flush policy
+//------------------------------------------------------------------------------
+
+void amb_flush_policy_init(struct amb_flush_policy* p) {
+  p->min_bytes      = env_int("AMBROSIA_FLUSH_BYTES", 0);
+  p->max_delay_usec = env_int("AMBROSIA_FLUSH_USEC", 0);
+  p->adaptive       = env_int("AMBROSIA_FLUSH_ADAPTIVE", 1);
+  p->cork           = env_int("AMBROSIA_FLUSH_CORK", 0);
+}
+
+static struct amb_flush_policy* get_flush_policy(amb_client_t* client) {
+  if (!client->flush_set) {
+    amb_flush_policy_init(&client->flush);
+    client->flush_set = 1;
+  }
+  return &client->flush;
+}
+
+void amb_client_set_flush_policy(amb_client_t* client, const struct amb_flush_policy* policy) {
+  client->flush = *policy;
+  client->flush_set = 1;
+}
+
+void amb_client_flush_stats(amb_client_t* client, struct amb_flush_stats* out) {
+  *out = client->flush_stats;
+}
+
+// Runtime statistics
+//------------------------------------------------------------------------------
+
+// Read a counter that its own thread keeps updating, without tearing.
+static inline int64_t load_relaxed(const int64_t* p) {
+#ifdef _WIN32
+  return *(const volatile int64_t*)p; // Aligned 64 bit loads are atomic on x64.
+#else
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline double load_relaxed_double(const double* p) {
+#ifdef _WIN32
+  return *(const volatile double*)p;
+#else
+  double v;
+  __atomic_load(p, &v, __ATOMIC_RELAXED);
+  return v;
+#endif
+}
+
+void amb_client_get_stats(amb_client_t* client, struct amb_stats* out) {
+  out->bytes_sent       = load_relaxed(&client->flush_stats.bytes);
+  out->send_calls       = load_relaxed(&client->flush_stats.sends);
+  out->yield_calls      = load_relaxed(&client->yields);
+  out->msgs_sent        = load_relaxed(&client->msgs_sent);
+  out->ring_high_water  = load_relaxed(&client->ring->high_water);
+  out->ring_stalls      = load_relaxed(&client->ring->stalls);
+  out->ring_stall_ns    = load_relaxed(&client->ring->stall_ns);
+  out->bytes_received   = load_relaxed(&client->recv_bytes);
+  out->records_received = load_relaxed(&client->recv_records);
+  out->msgs_received    = load_relaxed(&client->recv_msgs);
+  out->recv_calls       = load_relaxed(&client->recv_calls);
+  out->quickack_calls   = load_relaxed(&client->quickack_calls);
+}
+
+// Copy a histogram that another thread may be recording into.  Buckets
+// past that of the maximum are empty, so they are left alone; dst must
+// start out empty and only ever be refreshed from the same src.
+static void copy_histogram(struct amb_histogram* dst, const struct amb_histogram* src) {
+  int64_t count = load_relaxed(&src->count);
+  if (count == dst->count) return; // Nothing recorded since.
+  dst->min = load_relaxed(&src->min);
+  dst->max = load_relaxed(&src->max);
+  dst->sum = load_relaxed_double(&src->sum);
+  int last = count == 0 ? -1 : amb_hist_bucket(dst->max);
+  for (int i = 0; i <= last; i++) dst->counts[i] = load_relaxed(&src->counts[i]);
+  dst->count = count;
+}
+
+void amb_client_get_stats_histograms(amb_client_t* client, struct amb_stats_histograms* out) {
+  memset(out, 0, sizeof(*out));
+  copy_histogram(&out->stall_latency, &client->stall_latency);
+  copy_histogram(&out->dispatch_latency, &client->dispatch_latency);
+}
+
+void amb_get_stats(struct amb_stats* out) {
+  amb_client_get_stats(amb_current_client(), out);
+}
+
+void amb_get_stats_histograms(struct amb_stats_histograms* out) {
+  amb_client_get_stats_histograms(amb_current_client(), out);
+}
+
+struct stats_publisher {
+  struct amb_stats_page* page;
+  int64_t interval_ns;
+  int64_t next_ns;
+};
+
+// Clients in this process that have published statistics.
+static volatile long g_stats_pages = 0;
+
+// Map the page named by AMBROSIA_STATS_SHM, if any.  Failures only
+// warn: statistics are a diagnostic aid.
+static void open_stats_publisher(amb_client_t* client) {
+  const char* env = getenv("AMBROSIA_STATS_SHM");
+  if (env == NULL || *env == 0) return;
+  size_t sz = sizeof(struct amb_stats_page);
+  struct amb_stats_page* page = NULL;
+  // The first client takes the name itself, any others NAME.1, NAME.2, ...
+#ifdef _WIN32
+  long idx = InterlockedIncrement(&g_stats_pages) - 1;
+#else
+  long idx = __sync_fetch_and_add(&g_stats_pages, 1);
+#endif
+  char name[200];
+  if (idx == 0) snprintf(name, sizeof(name), "%s", env);
+  else          snprintf(name, sizeof(name), "%s.%ld", env, idx);
+#ifdef _WIN32
+  char path[256];
+  snprintf(path, sizeof(path), "Local\\%s", name);
+  HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)sz, path);
+  if (h != NULL) page = (struct amb_stats_page*)MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, sz);
+#else
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+  int fd = shm_open(path, O_CREAT | O_RDWR, 0644);
+  if (fd >= 0 && ftruncate(fd, sz) == 0) {
+    void* mem = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem != MAP_FAILED) page = (struct amb_stats_page*)mem;
+  }
+  if (fd >= 0) close(fd);
+#endif
+  if (page == NULL) {
+    fprintf(stderr, "WARNING: could not map statistics page %s: %s\n", path, amb_get_error_string());
+    return;
+  }
+  memset(page, 0, sz);
+  page->magic = AMB_STATS_MAGIC;
+  page->size  = (uint32_t)sz;
+#ifdef _WIN32
+  page->pid   = GetCurrentProcessId();
+#else
+  page->pid   = getpid();
+#endif
+  struct stats_publisher* pub = (struct stats_publisher*)calloc(1, sizeof(*pub));
+  pub->page = page;
+  pub->interval_ns = (int64_t)env_int("AMBROSIA_STATS_MS", 1000) * 1000000;
+  client->publisher = pub;
+  printf(" *** Publishing statistics to shared memory %s every %d ms\n",
+         path, (int)(pub->interval_ns / 1000000));
+}
+
+// Copy the statistics to the shared page (sending thread only).
+static void publish_stats_if_due(amb_client_t* client) {
+  struct stats_publisher* pub = client->publisher;
+  if (pub == NULL) return;
+  int64_t now = amb_monotonic_ns();
+  if (now < pub->next_ns) return;
+  pub->next_ns = now + pub->interval_ns;
+  struct amb_stats_page* page = pub->page;
+  page->seq++; // Odd: update in progress.
+  amb_full_fence();
+  amb_client_get_stats(client, &page->stats);
+  copy_histogram(&page->histograms.stall_latency, &client->stall_latency);
+  copy_histogram(&page->histograms.dispatch_latency, &client->dispatch_latency);
+  page->updated_ns = now;
+  amb_full_fence();
+  page->seq++;
+}
+
+static int64_t now_usec() {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, current;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&current);
+  return (int64_t)(current.QuadPart * 1000000 / frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static void set_cork(int fd, int on) {
+#ifdef __linux__
+  set_socket_option(fd, IPPROTO_TCP, TCP_CORK, on, "TCP_CORK");
+#endif
+}
+
+// Send everything in the priority lane (network thread only).
+static void send_control_lane(amb_client_t* client) {
+  int numbytes = -1;
+  char* ptr;
+  while ((ptr = rring_peek(client->control, &numbytes)) != NULL && numbytes > 0) {
+    amb_debug_log(" network thread: sending %d bytes of control messages\n", numbytes);
+    AMB_TRACE(AMB_TRACE_SEND_BEGIN, 0, numbytes, 0);
+    client->flush_stats.sends += amb_socket_send_all(client->to_coord, ptr, numbytes, 0);
+    AMB_TRACE(AMB_TRACE_SEND_END, 0, numbytes, 0);
+    AMB_PROBE1(send, numbytes);
+    rring_pop(client->control, numbytes);
+    client->flush_stats.bytes += numbytes;
+  }
+}
+
+// Hand the pages of an elastic ring back once it has been empty for
+// the trim interval.  Called by the ring's consumer, when idle.
+static void trim_if_idle(amb_client_t* client) {
+  if (client->ring_trimmed || client->ring_trim_usec <= 0) return;
+  int64_t now = now_usec();
+  if (client->ring_idle_since == 0) { client->ring_idle_since = now; return; }
+  if (now - client->ring_idle_since < client->ring_trim_usec) return;
+  client->ring_idle_since = 0; // Retry after another interval if it backs off.
+  if (rring_trim(client->ring)) {
+    client->ring_trimmed = 1;
+    amb_debug_log(" trimmed the ring after %d us idle\n", client->ring_trim_usec);
+  }
+}
+
+static void ring_active(amb_client_t* client) {
+  client->ring_idle_since = 0;
+  client->ring_trimmed = 0;
+}
+
 // Launch a background thread that progresses the network.
 #ifdef _WIN32
 DWORD WINAPI amb_network_progress_thread( LPVOID lpParam )
@@ -294,28 +1185,90 @@ DWORD WINAPI amb_network_progress_thread( LPVOID lpParam )
 void*        amb_network_progress_thread( void* lpParam )
 #endif
 {
+  // A NULL argument selects the default client:
+  amb_client_t* client = resolve_client(lpParam);
+  struct amb_latency_profile* prof = get_profile(client);
+  pin_current_thread(prof->network_cpu, prof->numa_node);
+  AMB_TRACE_THREAD("network");
+  struct amb_flush_policy* pol = get_flush_policy(client);
+  struct amb_flush_stats* st = &client->flush_stats;
+  int batching = pol->min_bytes > 0 && pol->max_delay_usec > 0;
   printf(" *** Network progress thread starting...\n");
+  if (batching)
+    printf(" *** Flush policy: %d bytes or %d us (adaptive %d, cork %d)\n",
+           pol->min_bytes, pol->max_delay_usec, pol->adaptive, pol->cork);
   int hot_spin_amount = 1; // 100
   int spin_tries = hot_spin_amount;
-  while(1) {
+  int64_t first_unsent = 0;  // When the oldest unsent byte appeared (0: none).
+  int64_t last_send = 0;
+  int under_load = 0;        // Whether the current batch is held back.
+  int corked = 0;
+  while (!client->network_stop) {
+    // A pending amb_client_flush: send without holding back, and
+    // acknowledge once both rings are empty.
+    int64_t flush_want = client->flush_requested;
+    int flushing = flush_want != client->flush_acked;
+    if (flushing) amb_full_fence(); // Observe every release made before the request.
+    int64_t seq0 = client->bulk_seq;
+    amb_full_fence();
     int numbytes = -1;
-    char* ptr = peek_buffer(&numbytes);    
+    char* ptr = rring_peek(client->ring, &numbytes);
+    // Control messages may overtake the bulk bytes just observed, but
+    // not bulk bytes released after them, so check them second.  They
+    // wait while the bytes sent so far end inside a message:
+    if (!client->bulk_mid_message) send_control_lane(client);
     if (numbytes > 0) {
+      AMB_TRACE(AMB_TRACE_PEEK, 0, numbytes, 0);
+      int flags = 0;
+      if (batching) {
+        int64_t now = now_usec();
+        if (first_unsent == 0) {
+          first_unsent = now;
+          // After a quiet spell, don't make a lone message wait:
+          under_load = !pol->adaptive || (now - last_send < pol->max_delay_usec);
+        }
+        // In the torn state this slice ends at the (early) wrap point
+        // and cannot grow, and more bytes follow it.
+        int torn = client->ring->tail < client->ring->head;
+        if (!under_load)                                   st->idle_flushes++;
+        else if (numbytes >= pol->min_bytes || torn)       st->size_flushes++;
+        else if (now - first_unsent >= pol->max_delay_usec || flushing) st->deadline_flushes++;
+        else { amb_yield_thread(); continue; }
+        if (under_load && pol->cork && !corked) { set_cork(client->to_coord, 1); corked = 1; }
+#ifdef MSG_MORE
+        if (torn) flags = MSG_MORE;
+#endif
+        last_send = now;
+        first_unsent = 0;
+      } else st->idle_flushes++;
       amb_debug_log(" network thread: sending slice of %d bytes\n", numbytes);
-      amb_socket_send_all(g_to_immortal_coord, ptr, numbytes, 0);
-      pop_buffer(numbytes); // Must be at least this many.
+      AMB_TRACE(AMB_TRACE_SEND_BEGIN, 0, numbytes, 0);
+      st->sends += amb_socket_send_all(client->to_coord, ptr, numbytes, flags);
+      AMB_TRACE(AMB_TRACE_SEND_END, 0, numbytes, 0);
+      AMB_PROBE1(send, numbytes);
+      rring_pop(client->ring, numbytes); // Must be at least this many.
+      note_bulk_peek(client, seq0, numbytes, numbytes);
+      st->bytes += numbytes;
       spin_tries = hot_spin_amount;
+      ring_active(client);
+    } else if (corked) {
+      set_cork(client->to_coord, 0); // The ring drained: push out the tail.
+      corked = 0;
+    } else if (client->bulk_mid_message) {
+      note_bulk_peek(client, seq0, 0, 0); // Waiting for the rest of a message.
+    } else if (flushing) {
+      if (rring_used(client->control) == 0) client->flush_acked = flush_want;
     } else if ( spin_tries == 0) {
       spin_tries = hot_spin_amount;
+      trim_if_idle(client);
+      publish_stats_if_due(client);
       // amb_debug_log(" network thread: yielding to wait...\n");
-#ifdef AMBCLIENT_DEBUG      
-      amb_sleep_seconds(0.5);
-      amb_sleep_seconds(0.05);
-#endif
       amb_yield_thread();
+      client->yields++;
     } else spin_tries--;   
   }
-
+  if (corked) set_cork(client->to_coord, 0);
+  printf(" *** Network progress thread exiting.\n");
   return 0;
 }
 
@@ -344,7 +1297,7 @@ void enable_fast_loopback(SOCKET sock) {
       else {
         fprintf(stderr,        "\nERROR: Loopback Fastpath WSAIoctl failed with code: %d", 
                 LastError);
-        abort();
+        amb_abort();
       }
   }
 }
@@ -365,13 +1318,13 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   amb_debug_log("Initializing Winsock...\n");
   if (WSAStartup(MAKEWORD(2,2),&wsa) != 0) {
     fprintf(stderr,"\nERROR: Error Code : %d", WSAGetLastError());
-    abort();
+    amb_abort();
   }
 
   amb_debug_log("Creating to-AMBROSIA connection\n");  
   if((sock = socket(af_inet, SOCK_STREAM , 0 )) == INVALID_SOCKET) {
     fprintf(stderr, "ERROR: Could not create socket : %d" , WSAGetLastError());
-    abort();
+    amb_abort();
   }
 
   printf(" *** Configuring socket for Windows fast-loopback (pre-connect).\n");
@@ -385,7 +1338,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   
   if (connect(sock, (struct sockaddr *)&addr , sizeof(addr)) < 0) {
     fprintf(stderr, "\nERROR: Failed to connect to-socket: %s:%d\n", coordinator_host, upport); 
-    abort();
+    amb_abort();
   }
 #else
   struct sockaddr_in6 addr;  
@@ -396,7 +1349,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
     fprintf(stderr, "\nERROR: Failed to connect to-socket (ipv6): %s:%d\n Error: %s",
             coordinator_host, upport, amb_get_error_string()); 
-    abort();
+    amb_abort();
   }
   /*  
     DWORD ipv6only = 0;
@@ -404,7 +1357,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
                                    IPV6_V6ONLY, (char*)&ipv6only, sizeof(ipv6only) )) {
       fprintf(stderr, "\nERROR: Failed to setsockopt.\n"); 
       closesocket(sock);
-      abort();
+      amb_abort();
     }
     // Output parameters:
     SOCKADDR_STORAGE LocalAddr = {0};
@@ -424,7 +1377,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
                           NULL) ) {
       fprintf(stderr, "\nERROR: Failed to connect (IPV6) to-socket: %s:%d\n Error: %s\n",
               host, upport, amb_get_error_string());
-      abort();
+      amb_abort();
     }
   */
 #endif
@@ -437,7 +1390,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   SOCKET tempsock;
   if ((tempsock = socket(af_inet, SOCK_STREAM, 0)) == INVALID_SOCKET) {
     fprintf(stderr, "\nERROR: Failed to create (recv) socket: %d\n", WSAGetLastError());
-    abort();
+    amb_abort();
   }
 #ifdef IPV4  
   addr.sin_family = AF_INET;
@@ -450,7 +1403,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   if( bind(tempsock, (struct sockaddr *)&addr , sizeof(addr)) == SOCKET_ERROR) {
     fprintf(stderr,"\nERROR: bind returned error, addr:port is %s:%d\n Error was: %d\n",
             coordinator_host, downport, WSAGetLastError());
-    abort();
+    amb_abort();
   }
 
   // enable_fast_loopback(tempsock); // TEMP HACK:
@@ -459,7 +1412,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
     fprintf(stderr, "ERROR: listen() failed with error: %d\n", WSAGetLastError() );
     closesocket(tempsock);
     WSACleanup();
-    abort();
+    amb_abort();
   }
   struct sockaddr_in clientaddr;
   int addrlen = sizeof(struct sockaddr_in);
@@ -469,7 +1422,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   SOCKET new_socket = accept(tempsock, (struct sockaddr *)&clientaddr, &addrlen);
   if (new_socket == INVALID_SOCKET) {
     fprintf(stderr, "ERROR: accept failed with error code : %d" , WSAGetLastError());
-    abort();
+    amb_abort();
   }
 
   // enable_fast_loopback(new_socket); // TEMP HACK:
@@ -487,13 +1440,13 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
             coordinator_host, downport, amb_get_error_string() );
     closesocket(tempsock);
     WSACleanup();
-    abort();
+    amb_abort();
   }
   if ( listen(tempsock, 5) == SOCKET_ERROR) {
     fprintf(stderr, "ERROR: listen() failed with error: %s\n", amb_get_error_string() );
     closesocket(tempsock);
     WSACleanup();
-    abort();
+    amb_abort();
   }
   SOCKET new_socket = WSAAccept(tempsock, NULL, NULL, NULL, (DWORD_PTR)NULL);
 #endif
@@ -524,13 +1477,13 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   amb_debug_log("Creating to-AMBROSIA connection\n");  
   if ((*upptr = socket(af_inet, SOCK_STREAM, 0)) < 0) {
     fprintf(stderr, "\nERROR: Failed to create (send) socket.\n");
-    abort();
+    amb_abort();
   }
 #ifdef IPV4  
   immortalCoord = gethostbyname(coordinator_host);
   if (immortalCoord == NULL) {
     amb_debug_log("\nERROR: could not resolve host: %s\n", coordinator_host);
-    abort();
+    amb_abort();
   }
   addr.sin_family = af_inet;  
   memcpy( (char*)&addr.sin_addr.s_addr,
@@ -546,7 +1499,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
 
   if (connect(*upptr, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
     fprintf(stderr, "\nERROR: Failed to connect to-socket: %s:%d\n", coordinator_host, upport); 
-    abort();
+    amb_abort();
   }
 
   // Down link from the coordinator (recv channel)
@@ -555,7 +1508,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   int tempfd;
   if ((tempfd = socket(af_inet, SOCK_STREAM, 0)) < 0) {
     fprintf(stderr, "\nERROR: Failed to create (recv) socket.\n");
-    abort();
+    amb_abort();
   }
   memset((char*) &addr, 0, sizeof(addr));
 #ifdef IPV4
@@ -570,13 +1523,13 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   if (bind(tempfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
     fprintf(stderr,"\nERROR: bind returned error, addr:port is %s:%d\n ERRNO was: %s\n",
             coordinator_host, downport, strerror(errno));
-    abort();
+    amb_abort();
   }
 
   if ( listen(tempfd,5) ) {
     fprintf(stderr,"\nERROR: listen returned error, addr:port is %s:%d\n ERRNO was: %s\n",
             coordinator_host, downport, strerror(errno));
-    abort();
+    amb_abort();
   }
 #ifdef IPV4  
   struct sockaddr_in clientaddr;
@@ -587,7 +1540,7 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
   socklen_t addrlen = 0;
   if ((*downptr = accept(tempfd, (struct sockaddr*) &clientaddr, &addrlen)) < 0) {
     fprintf(stderr, "failed to accept connection, accept returned: %d", *downptr);
-    abort();
+    amb_abort();
   }
   return;
 }
@@ -599,7 +1552,10 @@ void amb_connect_sockets(int upport, int downport, int* upptr, int* downptr) {
 //------------------------------------------------------------------------------
 
 // Execute the startup messaging protocol.
-void amb_startup_protocol(int upfd, int downfd) {
+void amb_client_startup_protocol(amb_client_t* client, int upfd, int downfd) {
+  // The checkpoint callback below sends through the client:
+  client->to_coord   = upfd;
+  client->from_coord = downfd;
   struct log_hdr hdr; memset((void*) &hdr, 0, AMBROSIA_HEADERSIZE);
   assert(sizeof(struct log_hdr) == AMBROSIA_HEADERSIZE);
 
@@ -612,19 +1568,17 @@ void amb_startup_protocol(int upfd, int downfd) {
   if(recv(downfd, buf, payloadSz, MSG_WAITALL) < payloadSz) {
     fprintf(stderr,"\nERROR: connection interrupted. Did not receive all %d bytes of payload following header.",
             payloadSz);
-    abort();
+    amb_abort();
   }
 
-#ifdef AMBCLIENT_DEBUG
-  amb_debug_log("  Read %d byte payload following header: ", payloadSz);
-  print_hex_bytes(amb_dbg_fd, buf, payloadSz); fprintf(amb_dbg_fd,"\n");
-#endif
+  amb_debug_log("  Read %d byte payload following header:\n", payloadSz);
+  amb_log_hex(AMB_LOG_DEBUG, "  ", buf, payloadSz);
 
   int32_t msgsz = -1;
   char* buf2 = read_zigzag_int(buf, &msgsz);
   if (buf2 == NULL) {
     fprintf(stderr,"\nERROR: failed to parse zig-zag int for log record size.\n");
-    abort();
+    amb_abort();
   }
   char msgType = *buf2;
   amb_debug_log("  Read log record size: %d\n", msgsz);
@@ -638,11 +1592,11 @@ void amb_startup_protocol(int upfd, int downfd) {
   case Checkpoint:
     fprintf(stderr, "RECOVER mode ... not implemented yet.\n");
     
-    abort();
+    amb_abort();
     break;
   default:
     fprintf(stderr, "Protocol violation, did not expect this initial message type from server: %d", msgType);
-    abort();
+    amb_abort();
     break;
   }
   
@@ -687,12 +1641,8 @@ void amb_startup_protocol(int upfd, int downfd) {
 
   int totalbytes = msgsize + (bufcur-buf);
   amb_debug_log("  Now will send InitialMessage to ImmortalCoordinator, %lld total bytes, %d in payload.\n",
-         (int64_t)totalbytes, msgsize);
-#ifdef AMBCLIENT_DEBUG
-  amb_debug_log("  Message: ");
-  print_hex_bytes(amb_dbg_fd, buf, msgsize + (bufcur-buf));
-  fprintf(amb_dbg_fd,"\n");
-#endif
+         (long long)totalbytes, msgsize);
+  amb_log_hex(AMB_LOG_DEBUG, "  Message: ", buf, totalbytes);
   amb_socket_send_all(upfd, buf, totalbytes, 0);
   /* for(int i=0; i<totalbytes; i++) {
     printf("Sending byte[%d] = %x when you press enter...", i, buf[i]);
@@ -702,49 +1652,172 @@ void amb_startup_protocol(int upfd, int downfd) {
   
   // Send Checkpoint message
   // ----------------------------------------
-  send_dummy_checkpoint(upfd);
+  AMB_TRACE(AMB_TRACE_CHECKPOINT_BEGIN, 0, 0, 0);
+  AMB_PROBE1(checkpoint_begin, 0);
+  client->checkpoint(client, upfd);
+  AMB_PROBE1(checkpoint_end, 0);
+  AMB_TRACE(AMB_TRACE_CHECKPOINT_END, 0, 0, 0);
 
   return;
 }
 
-void amb_initialize_client_runtime(int upport, int downport, int bufSz)
+void amb_startup_protocol(int upfd, int downfd) {
+  amb_client_startup_protocol(&g_default_client, upfd, downfd);
+}
+
+// Connect, run the startup protocol and allocate the ring.
+static void connect_client(amb_client_t* client, int upport, int downport, int bufSz)
 {
   int upfd, downfd;
+  amb_log_init_from_env();
   amb_connect_sockets(upport, downport, &upfd, &downfd);
   amb_debug_log("Connections established (%d,%d), beginning protocol.\n", upfd, downfd);
-  amb_startup_protocol(upfd, downfd);
-
-  // Initialize global state that other API entrypoints use:
-  g_to_immortal_coord   = upfd;
-  g_from_immortal_coord = downfd;
+  amb_trace_init_from_env();
+  // Before any thread can send an async RPC or take its reply:
+  if (client->continuations.slots == NULL)
+    amb_continuations_init(&client->continuations, 0);
+  amb_client_startup_protocol(client, upfd, downfd);
 
   // Set a default:
   if (bufSz <= 0) bufSz = 20 * 1024 * 1024;
+  tune_sockets(client, upfd, downfd, bufSz);
+
+  // Initialize the state that other API entrypoints use:
+  client->to_coord   = upfd;
+  client->from_coord = downfd;
+  if (client == &g_default_client) {
+    g_to_immortal_coord   = upfd;
+    g_from_immortal_coord = downfd;
+  }
 
-  // Initialize the SPSC ring 
-  new_buffer(bufSz);
+  // Initialize the SPSC ring and the priority lane.  The ring is
+  // elastic: bufSz is only its ceiling.
+  int initial = env_int("AMBROSIA_RING_INITIAL", AMB_RING_INITIAL_SIZE);
+  if (initial <= 0 || initial > bufSz) initial = bufSz;
+  int flags = 0;
+  const char* huge = getenv("AMBROSIA_RING_HUGEPAGES");
+  if (huge != NULL && strcmp(huge, "thp") == 0)      flags = RRING_THP;
+  if (huge != NULL && strcmp(huge, "explicit") == 0) flags = RRING_HUGETLB;
+  rring_init_elastic(client->ring, initial, bufSz, flags);
+  client->ring->stall_hist = &client->stall_latency;
+  client->ring_trim_usec = env_int("AMBROSIA_RING_TRIM_MS", 1000) * 1000;
+  client->ring_trimmed = 1;
+  rring_init(client->control, AMB_CONTROL_LANE_SIZE);
+  open_stats_publisher(client);
+}
+
+void amb_client_initialize(amb_client_t* client, int upport, int downport, int bufSz)
+{
+  connect_client(client, upport, downport, bufSz);
 
 #ifdef _WIN32
   DWORD lpThreadId;
   HANDLE th = CreateThread(NULL, 0,
                            amb_network_progress_thread,
-                           NULL, 0,
+                           client, 0,
                            & lpThreadId);
   if (th == NULL)
 #else
   pthread_t th;
-  int res = pthread_create(& th, NULL, amb_network_progress_thread, NULL);
+  int res = pthread_create(& th, NULL, amb_network_progress_thread, client);
   if (res != 0)
 #endif
   {
     fprintf(stderr, "ERROR: failed to create network progress thread.\n");
-    abort();
+    amb_abort();
   }
+  client->network_thread  = th;
+  client->network_started = 1;
+}
+
+void amb_client_shutdown(amb_client_t* client)
+{
+  client->terminating = 1;
+}
+
+int amb_client_flush(amb_client_t* client, int timeout_ms)
+{
+  int64_t deadline = timeout_ms < 0 ? -1 : now_usec() + (int64_t)timeout_ms * 1000;
+  if (client->polled) {
+    while (poll_send(client)) {
+      int64_t left = deadline < 0 ? -1 : deadline - now_usec();
+      if (deadline >= 0 && left <= 0) return 0;
+      wait_socket(client->to_coord, 1, left < 0 ? -1 : (int)((left + 999) / 1000));
+    }
+    return 1;
+  }
+  if (!client->network_started) {
+    // No network thread (not initialized, or already closed): nothing
+    // will ever send what is buffered, so don't wait for it.
+    return rring_used(client->ring) + rring_used(client->control) == 0;
+  }
+#ifdef _WIN32
+  int64_t want = InterlockedIncrement64(&client->flush_requested);
+#else
+  int64_t want = __sync_add_and_fetch(&client->flush_requested, 1);
+#endif
+  while (client->flush_acked < want) {
+    if (client->network_stop || (deadline >= 0 && now_usec() >= deadline)) return 0;
+    amb_yield_thread();
+  }
+  return 1;
+}
+
+int amb_flush(int timeout_ms)
+{
+  return amb_client_flush(amb_current_client(), timeout_ms);
+}
+
+void amb_client_close(amb_client_t* client)
+{
+  if (client->to_coord < 0) return;
+  if (!amb_client_flush(client, 10000)) {
+    // The network thread may be stuck in a send; leave it be.
+    fprintf(stderr, "WARNING: closing a client with %d bytes still unsent; not waiting for its network thread\n",
+            rring_used(client->ring) + rring_used(client->control));
+    client->network_stop = 1;
+    return;
+  }
+  if (client->network_started) {
+    client->network_stop = 1;
+#ifdef _WIN32
+    WaitForSingleObject((HANDLE)client->network_thread, INFINITE);
+    CloseHandle((HANDLE)client->network_thread);
+#else
+    pthread_join(client->network_thread, NULL);
+#endif
+    client->network_started = 0;
+  }
+  rring_free(client->ring);
+  rring_free(client->control);
+  free(client->spill);
+  client->spill = NULL;
+  client->spill_cap = 0;
+  free(client->inbuf);
+  client->inbuf = NULL;
+  client->inbuf_cap = client->inbuf_len = 0;
+#ifdef _WIN32
+  closesocket((SOCKET)client->to_coord);
+  closesocket((SOCKET)client->from_coord);
+#else
+  close(client->to_coord);
+  close(client->from_coord);
+#endif
+  client->to_coord = client->from_coord = -1;
+  if (client == &g_default_client) {
+    g_to_immortal_coord   = -1;
+    g_from_immortal_coord = -1;
+  }
+}
+
+void amb_initialize_client_runtime(int upport, int downport, int bufSz)
+{
+  amb_client_initialize(&g_default_client, upport, downport, bufSz);
 }
 
 void amb_shutdown_client_runtime()
 {
-  g_amb_client_terminating = 1;
+  amb_client_shutdown(amb_current_client());
 }
 
 
@@ -757,106 +1830,415 @@ void amb_shutdown_client_runtime()
 // ARGUMENT len: The length argument is an exact bound on the bytes
 // read by this function for this message, which is used in turn to
 // compute the byte size of the arguments at the tail of the payload.
-char* amb_handle_rpc(char* buf, int len) {
+static inline void count_dispatch(amb_client_t* client) {
+  client->recv_msgs++;
+  amb_hist_record(&client->dispatch_latency, amb_monotonic_ns() - client->record_arrival);
+}
+
+static char* handle_rpc(amb_client_t* client, char* buf, int len) {
   if (len < 0) {
     fprintf(stderr, "ERROR: amb_handle_rpc, received negative length!: %d", len);
-    abort();
+    amb_abort();
   }
   char* bufstart = buf;
-  char rpc_or_ret = *buf++;             // 1 Reserved byte.
+  char rpc_or_ret = *buf++;             // 1 byte, enum ReturnValueType
+  if (rpc_or_ret != NotReturnValue) {
+    // A reply to one of our own async/await calls:
+    int32_t senderLen;
+    int64_t callID;
+    buf = read_zigzag_int(buf, &senderLen); // Return address of the callee
+    buf += senderLen;
+    buf = read_zigzag_long(buf, &callID);   // 1-10 bytes
+    int retLen = len - (buf-bufstart);      // Everything left
+    if (retLen < 0) {
+      fprintf(stderr, "ERROR: amb_handle_rpc, read past the end of the buffer: start %p, len %d", buf, len);
+      amb_abort();
+    }
+    amb_continuation_t k;
+    void* closure;
+    if (! amb_continuations_take(&client->continuations, callID, &k, &closure)) {
+      fprintf(stderr, "ERROR: received return value for unknown call ID %lld\n", (long long)callID);
+      amb_abort();
+    }
+    amb_debug_log("  Return value (type %d) for call %lld, %d bytes...\n",
+                  rpc_or_ret, (long long)callID, retLen);
+    count_dispatch(client);
+    AMB_TRACE(AMB_TRACE_DISPATCH_BEGIN, client->record_seq, retLen, 0);
+    AMB_PROBE3(dispatch_start, -1, client->record_seq, retLen);
+    k(closure, callID, rpc_or_ret, buf, retLen);
+    AMB_PROBE2(dispatch_end, -1, client->record_seq);
+    AMB_TRACE(AMB_TRACE_DISPATCH_END, client->record_seq, retLen, 0);
+    return (buf+retLen);
+  }
+
   int32_t methodID;
   buf = read_zigzag_int(buf, &methodID);  // 1-5 bytes
-  char fire_forget = *buf++;            // 1 byte
+  char fire_forget = *buf++;            // 1 byte, enum RpcType
+  if (fire_forget == AsyncRPC) {
+    buf = read_zigzag_int(buf, &client->current_sender_len); // Return address
+    client->current_sender = buf;
+    buf += client->current_sender_len;
+    buf = read_zigzag_long(buf, &client->current_callID);
+  }
   int argsLen = len - (buf-bufstart);   // Everything left
   if (argsLen < 0) {
     fprintf(stderr, "ERROR: amb_handle_rpc, read past the end of the buffer: start %p, len %d", buf, len);
-    abort();
+    amb_abort();
   }
   amb_debug_log("  Dispatching method %d (rpc/ret %d, fireforget %d) with %d bytes of args...\n",
                 methodID, rpc_or_ret, fire_forget, argsLen);
-  amb_dispatch_method(methodID, buf, argsLen);
+  count_dispatch(client);
+  AMB_TRACE(AMB_TRACE_DISPATCH_BEGIN, client->record_seq, argsLen, methodID);
+  AMB_PROBE3(dispatch_start, methodID, client->record_seq, argsLen);
+  client->dispatch(client, methodID, buf, argsLen);
+  AMB_PROBE2(dispatch_end, methodID, client->record_seq);
+  AMB_TRACE(AMB_TRACE_DISPATCH_END, client->record_seq, argsLen, methodID);
+  client->current_sender = NULL;
+  client->current_sender_len = 0;
+  client->current_callID = 0;
   return (buf+argsLen);
 }
 
-void amb_normal_processing_loop()
+char* amb_handle_rpc(char* buf, int len) {
+  return handle_rpc(amb_current_client(), buf, len);
+}
+
+// Process every message in one log record's payload.
+static void process_log_record(amb_client_t* client, char* buf, int payloadsize)
 {
-  int upfd   = g_to_immortal_coord;
-  int downfd = g_from_immortal_coord;
+  // Read a stream of messages from the log record:
+  int rawsize = 0;
+  char* bufcur = buf;
+  char* limit = buf + payloadsize;
+  int ind = 0;
+  while (bufcur < limit) {
+    amb_debug_log(" Processing message %d in log record, starting at offset %d (%p), remaining bytes %d\n",
+                  ind++, (int)(bufcur-buf), bufcur, (int)(limit-bufcur));
+    bufcur = read_zigzag_int(bufcur, &rawsize);  // Size
+    char tag = *bufcur++;                      // Type
+    rawsize--; // Discount type byte.
+    switch(tag) {
+
+    case RPC:
+      amb_debug_log(" It's an incoming RPC.. size without len/tag bytes: %d\n", rawsize);
+      // print_hex_bytes(bufcur,rawsize);printf("\n");
+      bufcur = handle_rpc(client, bufcur, rawsize);
+      break;
+
+    case InitialMessage:
+      amb_debug_log(" Received InitialMessage back from server.  Processing..\n");
+      // FIXME: InitialMessage should be an arbitrary blob...
+      // but here we're following the convention that it's an actual message.
+      break;
+
+    case RPCBatch:
+      { int32_t numMsgs = -1;
+        bufcur = read_zigzag_int(bufcur, &numMsgs);
+        amb_debug_log(" Receiving RPC batch of %d messages.\n", numMsgs);
+        char* batchstart = bufcur;
+        for (int i=0; i < numMsgs; i++) {
+          amb_debug_log(" Reading off message %d/%d of batch, current offset %d, bytes left: %d.\n",
+                        i+1, numMsgs, (int)(bufcur-batchstart), rawsize);
+          char* lastbufcur = bufcur;
+          int32_t msgsize = -100;
+          bufcur = read_zigzag_int(bufcur, &msgsize);  // Size (unneeded)            
+          char type = *bufcur++;                     // Type - IGNORED
+          amb_debug_log(" --> Read message, type %d, payload size %d\n", type, msgsize-1);
+          bufcur = handle_rpc(client, bufcur, msgsize-1);
+          amb_debug_log(" --> handling that message read %d bytes off the batch\n", (int)(bufcur - lastbufcur));
+          rawsize -= (bufcur - lastbufcur);
+        }
+      }
+      break;
+
+    case TakeCheckpoint:
+      AMB_TRACE(AMB_TRACE_CHECKPOINT_BEGIN, client->record_seq, 0, 0);
+      AMB_PROBE1(checkpoint_begin, client->record_seq);
+      client->checkpoint(client, client->to_coord);
+      AMB_PROBE1(checkpoint_end, client->record_seq);
+      AMB_TRACE(AMB_TRACE_CHECKPOINT_END, client->record_seq, 0, 0);
+      break;
+    default:
+      fprintf(stderr, "ERROR: unexpected or unrecognized message type: %d", tag);
+      amb_abort();
+      break;
+    }
+  }
+}
+
+void amb_client_processing_loop(amb_client_t* client)
+{
+  amb_client_t* outer = t_current_client;
+  t_current_client = client;
+  amb_client_pin_processing_thread(client);
+  AMB_TRACE_THREAD("processing");
   
   amb_debug_log("\n        .... Normal processing underway ....\n");
   struct log_hdr hdr;
   memset((void*) &hdr, 0, AMBROSIA_HEADERSIZE);
 
+  // One record buffer, reused (and grown as needed) for every log
+  // record.  Handlers see pointers into it, valid until they return.
+  int bufcap = 64 * 1024;
+  char* buf = (char*)malloc(bufcap);
+
   int round = 0;
-  while (!g_amb_client_terminating) {
+  while (!client->terminating) {
     amb_debug_log("Normal processing (iter %d): receive next log header..\n", round++);
-    amb_recv_log_hdr(downfd, &hdr);
+    // While a writer is waiting for ring space, don't sleep in recv:
+    while (client->writable_armed) {
+      check_writable(client);
+      if (wait_socket(client->from_coord, 0, 1)) break;
+    }
+    amb_client_recv(client, &hdr, AMBROSIA_HEADERSIZE);
+    client->record_arrival = amb_monotonic_ns();
+    client->record_seq = hdr.seqID;
+    AMB_TRACE(AMB_TRACE_RECV_HDR, hdr.seqID, hdr.totalSize, 0);
+    AMB_PROBE2(log_header, hdr.seqID, hdr.totalSize);
+    amb_debug_log("Read log header: { commit %d, sz %d, checksum %lld, seqid %lld }\n",
+                  hdr.commitID, hdr.totalSize, (long long)hdr.checksum, (long long)hdr.seqID );
 
     int payloadsize = hdr.totalSize - AMBROSIA_HEADERSIZE;
-    char* buf = calloc(payloadsize, 1);
-    recv(downfd, buf, payloadsize, MSG_WAITALL);
-#ifdef AMBCLIENT_DEBUG  
-    amb_debug_log("Entire Message Payload (%d bytes): ", payloadsize);
-    print_hex_bytes(amb_dbg_fd,buf, payloadsize); fprintf(amb_dbg_fd,"\n");
-#endif
-
-    // Read a stream of messages from the log record:
-    int rawsize = 0;
-    char* bufcur = buf;
-    char* limit = buf + payloadsize;
-    int ind = 0;
-    while (bufcur < limit) {
-      amb_debug_log(" Processing message %d in log record, starting at offset %d (%p), remaining bytes %d\n",
-                    ind++, bufcur-buf, bufcur, limit-bufcur);
-      bufcur = read_zigzag_int(bufcur, &rawsize);  // Size
-      char tag = *bufcur++;                      // Type
-      rawsize--; // Discount type byte.
-      switch(tag) {
-
-      case RPC:
-        amb_debug_log(" It's an incoming RPC.. size without len/tag bytes: %d\n", rawsize);
-        // print_hex_bytes(bufcur,rawsize);printf("\n");
-        bufcur = amb_handle_rpc(bufcur, rawsize);
-        break;
-
-      case InitialMessage:
-        amb_debug_log(" Received InitialMessage back from server.  Processing..\n");
-        // FIXME: InitialMessage should be an arbitrary blob...
-        // but here we're following the convention that it's an actual message.
-        break;
-
-      case RPCBatch:
-        { int32_t numMsgs = -1;
-          bufcur = read_zigzag_int(bufcur, &numMsgs);
-          amb_debug_log(" Receiving RPC batch of %d messages.\n", numMsgs);
-          char* batchstart = bufcur;
-          for (int i=0; i < numMsgs; i++) {
-            amb_debug_log(" Reading off message %d/%d of batch, current offset %d, bytes left: %d.\n",
-                          i+1, numMsgs, bufcur-batchstart, rawsize);
-            char* lastbufcur = bufcur;
-            int32_t msgsize = -100;
-            bufcur = read_zigzag_int(bufcur, &msgsize);  // Size (unneeded)            
-            char type = *bufcur++;                     // Type - IGNORED
-            amb_debug_log(" --> Read message, type %d, payload size %d\n", type, msgsize-1);
-            bufcur = amb_handle_rpc(bufcur, msgsize-1);
-            amb_debug_log(" --> handling that message read %d bytes off the batch\n", (int)(bufcur - lastbufcur));
-            rawsize -= (bufcur - lastbufcur);
-          }
-        }
-        break;
-
-      case TakeCheckpoint:
-        send_dummy_checkpoint(upfd);
-        break;
-      default:
-        fprintf(stderr, "ERROR: unexpected or unrecognized message type: %d", tag);
-        abort();
-        break;
-      }
+    if (payloadsize > bufcap) {
+      while (bufcap < payloadsize) bufcap *= 2;
+      free(buf);
+      buf = (char*)malloc(bufcap);
     }
+    amb_client_recv(client, buf, payloadsize);
+    client->recv_records++;
+    client->recv_bytes += hdr.totalSize;
+    amb_debug_log("Entire Message Payload (%d bytes):\n", payloadsize);
+    amb_log_hex(AMB_LOG_DEBUG, "  ", buf, payloadsize);
+
+    AMB_TRACE(AMB_TRACE_RECORD_BEGIN, hdr.seqID, hdr.totalSize, 0);
+    process_log_record(client, buf, payloadsize);
+    AMB_TRACE(AMB_TRACE_RECORD_END, hdr.seqID, hdr.totalSize, 0);
+    check_writable(client);
   }
+  free(buf);
+  t_current_client = outer;
   amb_debug_log("Client signaled shutdown, normal_processing_loop exiting cleanly...\n");
+  amb_client_close(client);
   return;
 }
 
+void amb_normal_processing_loop()
+{
+  amb_client_processing_loop(resolve_client(NULL));
+}
+
+
+
+
+// Event-loop integration mode
+//------------------------------------------------------------------------------
+
+#ifdef _WIN32
+  #define AMB_WOULD_BLOCK(e) ((e) == WSAEWOULDBLOCK)
+#else
+  #define AMB_WOULD_BLOCK(e) ((e) == EAGAIN || (e) == EWOULDBLOCK)
+#endif
+
+// Wait until a socket is readable (for_write == 0) or writable.  A
+// zero timeout just tests readiness.
+//
+// RETURN: nonzero if the socket is ready.
+static int wait_socket(int fd, int for_write, int timeout_ms)
+{
+#ifdef _WIN32
+  WSAPOLLFD pfd;
+  pfd.fd = fd;
+  pfd.events = for_write ? POLLWRNORM : POLLRDNORM;
+  pfd.revents = 0;
+  return WSAPoll(&pfd, 1, timeout_ms) > 0;
+#else
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = for_write ? POLLOUT : POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, timeout_ms) > 0;
+#endif
+}
+
+// Send without blocking.
+//
+// RETURN: the number of bytes sent, 0 if the socket is full.
+static int try_send(int fd, const char* buf, int len)
+{
+#ifdef _WIN32
+  // Winsock has no per-call MSG_DONTWAIT; test for room first.
+  if (!wait_socket(fd, 1, 0)) return 0;
+  int n = send(fd, buf, len, 0);
+#else
+  int n = send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+  if (n < 0) {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+#else
+    int err = errno;
+#endif
+    if (AMB_WOULD_BLOCK(err)) return 0;
+    fprintf(stderr,"\nERROR: failed send (%d bytes) which left errno = %s\n",
+            len, amb_get_error_string());
+    amb_abort();
+  }
+  return n;
+}
+
+// Receive without blocking.
+//
+// RETURN: the number of bytes read, 0 if none are available, or -1 if
+// the coordinator closed the connection.
+static int try_recv(int fd, char* buf, int len)
+{
+#ifdef _WIN32
+  if (!wait_socket(fd, 0, 0)) return 0;
+  int n = recv(fd, buf, len, 0);
+#else
+  int n = recv(fd, buf, len, MSG_DONTWAIT);
+#endif
+  if (n == 0) return -1;
+  if (n < 0) {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+#else
+    int err = errno;
+#endif
+    if (AMB_WOULD_BLOCK(err)) return 0;
+    fprintf(stderr,"\nERROR: failed recv which left errno = %s\n", amb_get_error_string());
+    amb_abort();
+  }
+  return n;
+}
+
+// Block until everything in the ring has been sent.
+static void drain_ring(amb_client_t* client)
+{
+  while (poll_send(client))
+    wait_socket(client->to_coord, 1, -1);
+}
 
+void amb_client_initialize_polled(amb_client_t* client, int upport, int downport, int bufSz)
+{
+  connect_client(client, upport, downport, bufSz);
+  client->polled    = 1;
+  client->inbuf_cap = 64 * 1024;
+  client->inbuf     = (char*)malloc(client->inbuf_cap);
+  client->inbuf_len = 0;
+}
+
+int amb_client_recv_fd(amb_client_t* client) { return client->from_coord; }
+int amb_client_send_fd(amb_client_t* client) { return client->to_coord; }
+
+// amb_poll_send, minus the writable check (which may call back into
+// the application, so it is unsafe from inside a reservation).
+static int poll_send(amb_client_t* client)
+{
+  while (1) {
+    int numbytes = -1;
+    int64_t seq0 = 0;
+    struct spsc_rring* r = client->control; // The priority lane goes first,
+    char* ptr = NULL;                       // between whole messages.
+    if (!client->bulk_mid_message) ptr = rring_peek(r, &numbytes);
+    if (numbytes <= 0) {
+      r = client->ring;
+      seq0 = client->bulk_seq;
+      amb_full_fence();
+      ptr = rring_peek(r, &numbytes);
+      if (numbytes <= 0) note_bulk_peek(client, seq0, 0, 0);
+    }
+    if (numbytes <= 0) {
+      if (!client->bulk_mid_message && rring_used(client->control) > 0)
+        continue; // Back at a message boundary: the priority lane's turn.
+      trim_if_idle(client);
+      publish_stats_if_due(client);
+      return 0;
+    }
+    AMB_TRACE(AMB_TRACE_SEND_BEGIN, 0, numbytes, 0);
+    int sent = try_send(client->to_coord, ptr, numbytes);
+    AMB_TRACE(AMB_TRACE_SEND_END, 0, sent, 0);
+    AMB_PROBE1(send, sent);
+    if (sent == 0) return 1;
+    if (r == client->ring) {
+      ring_active(client);
+      note_bulk_peek(client, seq0, numbytes, sent);
+    }
+    amb_debug_log(" poll_send: sent slice of %d bytes (of %d)\n", sent, numbytes);
+    rring_pop(r, sent);
+    client->flush_stats.sends++;
+    client->flush_stats.bytes += sent;
+  }
+}
+
+int amb_poll_send(amb_client_t* client)
+{
+  int pending = poll_send(client);
+  check_writable(client);
+  return pending;
+}
+
+int amb_poll_recv(amb_client_t* client, int max_records)
+{
+  if (client->terminating) return -1;
+
+  // Pull in whatever the socket has, then handle complete records:
+  if (client->inbuf_len < client->inbuf_cap) {
+    int n = try_recv(client->from_coord, client->inbuf + client->inbuf_len,
+                     client->inbuf_cap - client->inbuf_len);
+    client->recv_calls++;
+    if (n < 0) return -1;
+    if (n > 0 && n < client->inbuf_cap - client->inbuf_len && get_profile(client)->tcp_quickack)
+      rearm_quickack(client);
+    client->inbuf_len += n;
+  }
+
+  amb_client_t* outer = t_current_client;
+  t_current_client = client;
+  int records = 0;
+  int consumed = 0;
+  client->record_arrival = amb_monotonic_ns(); // (At the latest.)
+  while (records < max_records && !client->terminating) {
+    int avail = client->inbuf_len - consumed;
+    if (avail < AMBROSIA_HEADERSIZE) break;
+    struct log_hdr hdr;
+    memcpy(&hdr, client->inbuf + consumed, AMBROSIA_HEADERSIZE);
+    if (hdr.totalSize < AMBROSIA_HEADERSIZE) {
+      fprintf(stderr,"\nERROR: corrupt log header, totalSize %d\n", hdr.totalSize);
+      amb_abort();
+    }
+    if (avail < hdr.totalSize) {
+      // Make sure the rest of this record will fit:
+      if (hdr.totalSize > client->inbuf_cap - consumed) {
+        memmove(client->inbuf, client->inbuf + consumed, avail);
+        client->inbuf_len = avail;
+        consumed = 0;
+        if (hdr.totalSize > client->inbuf_cap) {
+          while (client->inbuf_cap < hdr.totalSize) client->inbuf_cap *= 2;
+          client->inbuf = (char*)realloc(client->inbuf, client->inbuf_cap);
+        }
+      }
+      break;
+    }
+    amb_debug_log("poll_recv: log record of %d bytes, seqID %lld\n", hdr.totalSize, (long long)hdr.seqID);
+    client->record_seq = hdr.seqID;
+    AMB_TRACE(AMB_TRACE_RECV_HDR, hdr.seqID, hdr.totalSize, 0);
+    AMB_PROBE2(log_header, hdr.seqID, hdr.totalSize);
+    AMB_TRACE(AMB_TRACE_RECORD_BEGIN, hdr.seqID, hdr.totalSize, 0);
+    process_log_record(client, client->inbuf + consumed + AMBROSIA_HEADERSIZE,
+                       hdr.totalSize - AMBROSIA_HEADERSIZE);
+    AMB_TRACE(AMB_TRACE_RECORD_END, hdr.seqID, hdr.totalSize, 0);
+    client->recv_records++;
+    client->recv_bytes += hdr.totalSize;
+    consumed += hdr.totalSize;
+    records++;
+    check_writable(client);
+  }
+  t_current_client = outer;
+
+  if (consumed > 0) {
+    memmove(client->inbuf, client->inbuf + consumed, client->inbuf_len - consumed);
+    client->inbuf_len -= consumed;
+  }
+  return records;
+}
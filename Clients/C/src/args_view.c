@@ -0,0 +1,65 @@
+
+// See the corresponding header for function-level documentation.
+
+#include <stdint.h>
+#include "ambrosia/args_view.h"
+
+// Length of the varint starting at p, or -1 if it is longer than
+// maxlen bytes or runs past the limit.
+static int varint_length(const char* p, const char* limit, int maxlen) {
+  int n = 0;
+  while (p + n < limit && n < maxlen) {
+    if ((p[n++] & 0x80) == 0) return n;
+  }
+  return -1;
+}
+
+int amb_view_init(struct amb_args_view* view, const uint8_t* schema, int nfields,
+                  void* args, int argsLen) {
+  if (nfields < 0 || nfields > AMB_VIEW_MAX_FIELDS || argsLen < 0) return -1;
+  const char* base  = (const char*)args;
+  const char* cur   = base;
+  const char* limit = base + argsLen;
+  view->base    = base;
+  view->len     = argsLen;
+  view->nfields = nfields;
+  view->schema  = schema;
+
+  for (int i = 0; i < nfields; i++) {
+    view->offsets[i] = (int32_t)(cur - base);
+    int n;
+    switch (schema[i]) {
+    case AMB_FIELD_INT32:
+      if ((n = varint_length(cur, limit, 5)) < 0) return -1;
+      cur += n;
+      break;
+    case AMB_FIELD_INT64:
+      if ((n = varint_length(cur, limit, 10)) < 0) return -1;
+      cur += n;
+      break;
+    case AMB_FIELD_FIXED32:
+      if (limit - cur < 4) return -1;
+      cur += 4;
+      break;
+    case AMB_FIELD_FIXED64:
+      if (limit - cur < 8) return -1;
+      cur += 8;
+      break;
+    case AMB_FIELD_BYTES: {
+      int32_t len;
+      if ((n = varint_length(cur, limit, 5)) < 0) return -1;
+      read_zigzag_int((void*)cur, &len);
+      cur += n;
+      if (len < 0 || limit - cur < len) return -1;
+      cur += len;
+      break; }
+    case AMB_FIELD_REST:
+      if (i != nfields - 1) return -1;
+      cur = limit;
+      break;
+    default:
+      return -1;
+    }
+  }
+  return (cur == limit) ? 0 : -1;
+}
@@ -0,0 +1,91 @@
+
+// See the corresponding header for function-level documentation.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ambrosia/internal/continuations.h"
+
+#define AMB_DEFAULT_CONTINUATIONS 1024
+
+static void alloc_slots(struct amb_continuation_table* tbl, int64_t capacity)
+{
+  tbl->slots = (struct amb_continuation_slot*)calloc(capacity, sizeof(struct amb_continuation_slot));
+  if (tbl->slots == NULL) {
+    fprintf(stderr, "\nERROR: failed to allocate continuation table of %lld entries\n",
+            (long long)capacity);
+    amb_abort();
+  }
+  tbl->capacity = capacity;
+}
+
+void amb_continuations_init(struct amb_continuation_table* tbl, int64_t capacity)
+{
+  if (capacity <= 0) capacity = AMB_DEFAULT_CONTINUATIONS;
+  // Round up to a power of two:
+  int64_t cap = 1;
+  while (cap < capacity) cap <<= 1;
+  alloc_slots(tbl, cap);
+  tbl->next_callID = 1;
+  tbl->outstanding = 0;
+}
+
+void amb_continuations_free(struct amb_continuation_table* tbl)
+{
+  free(tbl->slots);
+  tbl->slots = NULL;
+  tbl->capacity = 0;
+  tbl->outstanding = 0;
+}
+
+// Double the table until every outstanding ID has its own slot.
+static void grow(struct amb_continuation_table* tbl)
+{
+  struct amb_continuation_slot* old = tbl->slots;
+  int64_t oldcap = tbl->capacity;
+  int64_t newcap = oldcap * 2;
+  while (1) {
+    alloc_slots(tbl, newcap);
+    int collided = 0;
+    for (int64_t i = 0; i < oldcap; i++) {
+      if (old[i].callID == 0) continue;
+      struct amb_continuation_slot* dst = &tbl->slots[old[i].callID & (newcap - 1)];
+      if (dst->callID != 0) { collided = 1; break; }
+      *dst = old[i];
+    }
+    if (!collided) break;
+    free(tbl->slots);
+    newcap *= 2;
+  }
+  free(old);
+}
+
+int64_t amb_continuations_register(struct amb_continuation_table* tbl,
+                                   amb_continuation_t callback, void* closure)
+{
+  int64_t id = tbl->next_callID++;
+  struct amb_continuation_slot* slot = &tbl->slots[id & (tbl->capacity - 1)];
+  while (slot->callID != 0) {
+    // An older call is still outstanding in our slot.
+    grow(tbl);
+    slot = &tbl->slots[id & (tbl->capacity - 1)];
+  }
+  slot->callback = callback;
+  slot->closure  = closure;
+  slot->callID   = id;
+  tbl->outstanding++;
+  return id;
+}
+
+int amb_continuations_take(struct amb_continuation_table* tbl, int64_t callID,
+                           amb_continuation_t* callback, void** closure)
+{
+  if (callID <= 0 || tbl->slots == NULL) return 0; // Nothing was ever registered.
+  struct amb_continuation_slot* slot = &tbl->slots[callID & (tbl->capacity - 1)];
+  if (slot->callID != callID) return 0;
+  *callback = slot->callback;
+  *closure  = slot->closure;
+  slot->callID = 0; // Free the slot for reuse.
+  tbl->outstanding--;
+  return 1;
+}
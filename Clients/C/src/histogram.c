@@ -0,0 +1,43 @@
+
+// See the corresponding header for function-level documentation.
+
+#include <string.h>
+#include "ambrosia/histogram.h"
+
+void amb_hist_reset(struct amb_histogram* h) {
+  memset(h, 0, sizeof(*h));
+}
+
+void amb_hist_merge(struct amb_histogram* dst, const struct amb_histogram* src) {
+  if (src->count == 0) return;
+  for (int i = 0; i < AMB_HIST_BUCKETS; i++)
+    dst->counts[i] += src->counts[i];
+  if (dst->count == 0 || src->min < dst->min) dst->min = src->min;
+  if (src->max > dst->max) dst->max = src->max;
+  dst->count += src->count;
+  dst->sum   += src->sum;
+}
+
+// The largest value that lands in bucket i.
+static int64_t bucket_upper(int i) {
+  if (i < AMB_HIST_SUB_COUNT) return i;
+  int shift = (i - AMB_HIST_SUB_COUNT) / AMB_HIST_HALF + 1;
+  int64_t top = AMB_HIST_HALF + (i - AMB_HIST_SUB_COUNT) % AMB_HIST_HALF;
+  return ((top + 1) << shift) - 1;
+}
+
+int64_t amb_hist_percentile(const struct amb_histogram* h, double percentile) {
+  if (h->count == 0) return 0;
+  if (percentile >= 100.0) return h->max;
+  int64_t rank = (int64_t)(percentile / 100.0 * (double)h->count + 0.5);
+  if (rank < 1) rank = 1;
+  int64_t seen = 0;
+  for (int i = 0; i < AMB_HIST_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      int64_t v = bucket_upper(i);
+      return v > h->max ? h->max : v; // Don't report past what we saw.
+    }
+  }
+  return h->max;
+}
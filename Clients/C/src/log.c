@@ -0,0 +1,607 @@
+
+// See the corresponding header for function-level documentation.
+
+#ifndef _WIN32
+  #define _GNU_SOURCE // syscall
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+#include "ambrosia/log.h"
+#include "ambrosia/internal/platform.h"
+
+#ifndef _WIN32
+  #include <pthread.h>
+#endif
+
+#ifdef AMBCLIENT_DEBUG
+volatile int amb_log_level = AMB_LOG_DEBUG;
+#else
+volatile int amb_log_level = AMB_LOG_WARN;
+#endif
+
+// Limits on what one message captures:
+#define MAX_ARG_BYTES 1024 // Argument values and string bytes.
+#define MAX_STRING    256  // Bytes of any one %s argument.
+#define MAX_HEX       256  // Bytes of a hex dump.
+#define MAX_LINE      4096 // Characters of formatted output.
+
+enum { RECORD_PAD = 0, RECORD_PRINTF, RECORD_HEX };
+
+// The fixed part of a buffered message.  The captured arguments follow
+// it, each in 8-byte slots: integers as 64 bits, floating point as
+// doubles, and strings as a 32-bit length followed by their bytes.
+// Records are a multiple of 8 bytes and never wrap around the end of
+// the buffer; a RECORD_PAD record fills the gap instead.
+struct log_record {
+  uint32_t size;
+  uint16_t kind;
+  uint16_t level;
+  int64_t  ns;
+  const char* format; // Or the label of a hex dump.
+};
+
+// One thread's messages on their way to the writer.  A single-producer,
+// single-consumer byte ring: the owning thread advances head, the
+// writer advances tail.
+struct log_buffer {
+  struct log_buffer* next;    // All buffers, newest first.
+  int64_t  tid;
+  char*    data;
+  uint64_t mask;
+  volatile uint64_t head;
+  volatile uint64_t tail;
+  volatile int64_t dropped;   // Written by the owning thread...
+  int64_t  reported;          // ... and how many of those the writer has reported.
+  uint64_t limit;             // The writer's snapshot of head.
+  volatile int retired;       // Its thread has exited: free to take over once drained.
+};
+
+static struct log_buffer* volatile g_buffers = NULL;
+static int      g_capacity = 256 * 1024;
+static FILE*    g_out = NULL;
+static int64_t  g_ns0 = 0;
+static volatile int g_writer_started = 0;
+static volatile int64_t g_flush_requested = 0;
+static volatile int64_t g_flush_done = 0;
+
+static AMB_THREAD_LOCAL struct log_buffer* t_buffer = NULL;
+static AMB_THREAD_LOCAL int t_is_writer = 0;   // Never wait for ourselves.
+
+static const char g_level_tags[] = "-EWIDT";
+
+
+// Helpers
+// ------------------------------------------------------------
+
+static void sleep_briefly()
+{
+#ifdef _WIN32
+  Sleep(1);
+#else
+  const struct timespec ts = { 0, 1000000 };
+  nanosleep(&ts, NULL);
+#endif
+}
+
+// One parsed conversion specification, "%[flags][width][.precision][length]conv".
+struct spec {
+  char flags[8];
+  int  width, width_star;   // width < 0: none.
+  int  prec, prec_star;     // prec < 0: none.
+  char length;              // 'H' hh, 'h', 'l', 'q' ll, 'z', 'j', 't', 'L', or 0.
+  char conv;
+};
+
+// Parse the specification after a '%'.  RETURN: the character after
+// it, or NULL if it is malformed.
+static const char* parse_spec(const char* p, struct spec* s)
+{
+  int n = 0;
+  while (*p && strchr("-+ #0", *p)) {
+    if (n < (int)sizeof(s->flags) - 1) s->flags[n++] = *p;
+    p++;
+  }
+  s->flags[n] = 0;
+  s->width = -1; s->width_star = 0;
+  if (*p == '*') { s->width_star = 1; p++; }
+  else if (*p >= '0' && *p <= '9') s->width = (int)strtol(p, (char**)&p, 10);
+  s->prec = -1; s->prec_star = 0;
+  if (*p == '.') {
+    p++;
+    if (*p == '*') { s->prec_star = 1; p++; }
+    else s->prec = (int)strtol(p, (char**)&p, 10); // "%.f": precision 0.
+  }
+  s->length = 0;
+  switch (*p) {
+  case 'h': p++; if (*p == 'h') { s->length = 'H'; p++; } else s->length = 'h'; break;
+  case 'l': p++; if (*p == 'l') { s->length = 'q'; p++; } else s->length = 'l'; break;
+  case 'q': case 'z': case 'j': case 't': case 'L': s->length = *p++; break;
+  }
+  if (*p == 0 || !strchr("diouxXcsfFeEgGaApn", *p)) return NULL;
+  s->conv = *p++;
+  return p;
+}
+
+static int is_signed_conv(char c)   { return c == 'd' || c == 'i'; }
+static int is_unsigned_conv(char c) { return c == 'o' || c == 'u' || c == 'x' || c == 'X'; }
+static int is_float_conv(char c)    { return strchr("fFeEgGaA", c) != NULL; }
+
+
+// Producer side
+// ------------------------------------------------------------
+
+static void start_writer();
+
+// Buffers outlive their threads, since the writer may still be
+// draining them, so a thread's exit only retires its buffer.  A new
+// thread takes over a retired buffer rather than allocating another,
+// which keeps both the memory and the writer's walk bounded by the
+// most threads ever logging at once.
+#ifdef _WIN32
+static DWORD g_exit_key;
+static INIT_ONCE g_exit_key_once = INIT_ONCE_STATIC_INIT;
+
+static VOID WINAPI retire_buffer(PVOID arg)
+#else
+static pthread_key_t g_exit_key;
+static pthread_once_t g_exit_key_once = PTHREAD_ONCE_INIT;
+
+static void retire_buffer(void* arg)
+#endif
+{
+  struct log_buffer* b = (struct log_buffer*)arg;
+  if (b == NULL) return;
+  t_buffer = NULL; // Logging from a later destructor picks up a buffer afresh.
+  amb_full_fence(); // After our last record.
+  b->retired = 1;
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK create_exit_key(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+  (void)once; (void)param; (void)context;
+  g_exit_key = FlsAlloc(retire_buffer);
+  return g_exit_key != FLS_OUT_OF_INDEXES;
+}
+#else
+static void create_exit_key()
+{
+  if (pthread_key_create(&g_exit_key, retire_buffer) != 0) {
+    fprintf(stderr, "ERROR: failed to create the log buffer key\n");
+    abort();
+  }
+}
+#endif
+
+// Take over a retired buffer once the writer has drained it (and
+// reported its drops, which are counted against the old thread).
+static struct log_buffer* reuse_buffer()
+{
+  for (struct log_buffer* b = g_buffers; b != NULL; b = b->next) {
+    if (!b->retired) continue;
+    amb_full_fence(); // Read the old thread's last head after its retirement.
+    if (b->tail != b->head || b->reported != b->dropped) continue;
+#ifdef _WIN32
+    if (InterlockedCompareExchange((LONG volatile*)&b->retired, 0, 1) == 1) return b;
+#else
+    if (__sync_bool_compare_and_swap(&b->retired, 1, 0)) return b;
+#endif
+  }
+  return NULL;
+}
+
+// Give the calling thread a buffer: a retired one, or else a new one
+// published with a lock-free push.
+static struct log_buffer* new_buffer_for_thread()
+{
+  struct log_buffer* b = reuse_buffer();
+  if (b == NULL) {
+    b = (struct log_buffer*)calloc(1, sizeof(*b));
+    b->data = (char*)malloc(g_capacity);
+    if (b->data == NULL) {
+      fprintf(stderr, "ERROR: could not allocate a %d byte log buffer\n", g_capacity);
+      abort();
+    }
+    b->mask = g_capacity - 1;
+    b->tid  = amb_thread_id();
+    if (g_ns0 == 0) g_ns0 = amb_monotonic_ns();
+    amb_push_node((void* volatile*)&g_buffers, b, (void**)&b->next);
+  } else {
+    b->tid = amb_thread_id();
+  }
+#ifdef _WIN32
+  if (InitOnceExecuteOnce(&g_exit_key_once, create_exit_key, NULL, NULL))
+    FlsSetValue(g_exit_key, b);
+#else
+  pthread_once(&g_exit_key_once, create_exit_key);
+  pthread_setspecific(g_exit_key, b);
+#endif
+  t_buffer = b;
+  return b;
+}
+
+// Copy a record (header plus len bytes of arguments) into the calling
+// thread's buffer, or count it as dropped.
+static void publish(int kind, int level, const char* format, const char* args, int len)
+{
+  struct log_buffer* b = t_buffer;
+  if (b == NULL) b = new_buffer_for_thread();
+  if (!g_writer_started) start_writer();
+
+  uint64_t size = (sizeof(struct log_record) + len + 7) & ~(uint64_t)7;
+  uint64_t head = b->head;
+  uint64_t pos  = head & b->mask;
+  uint64_t gap  = pos + size > b->mask + 1 ? b->mask + 1 - pos : 0; // Padding to the end.
+  if (head + gap + size - b->tail > b->mask + 1) {
+    b->dropped++;
+    return;
+  }
+  if (gap > 0) {
+    struct log_record* pad = (struct log_record*)(b->data + pos);
+    pad->size = (uint32_t)gap;
+    pad->kind = RECORD_PAD;
+    pos = 0;
+  }
+  struct log_record* rec = (struct log_record*)(b->data + pos);
+  rec->size   = (uint32_t)size;
+  rec->kind   = (uint16_t)kind;
+  rec->level  = (uint16_t)level;
+  rec->ns     = amb_monotonic_ns();
+  rec->format = format;
+  memcpy(rec + 1, args, len);
+  amb_full_fence(); // The record is complete before the writer can see it.
+  b->head = head + gap + size;
+}
+
+// Append one 8-byte slot to the argument buffer.  RETURN: 0 if it is full.
+static inline int put_slot(char* args, int* len, const void* val)
+{
+  if (*len + 8 > MAX_ARG_BYTES) return 0;
+  memcpy(args + *len, val, 8);
+  *len += 8;
+  return 1;
+}
+
+void amb_log_write(int level, const char* format, ...)
+{
+  char args[MAX_ARG_BYTES];
+  int len = 0;
+  va_list ap;
+  va_start(ap, format);
+  // Capture each argument by the type its conversion expects:
+  const char* p = format;
+  int full = 0;
+  while (!full && (p = strchr(p, '%')) != NULL) {
+    if (p[1] == '%') { p += 2; continue; }
+    struct spec s;
+    p = parse_spec(p + 1, &s);
+    if (p == NULL) break; // The writer stops at the same place.
+    int64_t v;
+    if (s.width_star) { v = va_arg(ap, int); full |= !put_slot(args, &len, &v); }
+    if (s.prec_star)  { v = va_arg(ap, int); full |= !put_slot(args, &len, &v); if (v >= 0) s.prec = (int)v; }
+    if (full) break;
+    if (is_signed_conv(s.conv)) {
+      switch (s.length) {
+      case 'H': v = (signed char)va_arg(ap, int); break;
+      case 'h': v = (short)va_arg(ap, int); break;
+      case 'l': v = va_arg(ap, long); break;
+      case 'q': v = va_arg(ap, long long); break;
+      case 'z': v = (int64_t)va_arg(ap, size_t); break;
+      case 'j': v = (int64_t)va_arg(ap, intmax_t); break;
+      case 't': v = (int64_t)va_arg(ap, ptrdiff_t); break;
+      default:  v = va_arg(ap, int);
+      }
+      full = !put_slot(args, &len, &v);
+    } else if (is_unsigned_conv(s.conv)) {
+      uint64_t u;
+      switch (s.length) {
+      case 'H': u = (unsigned char)va_arg(ap, unsigned int); break;
+      case 'h': u = (unsigned short)va_arg(ap, unsigned int); break;
+      case 'l': u = va_arg(ap, unsigned long); break;
+      case 'q': u = va_arg(ap, unsigned long long); break;
+      case 'z': u = va_arg(ap, size_t); break;
+      case 'j': u = (uint64_t)va_arg(ap, uintmax_t); break;
+      case 't': u = (uint64_t)va_arg(ap, ptrdiff_t); break;
+      default:  u = va_arg(ap, unsigned int);
+      }
+      full = !put_slot(args, &len, &u);
+    } else if (is_float_conv(s.conv)) {
+      double d = s.length == 'L' ? (double)va_arg(ap, long double) : va_arg(ap, double);
+      full = !put_slot(args, &len, &d);
+    } else if (s.conv == 'c') {
+      v = va_arg(ap, int);
+      full = !put_slot(args, &len, &v);
+    } else if (s.conv == 'p') {
+      void* ptr = va_arg(ap, void*);
+      full = !put_slot(args, &len, &ptr);
+    } else if (s.conv == 'n') {
+      (void)va_arg(ap, int*);
+    } else { // 's'
+      const char* str = va_arg(ap, const char*);
+      if (str == NULL) str = "(null)";
+      int32_t n = 0;
+      int cap = s.prec >= 0 && s.prec < MAX_STRING ? s.prec : MAX_STRING;
+      while (n < cap && str[n] != 0) n++;
+      if (len + 8 + n > MAX_ARG_BYTES) n = MAX_ARG_BYTES - len - 8;
+      if (n < 0) break;
+      memcpy(args + len, &n, sizeof(n));
+      memcpy(args + len + sizeof(n), str, n);
+      len += (sizeof(n) + n + 7) & ~7;
+    }
+  }
+  va_end(ap);
+  publish(RECORD_PRINTF, level, format, args, len);
+}
+
+void amb_log_write_hex(int level, const char* label, const void* buf, int len)
+{
+  char args[8 + MAX_HEX];
+  int32_t n = len < MAX_HEX ? len : MAX_HEX;
+  int32_t total = len;
+  memcpy(args, &total, 4);
+  memcpy(args + 4, &n, 4);
+  memcpy(args + 8, buf, n);
+  publish(RECORD_HEX, level, label, args, 8 + n);
+}
+
+
+// The writer
+// ------------------------------------------------------------
+
+// Format a printf record's captured arguments into out (of MAX_LINE chars).
+static int format_printf(const struct log_record* rec, char* out)
+{
+  const char* args = (const char*)(rec + 1);
+  int avail = (int)(rec->size - sizeof(*rec));
+  int used = 0, n = 0;
+  const char* p = rec->format;
+#define OUT_LEFT (n < MAX_LINE ? MAX_LINE - n : 0)
+#define NEXT_SLOT(var) do { if (used + 8 > avail) goto truncated; memcpy(&(var), args + used, 8); used += 8; } while (0)
+  while (*p && n < MAX_LINE - 1) {
+    if (*p != '%') { out[n++] = *p++; continue; }
+    if (p[1] == '%') { out[n++] = '%'; p += 2; continue; }
+    struct spec s;
+    const char* next = parse_spec(p + 1, &s);
+    if (next == NULL) break;
+    p = next;
+    int64_t w;
+    if (s.width_star) { NEXT_SLOT(w); s.width = (int)w; if (w < 0) { strcat(s.flags, "-"); s.width = (int)-w; } }
+    if (s.prec_star)  { NEXT_SLOT(w); s.prec = (int)w; }
+    // Rebuild the specification with 64-bit integer lengths:
+    char fmt[32];
+    int f = snprintf(fmt, sizeof(fmt), "%%%s", s.flags);
+    if (s.width >= 0) f += snprintf(fmt + f, sizeof(fmt) - f, "%d", s.width);
+    if (s.conv == 's') {
+      int32_t len;
+      if (used + 4 > avail) goto truncated;
+      memcpy(&len, args + used, 4);
+      snprintf(fmt + f, sizeof(fmt) - f, ".*s");
+      n += snprintf(out + n, OUT_LEFT, fmt, (int)len, args + used + 4);
+      used += (4 + len + 7) & ~7;
+      continue;
+    }
+    if (s.prec >= 0) f += snprintf(fmt + f, sizeof(fmt) - f, ".%d", s.prec);
+    if (s.conv == 'n') continue;
+    if (is_signed_conv(s.conv) || is_unsigned_conv(s.conv)) {
+      int64_t v;
+      NEXT_SLOT(v);
+      snprintf(fmt + f, sizeof(fmt) - f, "ll%c", s.conv);
+      n += snprintf(out + n, OUT_LEFT, fmt, (long long)v);
+    } else if (is_float_conv(s.conv)) {
+      double d;
+      NEXT_SLOT(d);
+      snprintf(fmt + f, sizeof(fmt) - f, "%c", s.conv);
+      n += snprintf(out + n, OUT_LEFT, fmt, d);
+    } else if (s.conv == 'c') {
+      int64_t v;
+      NEXT_SLOT(v);
+      snprintf(fmt + f, sizeof(fmt) - f, "c");
+      n += snprintf(out + n, OUT_LEFT, fmt, (int)v);
+    } else { // 'p'
+      void* ptr;
+      NEXT_SLOT(ptr);
+      snprintf(fmt + f, sizeof(fmt) - f, "p");
+      n += snprintf(out + n, OUT_LEFT, fmt, ptr);
+    }
+  }
+  return n < MAX_LINE ? n : MAX_LINE - 1;
+truncated:
+  n += snprintf(out + n, OUT_LEFT, "...");
+  return n < MAX_LINE ? n : MAX_LINE - 1;
+#undef NEXT_SLOT
+#undef OUT_LEFT
+}
+
+// In the style of print_hex_bytes.
+static int format_hex(const struct log_record* rec, char* out)
+{
+  const char* args = (const char*)(rec + 1);
+  int32_t total, len;
+  memcpy(&total, args, 4);
+  memcpy(&len, args + 4, 4);
+  int n = snprintf(out, MAX_LINE, "%s0x", rec->format ? rec->format : "");
+  for (int j = 0; j < len && n < MAX_LINE - 8; j++)
+    n += snprintf(out + n, MAX_LINE - n, j % 2 == 1 ? "%02x " : "%02x", (unsigned char)args[8 + j]);
+  if (len < total && n < MAX_LINE - 4) n += snprintf(out + n, MAX_LINE - n, "...");
+  return n < MAX_LINE ? n : MAX_LINE - 1;
+}
+
+static void write_record(const struct log_buffer* b, const struct log_record* rec)
+{
+  static char line[MAX_LINE + 64];
+  int n = snprintf(line, 64, " [AMBCLIENT %.6lf %c %lld] ", (rec->ns - g_ns0) / 1e9,
+                   g_level_tags[rec->level <= AMB_LOG_TRACE ? rec->level : 0], (long long)b->tid);
+  n += rec->kind == RECORD_HEX ? format_hex(rec, line + n) : format_printf(rec, line + n);
+  if (line[n - 1] != '\n') line[n++] = '\n';
+  fwrite(line, 1, n, g_out);
+}
+
+static inline struct log_record* peek(struct log_buffer* b)
+{
+  while (b->tail != b->limit) {
+    struct log_record* rec = (struct log_record*)(b->data + (b->tail & b->mask));
+    if (rec->kind != RECORD_PAD) return rec;
+    b->tail += rec->size;
+  }
+  return NULL;
+}
+
+// Write out everything published before the call, merging the threads'
+// messages by time.  RETURN: whether there was anything.
+static int write_pending()
+{
+  int any = 0;
+  for (struct log_buffer* b = g_buffers; b != NULL; b = b->next)
+    b->limit = b->head;
+  amb_full_fence();
+  while (1) {
+    struct log_buffer* best = NULL;
+    struct log_record* best_rec = NULL;
+    for (struct log_buffer* b = g_buffers; b != NULL; b = b->next) {
+      struct log_record* rec = peek(b);
+      if (rec != NULL && (best == NULL || rec->ns < best_rec->ns)) {
+        best = b;
+        best_rec = rec;
+      }
+    }
+    if (best == NULL) break;
+    write_record(best, best_rec);
+    amb_full_fence(); // Done reading before the producer may reuse the space.
+    best->tail += best_rec->size;
+    any = 1;
+  }
+  for (struct log_buffer* b = g_buffers; b != NULL; b = b->next) {
+    int64_t dropped = b->dropped;
+    if (dropped != b->reported) {
+      fprintf(g_out, " [AMBCLIENT] WARNING: %lld log messages dropped on thread %lld (buffer full)\n",
+              (long long)(dropped - b->reported), (long long)b->tid);
+      b->reported = dropped;
+    }
+  }
+  return any;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI writer_thread(LPVOID arg)
+#else
+static void* writer_thread(void* arg)
+#endif
+{
+  (void)arg;
+  t_is_writer = 1;
+  while (1) {
+    int64_t requested = g_flush_requested;
+    amb_full_fence();
+    int any = write_pending();
+    if (requested != g_flush_done || !any) {
+      fflush(g_out);
+      g_flush_done = requested;
+    }
+    if (!any) sleep_briefly();
+  }
+  return 0;
+}
+
+static void start_writer()
+{
+#ifdef _WIN32
+  if (InterlockedCompareExchange((LONG volatile*)&g_writer_started, 1, 0) != 0) return;
+#else
+  if (!__sync_bool_compare_and_swap(&g_writer_started, 0, 1)) return;
+#endif
+  if (g_out == NULL) g_out = stderr;
+#ifdef _WIN32
+  HANDLE th = CreateThread(NULL, 0, writer_thread, NULL, 0, NULL);
+  if (th == NULL) {
+    fprintf(stderr, "ERROR: failed to create the log writer thread\n");
+    abort();
+  }
+  CloseHandle(th);
+#else
+  pthread_t th;
+  if (pthread_create(&th, NULL, writer_thread, NULL) != 0) {
+    fprintf(stderr, "ERROR: failed to create the log writer thread\n");
+    abort();
+  }
+  pthread_detach(th);
+#endif
+  atexit(amb_log_flush);
+}
+
+
+// Control
+// ------------------------------------------------------------
+
+void amb_log_set_level(int level)
+{
+  amb_log_level = level < AMB_LOG_OFF ? AMB_LOG_OFF : level > AMB_LOG_TRACE ? AMB_LOG_TRACE : level;
+}
+
+void amb_log_flush()
+{
+  if (!g_writer_started) return;
+#ifdef _WIN32
+  int64_t want = InterlockedIncrement64(&g_flush_requested);
+#else
+  int64_t want = __sync_add_and_fetch(&g_flush_requested, 1);
+#endif
+  while (g_flush_done < want) sleep_briefly();
+}
+
+void amb_abort()
+{
+  if (g_writer_started && !t_is_writer) {
+#ifdef _WIN32
+    int64_t want = InterlockedIncrement64(&g_flush_requested);
+#else
+    int64_t want = __sync_add_and_fetch(&g_flush_requested, 1);
+#endif
+    // Bounded: the writer may itself be stuck on the failing output.
+    int64_t deadline = amb_monotonic_ns() + 1000000000;
+    while (g_flush_done < want && amb_monotonic_ns() < deadline) sleep_briefly();
+  }
+  abort();
+}
+
+int64_t amb_log_dropped()
+{
+  int64_t total = 0;
+  for (struct log_buffer* b = g_buffers; b != NULL; b = b->next) total += b->dropped;
+  return total;
+}
+
+void amb_log_init_from_env()
+{
+  static int done = 0;
+  if (done) return;
+  done = 1;
+  static const char* names[] = { "off", "error", "warn", "info", "debug", "trace" };
+  char* v = getenv("AMBROSIA_LOG");
+  if (v != NULL && *v != 0) {
+    int level = -1;
+    for (int i = 0; i <= AMB_LOG_TRACE; i++)
+      if (strcmp(v, names[i]) == 0) level = i;
+    if (level < 0 && v[0] >= '0' && v[0] <= '9') level = atoi(v);
+    if (level < 0)
+      fprintf(stderr, "WARNING: ignoring AMBROSIA_LOG=%s (expected off, error, warn, info, debug or trace)\n", v);
+    else amb_log_set_level(level);
+  }
+  v = getenv("AMBROSIA_LOG_BUFFER");
+  if (v != NULL && atoi(v) > 0 && g_buffers == NULL) {
+    g_capacity = 4096;
+    while (g_capacity < atoi(v)) g_capacity *= 2;
+  }
+  v = getenv("AMBROSIA_LOG_FILE");
+  if (v != NULL && *v != 0 && !g_writer_started) {
+    g_out = fopen(v, "a");
+    if (g_out == NULL) {
+      fprintf(stderr, "ERROR: could not open log file %s\n", v);
+      abort();
+    }
+  }
+}
@@ -5,50 +5,31 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "ambrosia/internal/spsc_rring.h"
+#include "ambrosia/internal/platform.h"
+#include "ambrosia/histogram.h"
+#include "ambrosia/log.h"
+#include "ambrosia/internal/probes.h"
+#include "ambrosia/trace.h"
 
 #if _WIN32
+  #include <windows.h>
 #else
   #include <sched.h> // sched_yield
+  #include <sys/mman.h>
+  #include <time.h>
 #endif
 
-// ----------------------------------------------------------------------------
-// FIXME: replace globals with a proper API for dynamically allocating buffers:
-// ----------------------------------------------------------------------------
-
-// TODO: FACTOR THESE INTO A STRUCT TO ALLOW MORE THAN ONE INSTANCE:
-
-// Single-producer Single-consumer concurrent ring buffer:
-char* g_buffer = NULL;
-volatile int g_buffer_head = 0; // Byte offset into buffer, written by consumer.
-volatile int g_buffer_tail = 0; // Byte offset into buffer, written by producer.
-// volatile int g_buffer_msgs = 0; // Count of complete "messages" in g_buffer
-volatile int g_buffer_end = -1; // The current capacity, MODIFIED dynamically by PRODUCER.
-
-int orig_buffer_end = -1; // Snapshot of the original buffer capacity.
-
-int g_buffer_last_reserved = -1; // The number of bytes in the last reserve call (producer-private)
+// The ring used by the legacy single-buffer API (new_buffer, reserve_buffer, ...).
+struct spsc_rring g_rring = { .end = -1, .orig_end = -1, .last_reserved = -1 };
 
 
 // Debugging
 //--------------------------------------------------------------------------------
 
-// Fine-grained debugging.  Turned off statically to avoid overhead.
+// Fine-grained debugging, at AMB_LOG_TRACE.  Turned off statically to avoid overhead.
 #ifdef SPSC_RRING_DEBUG
-volatile int64_t spsc_debug_lock = 0;
-void spsc_rring_debug_log(const char *format, ...)
-{
-    va_list args;
-    va_start(args, format);
-    sleep_seconds((double)(rand()%1000) * 0.00001); // .01 - 10 ms
-    while ( 1 == InterlockedCompareExchange64(&spsc_debug_lock, 1, 0) ) { }
-    fprintf(dbg_fd," [AMBCLIENT] ");
-    vfprintf(dbg_fd,format, args);
-    fflush(dbg_fd);
-    spsc_debug_lock = 0;
-    va_end(args);
-}
+#define spsc_rring_debug_log(...) amb_log(AMB_LOG_TRACE, __VA_ARGS__)
 #else
-// inline void spsc_rring_debug_log(const char *format, ...) { }
 #define spsc_rring_debug_log(...) {}
 #endif
 
@@ -56,62 +37,175 @@ void spsc_rring_debug_log(const char *format, ...)
 // Buffer life cycle
 // ------------------------------------------------------------
 
-void new_buffer(int sz)
+void rring_init(struct spsc_rring* r, int sz)
+{
+  if (r->buffer != NULL) {
+    fprintf(stderr, "ERROR: tried to initialize a ring buffer a second time\n");
+    amb_abort();
+  }
+  r->buffer = malloc(sz);
+  r->head = 0;
+  r->tail = 0;
+  r->orig_end = sz;  // Need room for the largest message.
+  r->end = sz;
+  r->last_reserved = -1;
+  spsc_rring_debug_log("Initialized ring buffer, address %p\n", r->buffer);
+}
+
+// Explicit huge pages are assumed to be 2 MiB; mappings are rounded up to them.
+#define RRING_HUGE_PAGE (2*1024*1024)
+
+void rring_init_elastic(struct spsc_rring* r, int initial, int max, int flags)
+{
+  if (r->buffer != NULL) {
+    fprintf(stderr, "ERROR: tried to initialize a ring buffer a second time\n");
+    amb_abort();
+  }
+  if (initial > max) initial = max;
+#ifdef _WIN32
+  // Reserve the address space; commit pages as the capacity grows.
+  r->buffer = VirtualAlloc(NULL, max, MEM_RESERVE, PAGE_READWRITE);
+  if (r->buffer != NULL && VirtualAlloc(r->buffer, initial, MEM_COMMIT, PAGE_READWRITE) == NULL)
+    r->buffer = NULL;
+#else
+  // Untouched pages of a MAP_NORESERVE mapping cost nothing.
+  void* mem = MAP_FAILED;
+  #ifdef MAP_HUGETLB
+  if (flags & RRING_HUGETLB) {
+    // No MAP_NORESERVE here: reserve the huge pages now, so that a short
+    // pool fails this call rather than faulting (SIGBUS) later.
+    max = (max + RRING_HUGE_PAGE - 1) & ~(RRING_HUGE_PAGE - 1);
+    mem = mmap(NULL, max, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+  }
+  #endif
+  if (mem == MAP_FAILED)
+    mem = mmap(NULL, max, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  #ifdef MADV_HUGEPAGE
+  if (mem != MAP_FAILED && (flags & RRING_THP))
+    madvise(mem, max, MADV_HUGEPAGE);
+  #endif
+  r->buffer = (mem == MAP_FAILED) ? NULL : (char*)mem;
+#endif
+  if (r->buffer == NULL) {
+    fprintf(stderr, "ERROR: could not reserve %d bytes for a ring buffer\n", max);
+    amb_abort();
+  }
+  r->head = 0;
+  r->tail = 0;
+  r->orig_end = initial;
+  r->end = initial;
+  r->last_reserved = -1;
+  r->elastic = 1;
+  r->initial_end = initial;
+  r->max_end = max;
+  r->reserving = 0;
+  r->trimming = 0;
+  spsc_rring_debug_log("Initialized elastic ring buffer, address %p, %d of %d bytes\n",
+                       r->buffer, initial, max);
+}
+
+int rring_max_capacity(struct spsc_rring* r)
+{
+  return r->elastic ? r->max_end : r->orig_end;
+}
+
+int rring_trim(struct spsc_rring* r)
+{
+  if (!r->elastic) return 0;
+  // Dekker-style handshake with rring_try_reserve: each side announces
+  // itself, then checks for the other.
+  r->trimming = 1;
+  amb_full_fence();
+  if (r->reserving || r->head != r->tail) {
+    r->trimming = 0;
+    return 0;
+  }
+  // The producer is locked out and the ring is empty: we own everything.
+#ifdef _WIN32
+  VirtualAlloc(r->buffer, r->max_end, MEM_RESET, PAGE_READWRITE);
+#else
+  madvise(r->buffer, r->max_end, MADV_DONTNEED);
+#endif
+  r->head = 0;
+  r->tail = 0;
+  r->orig_end = r->initial_end;
+  r->end = r->initial_end;
+  amb_full_fence();
+  r->trimming = 0;
+  spsc_rring_debug_log("Trimmed ring buffer %p back to %d bytes\n", r->buffer, r->initial_end);
+  return 1;
+}
+
+// (Producer) Raise the capacity of an elastic ring, in the natural state.
+static void grow(struct spsc_rring* r, int needed)
 {
-  if (g_buffer != NULL) {
-    fprintf(stderr, "ERROR: tried to call new_buffer a second time\n");
-    fprintf(stderr, "Only one global ring buffer permitted for now.");
-    abort();
+  int cap = r->orig_end;
+  while (cap < needed && cap < r->max_end) cap *= 2;
+  if (cap > r->max_end) cap = r->max_end;
+#ifdef _WIN32
+  if (VirtualAlloc(r->buffer, cap, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+    fprintf(stderr, "ERROR: could not commit %d bytes of ring buffer\n", cap);
+    amb_abort();
   }
-  g_buffer = malloc(sz); 
-  orig_buffer_end = sz;  // Need room for the largest message.
-  spsc_rring_debug_log("Initialized global buffer, address %p\n", g_buffer);
+#endif
+  spsc_rring_debug_log("! reserve_buffer: growing capacity from %d to %d\n", r->orig_end, cap);
+  r->orig_end = cap;
+  r->end = cap; // Natural state: ours to write.
 }
 
-void reset_buffer()
+void rring_reset(struct spsc_rring* r)
 {
-  g_buffer_end = orig_buffer_end;
+  r->end = r->orig_end;
 }
 
-void free_buffer()
+void rring_free(struct spsc_rring* r)
 {
-  spsc_rring_debug_log("Freeing buffer %p\n", g_buffer);
-  free(g_buffer);
-  g_buffer = NULL;
-  orig_buffer_end = -1;
+  spsc_rring_debug_log("Freeing buffer %p\n", r->buffer);
+  if (r->elastic) {
+#ifdef _WIN32
+    VirtualFree(r->buffer, 0, MEM_RELEASE);
+#else
+    munmap(r->buffer, r->max_end);
+#endif
+    r->elastic = 0;
+  } else
+    free(r->buffer);
+  r->buffer = NULL;
+  r->orig_end = -1;
 }
 
 // Buffer operations
 //--------------------------------------------------------------------------------
 
-char* peek_buffer(int* numread)
+char* rring_peek(struct spsc_rring* r, int* numread)
 {
   while (1)
   {
-    int observed_head = g_buffer_head; // We "own" the head (and _end)
-    int observed_tail = g_buffer_tail;
-    int observed_end  = g_buffer_end;
-    // spsc_rring_debug_log(" peek_buffer: head/tail/end: %d / %d / %d\n", observed_head, observed_tail, g_buffer_end);  
+    int observed_head = r->head; // We "own" the head (and _end)
+    int observed_tail = r->tail;
+    int observed_end  = r->end;
+    // spsc_rring_debug_log(" peek_buffer: head/tail/end: %d / %d / %d\n", observed_head, observed_tail, r->end);  
     
     if( observed_head == observed_tail ) {
       *numread = 0;
       return NULL;
     }
     // If we get past here we KNOW we are in torn/wrap-around tail<head
-    // state, which gives us priority to modify g_buffer_end an flip
+    // state, which gives us priority to modify r->end and flip
     // back to the "normal" head<=tail state.
     
     // A shrink may have left us with nothing to read at the end here:
     if (observed_head == observed_end) {
       spsc_rring_debug_log(" !!peek_buffer: FIXUP head==end==%d, resetting it, RESTORING end\n", observed_end);
-      g_buffer_end = orig_buffer_end; // Allowed to write INtorn state.
-      observed_end = orig_buffer_end;
-      g_buffer_head = 0; // Switch to natural state.
+      r->end = r->orig_end; // Allowed to write INtorn state.
+      observed_end = r->orig_end;
+      r->head = 0; // Switch to natural state.
       observed_head = 0;
       continue;
     }
 
-    char* start = g_buffer + observed_head;
+    char* start = r->buffer + observed_head;
     if ( observed_head < observed_tail ) {    
       *numread = observed_tail - observed_head;
     } else {
@@ -123,32 +217,33 @@ char* peek_buffer(int* numread)
   }
 }
 
-void pop_buffer(int numread)
+void rring_pop(struct spsc_rring* r, int numread)
 {
-  int observed_head = g_buffer_head; // We "own" the head 
-  int observed_end  = g_buffer_end;  // We "own" the end
+  int observed_head = r->head; // We "own" the head 
+  int observed_end  = r->end;  // We "own" the end
   spsc_rring_debug_log(" pop_buffer: advancing head (%d) by %d\n", observed_head, numread);
   assert(numread > 0);
+  AMB_PROBE1(ring_pop, numread);
   if (observed_head == observed_end) {
     spsc_rring_debug_log(" !!pop_buffer: FIXUP head==end, resetting it, RESTORING end\n");
-    g_buffer_end = orig_buffer_end; // Total store order!
-    g_buffer_head = 0;   // Flip the state back to in-order, release "lock" on _end
+    r->end = r->orig_end; // Total store order!
+    r->head = 0;   // Flip the state back to in-order, release "lock" on _end
     observed_head = 0;
   }
   
   if ( observed_head + numread < observed_end ) {
-    g_buffer_head += numread; // Clear the read bytes.
+    r->head += numread; // Clear the read bytes.
     return;
   } else if ( observed_head + numread == observed_end ) {
-    spsc_rring_debug_log(" ! pop_buffer: Wrapping head back around, RESTORING end to %d\n", orig_buffer_end);
-    // Here, the tail is to our "left".  That state gives US ownership over g_buffer_end to write it:
-    g_buffer_end = orig_buffer_end; // Total store order!
-    g_buffer_head = 0;              // EXIT wrap-around state.
+    spsc_rring_debug_log(" ! pop_buffer: Wrapping head back around, RESTORING end to %d\n", r->orig_end);
+    // Here, the tail is to our "left".  That state gives US ownership over r->end to write it:
+    r->end = r->orig_end; // Total store order!
+    r->head = 0;              // EXIT wrap-around state.
     return;
   } else {
     fprintf(stderr, "ERROR: tried to pop %d bytes past the end; head %d, tail %d, end %d",
-	    numread, observed_head, g_buffer_tail, observed_end);
-    abort();
+	    numread, observed_head, r->tail, observed_end);
+    amb_abort();
   }
 }
 
@@ -163,18 +258,26 @@ static inline void wait()
 #endif
 }
 
+void rring_count_stall(struct spsc_rring* r, int64_t ns)
+{
+  r->stalls++;
+  r->stall_ns += ns;
+  if (r->stall_hist != NULL) amb_hist_record(r->stall_hist, ns);
+}
+
 
-char* reserve_buffer(int len)
+char* rring_try_reserve(struct spsc_rring* r, int len)
 {
-  if (len > orig_buffer_end) {
-    fprintf(stderr,"\nERROR: reserve_buffer request bigger than allocated buffer itself! %d", len);
-    abort();
+  if (r->elastic) {
+    r->reserving = 1;
+    amb_full_fence();
+    if (r->trimming) { r->reserving = 0; return NULL; }
   }
   while(1) // Retry loop.
     { 
-    int our_tail = g_buffer_tail;
-    int observed_head = g_buffer_head; // Only consumer changes this.
-    int observed_end = g_buffer_end;
+    int our_tail = r->tail;
+    int observed_head = r->head; // Only consumer changes this.
+    int observed_end = r->end;
     int headroom;
     if (our_tail < observed_head) // Torn/wrapped-around state.
          headroom = observed_head - our_tail;
@@ -184,25 +287,26 @@ char* reserve_buffer(int len)
           headroom, observed_head, our_tail, observed_end);
     if (len < headroom)
       {
-        g_buffer_last_reserved = len;
-        return g_buffer+our_tail; // good to go!
+        AMB_TRACE(AMB_TRACE_RESERVE, 0, len, 0);
+        AMB_PROBE1(ring_reserve, len);
+        r->last_reserved = len;
+        return r->buffer+our_tail; // good to go!
       }
     else if (our_tail < observed_head) // Torn state
       {
-        int clearpos = our_tail + len;
-        if ( clearpos < observed_end ) {
-          // Don't wait for state change, wait till we have just enough room:
-          // while( g_buffer_head < clearpos ) 
-          spsc_rring_debug_log("! reserve_buffer: wait for head to advance.  Head/tail/end: %d %d %d\n",
-                               observed_head, our_tail, observed_end);
-        } else {
-          // Otherwise we have to wait for state change.  In natural
-          // state the shrunk buffer is restored.
-          // while( g_buffer_head < our_tail ) 
-          spsc_rring_debug_log("! reserve_buffer: wait to exit torn state.  Head/tail/end: %d %d %d\n",
-                               observed_head, our_tail, observed_end);
-        }
-        wait();
+        // Either the head must advance far enough, or (if the message
+        // cannot fit before _end) we must wait for the state change
+        // back to natural, where the shrunk buffer is restored.
+        spsc_rring_debug_log("! reserve_buffer: wait for head to advance.  Head/tail/end: %d %d %d\n",
+                             observed_head, our_tail, observed_end);
+        r->reserving = 0;
+        return NULL;
+      }
+    else if (r->elastic && r->orig_end < r->max_end &&
+             (our_tail - observed_head) + len >= r->orig_end / 2)
+      {
+        // Natural state, and the ring is filling up: make room in place.
+        grow(r, our_tail + len + 1);
         continue;
       }
     else // Natural state but need to switch.
@@ -210,35 +314,81 @@ char* reserve_buffer(int len)
         // In the natural state, we may be near the _end and need to
         // shrink/wrap-early.  BUT, we cannot wrap if head is squatting at
         // the start -- that would make a full state appear empty.
-        while ( observed_head == 0 ) {
+        if ( observed_head == 0 ) {
           spsc_rring_debug_log("! reserve_buffer: stalling EARLY WRAP (tail %d), until head moves off the start mark\n",
                                our_tail);
-          wait();
-          observed_head = g_buffer_head;
+          r->reserving = 0;
+          return NULL;
         }
         
         spsc_rring_debug_log("! reserve_buffer: committing an EARLY WRAP, shrinking end from %d to %d\n",
                       observed_end, our_tail);
         // We're in "natural" not "torn" state until *we* change it.
-        g_buffer_end = our_tail; // The state gives us "the lock" on this var.
-        our_tail      = 0;
-        g_buffer_tail = 0; // State change!  Torn state.
+        r->end = our_tail; // The state gives us "the lock" on this var.
+        r->tail = 0; // State change!  Torn state.
         continue;
       }
   }
 }
 
-void release_buffer(int len)
+char* rring_reserve(struct spsc_rring* r, int len)
 {
-  spsc_rring_debug_log("  => release_buffer of %d bytes, new tail %d\n", len, g_buffer_tail + len);
+  if (len >= rring_max_capacity(r)) {
+    fprintf(stderr,"\nERROR: reserve_buffer request bigger than allocated buffer itself! %d", len);
+    amb_abort();
+  }
+  char* ptr = rring_try_reserve(r, len);
+  if (ptr != NULL) return ptr;
+  // Only the slow path is timed:
+  int64_t start = amb_monotonic_ns();
+  AMB_TRACE(AMB_TRACE_STALL_BEGIN, 0, len, 0);
+  while ((ptr = rring_try_reserve(r, len)) == NULL)
+    wait();
+  AMB_TRACE(AMB_TRACE_STALL_END, 0, len, 0);
+  int64_t ns = amb_monotonic_ns() - start;
+  AMB_PROBE2(ring_stall, len, ns);
+  rring_count_stall(r, ns);
+  return ptr;
+}
+
+void rring_release(struct spsc_rring* r, int len)
+{
+  spsc_rring_debug_log("  => release_buffer of %d bytes, new tail %d\n", len, r->tail + len);
   
-  if (len > g_buffer_last_reserved) {
+  if (len > r->last_reserved) {
     fprintf(stderr, "ERROR: cannot finish/release %d bytes, only reserved %d\n",
-            len, g_buffer_last_reserved);
-    abort();
+            len, r->last_reserved);
+    amb_abort();
   }
-  g_buffer_tail += len;
-  g_buffer_last_reserved = -1;
+  r->tail += len;
+  r->last_reserved = -1;
+  r->reserving = 0;
   
-  // g_buffer_msgs++; // Only a release counts as a real "message".
+  r->releases++;
+  AMB_TRACE(AMB_TRACE_RELEASE, 0, len, 0);
+  AMB_PROBE1(ring_release, len);
+  int used = rring_used(r);
+  if (used > r->high_water) r->high_water = used;
 }
+
+int rring_used(struct spsc_rring* r)
+{
+  int observed_head = r->head;
+  int observed_tail = r->tail;
+  int observed_end  = r->end;
+  if (observed_head <= observed_tail)
+    return observed_tail - observed_head;
+  return (observed_end - observed_head) + observed_tail; // Torn state.
+}
+
+
+// Legacy single-ring API
+//--------------------------------------------------------------------------------
+
+void  new_buffer(int sz)        { rring_init(&g_rring, sz); }
+void  reset_buffer()            { rring_reset(&g_rring); }
+void  free_buffer()             { rring_free(&g_rring); }
+char* peek_buffer(int* numread) { return rring_peek(&g_rring, numread); }
+void  pop_buffer(int numread)   { rring_pop(&g_rring, numread); }
+char* reserve_buffer(int len)   { return rring_reserve(&g_rring, len); }
+void  release_buffer(int len)   { rring_release(&g_rring, len); }
@@ -0,0 +1,169 @@
+
+// See the corresponding header for function-level documentation.
+
+#ifndef _WIN32
+  #define _GNU_SOURCE // syscall
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ambrosia/log.h"
+#include "ambrosia/trace.h"
+#include "ambrosia/internal/platform.h"
+
+#ifdef _WIN32
+  #include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+// One thread's ring of recent events.  Only its thread writes it.
+struct trace_buffer {
+  struct trace_buffer* next; // All buffers, newest first.
+  char     name[24];
+  int64_t  tid;
+  uint64_t mask;
+  volatile uint64_t count;   // Events ever written.
+  struct amb_trace_event* events;
+};
+
+volatile int amb_trace_on = 0;
+
+static struct trace_buffer* volatile g_buffers = NULL;
+static int      g_capacity = 65536; // Events per thread (a power of 2).
+static uint64_t g_tsc0 = 0;
+static int64_t  g_ns0  = 0;
+static char*    g_exit_path = NULL;
+
+static AMB_THREAD_LOCAL struct trace_buffer* t_buffer = NULL;
+
+static inline uint64_t read_tsc()
+{
+#if defined(_WIN32) || defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (uint64_t)amb_monotonic_ns();
+#endif
+}
+
+// Create the calling thread's buffer and publish it (lock-free push).
+static struct trace_buffer* new_buffer_for_thread()
+{
+  struct trace_buffer* b = (struct trace_buffer*)calloc(1, sizeof(*b));
+  b->events = (struct amb_trace_event*)calloc(g_capacity, sizeof(struct amb_trace_event));
+  if (b->events == NULL) {
+    fprintf(stderr, "ERROR: could not allocate %d trace events\n", g_capacity);
+    amb_abort();
+  }
+  b->mask = g_capacity - 1;
+  b->tid  = amb_thread_id();
+  snprintf(b->name, sizeof(b->name), "thread %lld", (long long)b->tid);
+  amb_push_node((void* volatile*)&g_buffers, b, (void**)&b->next);
+  t_buffer = b;
+  return b;
+}
+
+void amb_trace_record(uint16_t id, int64_t seqID, uint32_t size, uint16_t aux)
+{
+  struct trace_buffer* b = t_buffer;
+  if (b == NULL) b = new_buffer_for_thread();
+  struct amb_trace_event* e = &b->events[b->count & b->mask];
+  e->tsc   = read_tsc();
+  e->seqID = seqID;
+  e->size  = size;
+  e->id    = id;
+  e->aux   = aux;
+  b->count++;
+}
+
+void amb_trace_enable(int on)
+{
+#ifndef AMBROSIA_TRACE
+  if (on)
+    fprintf(stderr, "WARNING: tracing requested, but the library was built without it (make trace)\n");
+#endif
+  if (on && g_tsc0 == 0) {
+    g_ns0  = amb_monotonic_ns();
+    g_tsc0 = read_tsc();
+  }
+  amb_trace_on = on;
+}
+
+void amb_trace_thread_name(const char* name)
+{
+  struct trace_buffer* b = t_buffer;
+  if (b == NULL) b = new_buffer_for_thread();
+  snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+static void dump_at_exit()
+{
+  int64_t n = amb_trace_dump(g_exit_path);
+  if (n >= 0) fprintf(stderr, " *** Wrote %lld trace events to %s\n", (long long)n, g_exit_path);
+}
+
+void amb_trace_init_from_env()
+{
+  static int done = 0;
+  if (done) return;
+  done = 1;
+  char* v = getenv("AMBROSIA_TRACE_EVENTS");
+  if (v != NULL && atoi(v) > 0) {
+    g_capacity = 1;
+    while (g_capacity < atoi(v)) g_capacity *= 2;
+  }
+  v = getenv("AMBROSIA_TRACE_FILE");
+  if (v != NULL && *v != 0) {
+    g_exit_path = strdup(v);
+    atexit(dump_at_exit);
+  }
+  v = getenv("AMBROSIA_TRACE");
+  if (v != NULL && atoi(v) != 0) amb_trace_enable(1);
+}
+
+int64_t amb_trace_dump(const char* path)
+{
+  FILE* f = fopen(path, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open trace file %s\n", path);
+    return -1;
+  }
+  struct amb_trace_file_hdr hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic   = AMB_TRACE_MAGIC;
+  hdr.version = 1;
+  hdr.tsc0    = g_tsc0;
+  hdr.ns0     = g_ns0;
+  hdr.ns1     = amb_monotonic_ns();
+  hdr.tsc1    = read_tsc();
+  // Threads registering now are left out of both walks alike:
+  struct trace_buffer* head = g_buffers;
+  for (struct trace_buffer* b = head; b != NULL; b = b->next) hdr.threads++;
+  int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+  int64_t total = 0;
+  for (struct trace_buffer* b = head; b != NULL && ok; b = b->next) {
+    uint64_t end = b->count;
+    uint64_t start = end > b->mask + 1 ? end - (b->mask + 1) : 0;
+    struct amb_trace_thread_hdr th;
+    memset(&th, 0, sizeof(th));
+    memcpy(th.name, b->name, sizeof(th.name));
+    th.tid   = b->tid;
+    th.count = end - start;
+    ok = fwrite(&th, sizeof(th), 1, f) == 1;
+    // At most two runs: up to the end of the array, then from its start.
+    size_t n = (size_t)th.count, first = (size_t)(start & b->mask);
+    size_t run = n < b->mask + 1 - first ? n : (size_t)(b->mask + 1 - first);
+    if (ok && run > 0) ok = fwrite(&b->events[first], sizeof(struct amb_trace_event), run, f) == run;
+    if (ok && run < n) ok = fwrite(b->events, sizeof(struct amb_trace_event), n - run, f) == n - run;
+    total += th.count;
+  }
+  if (fclose(f) != 0) ok = 0;
+  if (!ok) {
+    fprintf(stderr, "ERROR: failed writing trace file %s\n", path);
+    return -1;
+  }
+  return total;
+}
@@ -0,0 +1,154 @@
+
+// -----------------------------------------------------------------------------
+// Checks for the zero-copy argument views (ambrosia/args_view.h): every
+// field type round-trips through its accessor, and truncated payloads,
+// trailing bytes and invalid schemas are all rejected.
+// -----------------------------------------------------------------------------
+
+//   make check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ambrosia/args_view.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "ERROR: %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      g_failures++;                                                     \
+    }                                                                   \
+  } while (0)
+
+static const uint8_t k_schema[] = {
+  AMB_FIELD_INT32, AMB_FIELD_INT64, AMB_FIELD_FIXED32, AMB_FIELD_FIXED64,
+  AMB_FIELD_BYTES, AMB_FIELD_INT32, AMB_FIELD_BYTES
+};
+#define K_FIELDS ((int)sizeof(k_schema))
+
+static const char k_text[] = "hello, view";
+
+// Encode one payload for k_schema; returns its length.
+static int encode(char* buf, int32_t a, int64_t b, int32_t c, int64_t d, int32_t e) {
+  char* p = buf;
+  p = (char*)write_zigzag_int(p, a);
+  p = (char*)write_zigzag_long(p, b);
+  memcpy(p, &c, 4); p += 4;
+  memcpy(p, &d, 8); p += 8;
+  p = (char*)write_zigzag_int(p, (int32_t)strlen(k_text));
+  memcpy(p, k_text, strlen(k_text)); p += strlen(k_text);
+  p = (char*)write_zigzag_int(p, e);
+  p = (char*)write_zigzag_int(p, 0); // An empty byte field.
+  return (int)(p - buf);
+}
+
+static void check_fields() {
+  // Extremes of each varint width, plus values that flip sign under zigzag:
+  const int32_t ints[]  = { 0, -1, 1, 63, -64, 64, INT32_MAX, INT32_MIN };
+  const int64_t longs[] = { 0, -1, 1, (int64_t)1 << 40, INT64_MAX, INT64_MIN };
+  char buf[128];
+  for (int i = 0; i < (int)(sizeof(ints) / sizeof(ints[0])); i++) {
+    for (int j = 0; j < (int)(sizeof(longs) / sizeof(longs[0])); j++) {
+      int32_t a = ints[i], c = ints[(i + 3) % 8], e = -ints[(i + 5) % 8] - 1;
+      int64_t b = longs[j], d = longs[(j + 1) % 6];
+      int len = encode(buf, a, b, c, d, e);
+
+      struct amb_args_view v;
+      CHECK(amb_view_init(&v, k_schema, K_FIELDS, buf, len) == 0);
+      CHECK(amb_view_int32(&v, 0) == a);
+      CHECK(amb_view_int64(&v, 1) == b);
+      CHECK(amb_view_fixed32(&v, 2) == c);
+      CHECK(amb_view_fixed64(&v, 3) == d);
+      int n;
+      const char* s = amb_view_bytes(&v, 4, &n);
+      CHECK(n == (int)strlen(k_text) && memcmp(s, k_text, n) == 0);
+      CHECK(s >= buf && s + n <= buf + len); // Points into the payload.
+      CHECK(amb_view_int32(&v, 5) == e);
+      amb_view_bytes(&v, 6, &n);
+      CHECK(n == 0);
+
+      // Every strict prefix is truncated somewhere:
+      for (int k = 0; k < len; k++)
+        CHECK(amb_view_init(&v, k_schema, K_FIELDS, buf, k) == -1);
+      // And a trailing byte is left over:
+      buf[len] = 0;
+      CHECK(amb_view_init(&v, k_schema, K_FIELDS, buf, len + 1) == -1);
+    }
+  }
+}
+
+static void check_rest() {
+  const uint8_t schema[] = { AMB_FIELD_FIXED32, AMB_FIELD_REST };
+  char buf[64];
+  int32_t x = 0x12345678;
+  memcpy(buf, &x, 4);
+  memcpy(buf + 4, k_text, strlen(k_text));
+  int len = 4 + (int)strlen(k_text);
+
+  struct amb_args_view v;
+  int n;
+  CHECK(amb_view_init(&v, schema, 2, buf, len) == 0);
+  CHECK(amb_view_fixed32(&v, 0) == x);
+  const char* s = amb_view_bytes(&v, 1, &n);
+  CHECK(s == buf + 4 && n == (int)strlen(k_text));
+  // The rest may be empty, but the fields before it must be there:
+  CHECK(amb_view_init(&v, schema, 2, buf, 4) == 0);
+  amb_view_bytes(&v, 1, &n);
+  CHECK(n == 0);
+  CHECK(amb_view_init(&v, schema, 2, buf, 3) == -1);
+}
+
+static void check_malformed() {
+  struct amb_args_view v;
+  char buf[32];
+
+  // A varint whose continuation bit never ends:
+  memset(buf, 0xff, sizeof(buf));
+  const uint8_t one_int[]  = { AMB_FIELD_INT32 };
+  const uint8_t one_long[] = { AMB_FIELD_INT64 };
+  CHECK(amb_view_init(&v, one_int, 1, buf, sizeof(buf)) == -1);
+  CHECK(amb_view_init(&v, one_long, 1, buf, sizeof(buf)) == -1);
+
+  // Byte fields with a negative length, or one past the payload:
+  const uint8_t one_bytes[] = { AMB_FIELD_BYTES };
+  char* p = (char*)write_zigzag_int(buf, -3);
+  CHECK(amb_view_init(&v, one_bytes, 1, buf, (int)(p - buf) + 8) == -1);
+  p = (char*)write_zigzag_int(buf, 20);
+  CHECK(amb_view_init(&v, one_bytes, 1, buf, (int)(p - buf) + 19) == -1);
+  CHECK(amb_view_init(&v, one_bytes, 1, buf, (int)(p - buf) + 20) == 0);
+}
+
+static void check_schemas() {
+  struct amb_args_view v;
+  char buf[64] = { 0 };
+
+  const uint8_t rest_first[] = { AMB_FIELD_REST, AMB_FIELD_INT32 };
+  CHECK(amb_view_init(&v, rest_first, 2, buf, 1) == -1);
+  const uint8_t unknown[] = { AMB_FIELD_INT32, 17 };
+  CHECK(amb_view_init(&v, unknown, 2, buf, 2) == -1);
+
+  // As many fields as a view can hold, and one more:
+  uint8_t many[AMB_VIEW_MAX_FIELDS + 1];
+  memset(many, AMB_FIELD_INT32, sizeof(many));
+  CHECK(amb_view_init(&v, many, AMB_VIEW_MAX_FIELDS, buf, AMB_VIEW_MAX_FIELDS) == 0);
+  CHECK(amb_view_init(&v, many, AMB_VIEW_MAX_FIELDS + 1, buf, AMB_VIEW_MAX_FIELDS + 1) == -1);
+  CHECK(amb_view_init(&v, many, -1, buf, 0) == -1);
+
+  // No fields at all matches only an empty payload:
+  CHECK(amb_view_init(&v, many, 0, buf, 0) == 0);
+  CHECK(amb_view_init(&v, many, 0, buf, 1) == -1);
+}
+
+int main() {
+  check_fields();
+  check_rest();
+  check_malformed();
+  check_schemas();
+  if (g_failures) {
+    fprintf(stderr, "FAILED: %d checks\n", g_failures);
+    return 1;
+  }
+  printf("args_view check passed\n");
+  return 0;
+}
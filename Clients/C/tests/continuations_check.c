@@ -0,0 +1,123 @@
+
+// -----------------------------------------------------------------------------
+// Checks for the table of pending continuations
+// (ambrosia/internal/continuations.h): IDs are handed out in order,
+// replies taken out of order force the table to grow without losing
+// an entry, and unknown or already-taken IDs are refused.
+// -----------------------------------------------------------------------------
+
+//   make check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ambrosia/internal/continuations.h"
+
+#define CALLS 100000
+
+static int g_failures = 0;
+
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "ERROR: %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      g_failures++;                                                     \
+    }                                                                   \
+  } while (0)
+
+static void k_even(void* closure, int64_t callID, char retType, void* retval, int retLen) {
+  (void)closure; (void)callID; (void)retType; (void)retval; (void)retLen;
+}
+
+static void k_odd(void* closure, int64_t callID, char retType, void* retval, int retLen) {
+  (void)closure; (void)callID; (void)retType; (void)retval; (void)retLen;
+}
+
+static char g_closures[CALLS + 1];
+
+// Take one ID and check that it comes back with what was registered.
+static void take_and_check(struct amb_continuation_table* tbl, int64_t id) {
+  amb_continuation_t k = NULL;
+  void* closure = NULL;
+  CHECK(amb_continuations_take(tbl, id, &k, &closure) == 1);
+  CHECK(k == (id % 2 ? k_odd : k_even));
+  CHECK(closure == &g_closures[id]);
+  // A second reply for the same call is refused:
+  CHECK(amb_continuations_take(tbl, id, &k, &closure) == 0);
+}
+
+static void check_uninitialized() {
+  struct amb_continuation_table tbl;
+  memset(&tbl, 0, sizeof(tbl));
+  tbl.next_callID = 1;
+  amb_continuation_t k;
+  void* closure;
+  CHECK(amb_continuations_take(&tbl, 1, &k, &closure) == 0);
+  CHECK(amb_continuations_take(&tbl, 0, &k, &closure) == 0);
+}
+
+static void check_out_of_order() {
+  struct amb_continuation_table tbl;
+  amb_continuations_init(&tbl, 4);
+  CHECK(tbl.capacity == 4);
+
+  // Register every call, leaving them all outstanding, so that each
+  // wrap of the ID space over the table makes it grow:
+  for (int64_t i = 1; i <= CALLS; i++) {
+    int64_t id = amb_continuations_register(&tbl, i % 2 ? k_odd : k_even, &g_closures[i]);
+    CHECK(id == i);
+  }
+  CHECK(tbl.outstanding == CALLS);
+  CHECK(tbl.capacity >= CALLS && (tbl.capacity & (tbl.capacity - 1)) == 0);
+
+  amb_continuation_t k;
+  void* closure;
+  CHECK(amb_continuations_take(&tbl, CALLS + 1, &k, &closure) == 0);
+  CHECK(amb_continuations_take(&tbl, -5, &k, &closure) == 0);
+  // An ID that shares a slot with an outstanding call is still refused:
+  CHECK(amb_continuations_take(&tbl, 1 + tbl.capacity, &k, &closure) == 0);
+
+  // Take them back in a scrambled order (a stride coprime to CALLS):
+  int64_t j = 0;
+  for (int64_t n = 0; n < CALLS; n++) {
+    j = (j + 7919) % CALLS;
+    take_and_check(&tbl, j + 1);
+  }
+  CHECK(tbl.outstanding == 0);
+  amb_continuations_free(&tbl);
+}
+
+// The steady state: a window of calls in flight, retired roughly in
+// order, with the occasional straggler.
+static void check_window() {
+  struct amb_continuation_table tbl;
+  amb_continuations_init(&tbl, 0);
+  int64_t initial = tbl.capacity;
+
+  const int64_t straggler = 500; // Left pending until the end.
+  int64_t oldest = 1;
+  for (int64_t i = 1; i <= CALLS; i++) {
+    CHECK(amb_continuations_register(&tbl, i % 2 ? k_odd : k_even, &g_closures[i]) == i);
+    if (oldest == straggler) oldest++;
+    if (i - oldest >= 64) take_and_check(&tbl, oldest++);
+  }
+  for (; oldest <= CALLS; oldest++)
+    if (oldest != straggler) take_and_check(&tbl, oldest);
+  CHECK(tbl.outstanding == 1);
+  take_and_check(&tbl, straggler);
+  CHECK(tbl.outstanding == 0);
+  // Only the straggler's slot coming round again forces growth:
+  CHECK(tbl.capacity > initial);
+  amb_continuations_free(&tbl);
+}
+
+int main() {
+  check_uninitialized();
+  check_out_of_order();
+  check_window();
+  if (g_failures) {
+    fprintf(stderr, "FAILED: %d checks\n", g_failures);
+    return 1;
+  }
+  printf("continuations check passed\n");
+  return 0;
+}
@@ -0,0 +1,120 @@
+
+// -----------------------------------------------------------------------------
+// Stress check for the elastic ring (spsc_rring.h): a producer thread
+// reserves and releases messages of mixed sizes, which makes the ring
+// grow, while the consumer peeks and pops them in arbitrary pieces and
+// trims the ring whenever it finds it empty.  Every byte carries a
+// function of its position in the stream, so a lost, repeated or
+// clobbered byte (say, from a trim racing a reservation) shows up.
+// -----------------------------------------------------------------------------
+
+//   make check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ambrosia/internal/spsc_rring.h"
+
+#define INITIAL   4096
+#define MAXIMUM   (1 << 20)
+#define MESSAGES  400000
+#define BIG       (200 * 1024) // Occasional messages this large force growth.
+
+static struct spsc_rring g_ring;
+static volatile int g_done = 0;
+static volatile int64_t g_produced = 0;
+static int g_grew = 0;
+
+static inline uint8_t byte_at(int64_t pos) {
+  return (uint8_t)(pos * 131 + (pos >> 9));
+}
+
+static uint64_t g_rng = 88172645463325252ULL;
+
+static inline uint64_t next_random(uint64_t* s) {
+  *s ^= *s << 13;
+  *s ^= *s >> 7;
+  *s ^= *s << 17;
+  return *s;
+}
+
+static void* producer(void* arg) {
+  (void)arg;
+  uint64_t rng = 0x9e3779b97f4a7c15ULL;
+  int64_t pos = 0;
+  for (int i = 0; i < MESSAGES; i++) {
+    uint64_t x = next_random(&rng);
+    int len = (x % 1000 == 0) ? BIG : 1 + (int)(x % 2000);
+    // Sometimes reserve more than gets used:
+    int reserve = len + ((x >> 20) % 4 == 0 ? (int)((x >> 24) % 512) : 0);
+    char* p;
+    if ((x >> 12) % 2) {
+      p = rring_reserve(&g_ring, reserve);
+    } else {
+      while ((p = rring_try_reserve(&g_ring, reserve)) == NULL) sched_yield();
+    }
+    for (int j = 0; j < len; j++) p[j] = (char)byte_at(pos + j);
+    rring_release(&g_ring, len);
+    pos += len;
+    g_produced = pos;
+    if (g_ring.orig_end > INITIAL) g_grew = 1;
+    // Now and then, go quiet long enough for the ring to drain and trim:
+    if ((x >> 32) % 64 == 0)
+      for (int k = 0; k < 50; k++) sched_yield();
+  }
+  __sync_synchronize();
+  g_done = 1;
+  return NULL;
+}
+
+int main() {
+  rring_init_elastic(&g_ring, INITIAL, MAXIMUM, 0);
+  pthread_t th;
+  pthread_create(&th, NULL, producer, NULL);
+
+  int64_t consumed = 0;
+  int trims = 0, idle = 0;
+  while (1) {
+    int n;
+    char* p = rring_peek(&g_ring, &n);
+    if (p == NULL) {
+      if (g_done) {
+        __sync_synchronize();
+        if (rring_used(&g_ring) == 0) break;
+      }
+      // Trim as soon as the ring looks empty (the network thread waits
+      // for a quiet spell), so trims land while a reservation is open:
+      if (++idle % 16 == 1) trims += rring_trim(&g_ring);
+      sched_yield();
+      continue;
+    }
+    idle = 0;
+    // Pop the bytes seen in one or more pieces, like partial sends:
+    int k = 1 + (int)(next_random(&g_rng) % (uint64_t)n);
+    for (int j = 0; j < k; j++) {
+      if ((uint8_t)p[j] != byte_at(consumed + j)) {
+        fprintf(stderr, "ERROR: byte %lld is %d, expected %d\n",
+                (long long)(consumed + j), (uint8_t)p[j], byte_at(consumed + j));
+        return 1;
+      }
+    }
+    rring_pop(&g_ring, k);
+    consumed += k;
+  }
+  pthread_join(th, NULL);
+
+  if (consumed != g_produced) {
+    fprintf(stderr, "ERROR: consumed %lld bytes of %lld\n", (long long)consumed, (long long)g_produced);
+    return 1;
+  }
+  if (!g_grew || trims == 0) {
+    fprintf(stderr, "ERROR: the ring should have grown (%d) and been trimmed (%d times)\n",
+            g_grew, trims);
+    return 1;
+  }
+  printf("rring check passed: %lld bytes, %d trims\n", (long long)consumed, trims);
+  rring_free(&g_ring);
+  return 0;
+}
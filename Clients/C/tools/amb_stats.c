@@ -0,0 +1,141 @@
+
+// -----------------------------------------------------------------------------
+// Print the statistics a client publishes to shared memory.
+// -----------------------------------------------------------------------------
+
+// Start the client with AMBROSIA_STATS_SHM=NAME, then:
+//
+//   amb_stats.exe [-i SECONDS] NAME
+//
+// prints one snapshot, or with -i, one line of rates per interval
+// until interrupted.  See struct amb_stats_page in client.h for the
+// page layout and the seqlock protocol.
+
+// Linux only.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "ambrosia/client.h"
+
+static struct amb_stats_page* map_page(const char* name) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: no statistics page %s (is AMBROSIA_STATS_SHM set?)\n", path);
+    exit(1);
+  }
+  void* mem = mmap(NULL, sizeof(struct amb_stats_page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  struct amb_stats_page* page = (struct amb_stats_page*)mem;
+  if (page->magic != AMB_STATS_MAGIC || page->size != sizeof(struct amb_stats_page)) {
+    fprintf(stderr, "ERROR: %s is not a statistics page from this version of the client\n", path);
+    exit(1);
+  }
+  return page;
+}
+
+// Copy a consistent snapshot out of the page.
+static void read_page(const struct amb_stats_page* page, struct amb_stats* out,
+                      struct amb_stats_histograms* hists) {
+  while (1) {
+    int64_t seq = page->seq;
+    if (seq & 1) { sched_yield(); continue; }
+    __sync_synchronize();
+    memcpy(out, (const void*)&page->stats, sizeof(*out));
+    memcpy(hists, (const void*)&page->histograms, sizeof(*hists));
+    __sync_synchronize();
+    if (page->seq == seq) return;
+  }
+}
+
+static void print_hist(const char* what, const struct amb_histogram* h) {
+  if (h->count == 0) {
+    printf("  %-18s none\n", what);
+    return;
+  }
+  printf("  %-18s n %lld  mean %.1lf  p50 %.1lf  p99 %.1lf  p99.9 %.1lf  max %.1lf (us)\n",
+         what, (long long)h->count, amb_hist_mean(h) / 1e3,
+         amb_hist_percentile(h, 50) / 1e3, amb_hist_percentile(h, 99) / 1e3,
+         amb_hist_percentile(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+static void print_snapshot(const struct amb_stats_page* page, const struct amb_stats* s,
+                           const struct amb_stats_histograms* h) {
+  printf("Client pid %lld\n", (long long)page->pid);
+  printf("  sent               %lld msgs, %lld bytes, %lld send calls\n",
+         (long long)s->msgs_sent, (long long)s->bytes_sent, (long long)s->send_calls);
+  printf("  received           %lld msgs in %lld records, %lld bytes, %lld recv calls, %lld quickack re-arms\n",
+         (long long)s->msgs_received, (long long)s->records_received,
+         (long long)s->bytes_received, (long long)s->recv_calls, (long long)s->quickack_calls);
+  printf("  ring               high water %lld bytes, %lld stalls (%.3lf s)\n",
+         (long long)s->ring_high_water, (long long)s->ring_stalls, s->ring_stall_ns / 1e9);
+  printf("  network thread     %lld idle yields\n", (long long)s->yield_calls);
+  print_hist("ring stalls", &h->stall_latency);
+  print_hist("arrival->dispatch", &h->dispatch_latency);
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-i SECONDS] NAME\n"
+          "  NAME          the client's AMBROSIA_STATS_SHM\n"
+          "  -i SECONDS    print rates every SECONDS until interrupted\n",
+          prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  double interval = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:")) != -1) {
+    switch (opt) {
+    case 'i': interval = atof(optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) usage(argv[0]);
+
+  const struct amb_stats_page* page = map_page(argv[optind]);
+  static struct amb_stats prev, cur;
+  static struct amb_stats_histograms prev_h, cur_h;
+  read_page(page, &cur, &cur_h);
+  print_snapshot(page, &cur, &cur_h);
+  if (interval <= 0) return 0;
+
+  printf("%10s %10s %10s %10s %10s %12s %12s\n", "msgs/s out", "MB/s out", "sends/s",
+         "msgs/s in", "MB/s in", "stalls/s", "dispatch p99");
+  while (1) {
+    prev = cur;
+    prev_h = cur_h;
+    struct timespec ts = { (time_t)interval, (long)((interval - (time_t)interval) * 1e9) };
+    nanosleep(&ts, NULL);
+    read_page(page, &cur, &cur_h);
+    // Percentiles of just this interval:
+    struct amb_histogram* delta = &prev_h.dispatch_latency;
+    for (int i = 0; i < AMB_HIST_BUCKETS; i++)
+      delta->counts[i] = cur_h.dispatch_latency.counts[i] - prev_h.dispatch_latency.counts[i];
+    delta->count = cur_h.dispatch_latency.count - prev_h.dispatch_latency.count;
+    delta->max = cur_h.dispatch_latency.max;
+    printf("%10.0lf %10.2lf %10.0lf %10.0lf %10.2lf %12.0lf %10.1lfus\n",
+           (cur.msgs_sent - prev.msgs_sent) / interval,
+           (cur.bytes_sent - prev.bytes_sent) / interval / 1e6,
+           (cur.send_calls - prev.send_calls) / interval,
+           (cur.msgs_received - prev.msgs_received) / interval,
+           (cur.bytes_received - prev.bytes_received) / interval / 1e6,
+           (cur.ring_stalls - prev.ring_stalls) / interval,
+           amb_hist_percentile(delta, 99) / 1e3);
+    fflush(stdout);
+  }
+}
@@ -0,0 +1,117 @@
+
+// -----------------------------------------------------------------------------
+// Convert a client trace dump to Chrome trace JSON.
+// -----------------------------------------------------------------------------
+
+// Record a trace with a library built by `make trace`, for example:
+//
+//   AMBROSIA_TRACE=1 AMBROSIA_TRACE_FILE=run.trace ./service.exe ...
+//   amb_trace.exe run.trace > run.json
+//
+// then load run.json in chrome://tracing or ui.perfetto.dev.  Each
+// traced thread becomes a track; spans (reservation stalls, sends, log
+// records, handler dispatches, checkpoints) nest on it, and the rest
+// are instant events.  Timestamps are microseconds from the earliest
+// event in the file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ambrosia/trace.h"
+
+static const char* g_names[AMB_TRACE_ID_COUNT] = {
+  NULL,
+  "reserve", "release", "stall", "stall",
+  "peek", "send", "send",
+  "log header", "log record", "log record",
+  "dispatch", "dispatch", "checkpoint", "checkpoint"
+};
+
+// 'B'egin, 'E'nd, or 'i'nstant.
+static char phase(uint16_t id) {
+  switch (id) {
+  case AMB_TRACE_STALL_BEGIN: case AMB_TRACE_SEND_BEGIN: case AMB_TRACE_RECORD_BEGIN:
+  case AMB_TRACE_DISPATCH_BEGIN: case AMB_TRACE_CHECKPOINT_BEGIN:
+    return 'B';
+  case AMB_TRACE_STALL_END: case AMB_TRACE_SEND_END: case AMB_TRACE_RECORD_END:
+  case AMB_TRACE_DISPATCH_END: case AMB_TRACE_CHECKPOINT_END:
+    return 'E';
+  default:
+    return 'i';
+  }
+}
+
+static void read_or_die(void* buf, size_t sz, size_t n, FILE* f, const char* path) {
+  if (fread(buf, sz, n, f) != n) {
+    fprintf(stderr, "ERROR: %s is truncated\n", path);
+    exit(1);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s TRACEFILE > trace.json\n", argv[0]);
+    return 1;
+  }
+  const char* path = argv[1];
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "ERROR: could not open %s\n", path);
+    return 1;
+  }
+  struct amb_trace_file_hdr hdr;
+  read_or_die(&hdr, sizeof(hdr), 1, f, path);
+  if (hdr.magic != AMB_TRACE_MAGIC || hdr.version != 1) {
+    fprintf(stderr, "ERROR: %s is not an AMBROSIA trace (version 1)\n", path);
+    return 1;
+  }
+  // Timestamp counter ticks per nanosecond, from the calibration points:
+  double ticks_per_ns = 1.0;
+  if (hdr.tsc1 > hdr.tsc0 && hdr.ns1 > hdr.ns0)
+    ticks_per_ns = (double)(hdr.tsc1 - hdr.tsc0) / (double)(hdr.ns1 - hdr.ns0);
+
+  // Read all threads first, to find the earliest event.
+  struct amb_trace_thread_hdr* threads =
+    (struct amb_trace_thread_hdr*)calloc(hdr.threads + 1, sizeof(*threads));
+  struct amb_trace_event** events =
+    (struct amb_trace_event**)calloc(hdr.threads + 1, sizeof(*events));
+  uint64_t origin = UINT64_MAX;
+  for (uint32_t t = 0; t < hdr.threads; t++) {
+    read_or_die(&threads[t], sizeof(threads[t]), 1, f, path);
+    events[t] = (struct amb_trace_event*)malloc((threads[t].count + 1) * sizeof(struct amb_trace_event));
+    read_or_die(events[t], sizeof(struct amb_trace_event), threads[t].count, f, path);
+    if (threads[t].count > 0 && events[t][0].tsc < origin) origin = events[t][0].tsc;
+  }
+  fclose(f);
+
+  printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  int first = 1;
+  for (uint32_t t = 0; t < hdr.threads; t++) {
+    threads[t].name[sizeof(threads[t].name) - 1] = 0;
+    printf("%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%lld,\"args\":{\"name\":\"%s\"}}",
+           first ? "" : ",\n", (long long)threads[t].tid, threads[t].name);
+    first = 0;
+    for (uint64_t i = 0; i < threads[t].count; i++) {
+      struct amb_trace_event* e = &events[t][i];
+      char ph = phase(e->id);
+      char user[32];
+      const char* name = e->id < AMB_TRACE_ID_COUNT ? g_names[e->id] : NULL;
+      if (name == NULL) {
+        snprintf(user, sizeof(user), "event %u", (unsigned)e->id);
+        name = user;
+      }
+      double ts = (double)(int64_t)(e->tsc - origin) / ticks_per_ns / 1e3;
+      printf(",\n{\"ph\":\"%c\",%s\"name\":\"%s\",\"pid\":1,\"tid\":%lld,\"ts\":%.3lf,"
+             "\"args\":{\"seqID\":%lld,\"size\":%u",
+             ph, ph == 'i' ? "\"s\":\"t\"," : "", name, (long long)threads[t].tid, ts,
+             (long long)e->seqID, (unsigned)e->size);
+      if (e->id == AMB_TRACE_DISPATCH_BEGIN || e->id == AMB_TRACE_DISPATCH_END || e->aux != 0)
+        printf(",\"method\":%u", (unsigned)e->aux);
+      printf("}}");
+    }
+  }
+  printf("\n]}\n");
+  return 0;
+}
@@ -0,0 +1,515 @@
+
+// -----------------------------------------------------------------------------
+// A stand-in ImmortalCoordinator, for benchmarking and testing clients
+// without the .NET coordinator, its storage, or its disk.
+// -----------------------------------------------------------------------------
+
+// It speaks the client side of AMBROSIA_client_network_protocol.md to
+// one or more clients:
+//
+//  * the first-start handshake: send TakeBecomingPrimaryCheckpoint,
+//    then receive an InitialMessage (echoed back, as the coordinator
+//    does) and a Checkpoint;
+//  * log records with real check bytes and increasing sequence IDs;
+//  * outgoing RPCs are delivered to the client named by their
+//    destination (the sender itself for "" or its own name).  Unknown
+//    destinations are echoed to the sender, or dropped with -u drop;
+//  * consecutive RPCs for a client are packed into RPCBatch messages;
+//  * TakeCheckpoint every -k milliseconds (one outstanding at a time).
+//
+// Each record is appended to an in-memory log (-l memory) or not kept
+// at all (-l null).  Nothing ever touches the disk.
+//
+// Usage: mock_coordinator.exe [options] name:upport:downport ...
+//
+// The ports are the ones the client is started with: the client
+// connects to upport and listens on downport.
+
+// Linux only.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "ambrosia/client.h"
+
+#define MAX_CLIENTS 16
+#define READ_CHUNK (256 * 1024)
+
+// Options:
+static int     g_batch_max   = 1024;          // -b: RPCs per RPCBatch (1: no batching)
+static int     g_record_max  = 1024 * 1024;   // -r: payload bytes per record
+static int     g_ckpt_ms     = 0;             // -k: TakeCheckpoint period (0: never)
+static int     g_keep_log    = 1;             // -l memory|null
+static int64_t g_log_max     = 1LL << 30;     // -m: in-memory log cap, in MiB
+static int     g_drop_unknown = 0;            // -u echo|drop
+static int     g_verbose     = 0;             // -v
+
+static volatile sig_atomic_t g_stop = 0;
+
+struct buf {
+  char*   data;
+  int64_t len;
+  int64_t cap;
+};
+
+static void buf_reserve(struct buf* b, int64_t more) {
+  if (b->len + more <= b->cap) return;
+  int64_t cap = b->cap ? b->cap : 64 * 1024;
+  while (cap < b->len + more) cap *= 2;
+  b->data = (char*)realloc(b->data, cap);
+  if (b->data == NULL) {
+    fprintf(stderr, "ERROR: mock coordinator out of memory (%lld bytes)\n", (long long)cap);
+    abort();
+  }
+  b->cap = cap;
+}
+
+static void buf_append(struct buf* b, const void* src, int64_t n) {
+  if (n == 0) return;
+  buf_reserve(b, n);
+  memcpy(b->data + b->len, src, n);
+  b->len += n;
+}
+
+struct mock_client {
+  char name[64];
+  int  name_len;
+  int  up_port, down_port;
+  int  listen_fd;
+  int  up_fd;    // We receive on this one...
+  int  down_fd;  // ...and send log records on this one.
+  int  open;
+
+  int32_t commit_id;
+  int64_t seq;
+
+  struct buf in;         // Unparsed bytes from the client.
+  int64_t    ckpt_skip;  // Checkpoint blob bytes still to discard.
+  int        started;    // Received the startup checkpoint.
+  int        ckpt_outstanding;
+
+  struct buf pend;       // Messages waiting to go into a record.
+  struct buf out;        // Records waiting for the socket.
+  int64_t    out_off;
+  struct buf log;
+
+  // Counters:
+  int64_t msgs_in, bytes_in;
+  int64_t rpcs_out, records_out, batches_out, bytes_out;
+  int64_t ckpts_requested, ckpts_received, ckpt_bytes;
+  int64_t log_trims;
+};
+
+static struct mock_client g_clients[MAX_CLIENTS];
+static int g_nclients = 0;
+
+static int64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void on_signal(int sig) { (void)sig; g_stop = 1; }
+
+
+// Building log records
+//------------------------------------------------------------------------------
+
+// Queue one message (type + data) for delivery to a client.
+static void queue_message(struct mock_client* c, char type, const char* data, int len) {
+  char hdr[6];
+  char* cur = (char*)write_zigzag_int(hdr, len + 1);
+  *cur++ = type;
+  buf_append(&c->pend, hdr, cur - hdr);
+  buf_append(&c->pend, data, len);
+}
+
+// Wrap a payload in a log header and queue it on the socket (and log).
+static void emit_record(struct mock_client* c, const char* payload, int len) {
+  struct log_hdr hdr;
+  hdr.commitID  = c->commit_id;
+  hdr.totalSize = AMBROSIA_HEADERSIZE + len;
+  hdr.checksum  = amb_check_bytes(payload, len);
+  hdr.seqID     = c->seq++;
+  buf_append(&c->out, &hdr, AMBROSIA_HEADERSIZE);
+  buf_append(&c->out, payload, len);
+  c->records_out++;
+  c->bytes_out += hdr.totalSize;
+  if (g_keep_log) {
+    if (c->log.len + hdr.totalSize > g_log_max) {
+      c->log.len = 0; // Pretend everything so far was checkpointed and trimmed.
+      c->log_trims++;
+    }
+    buf_append(&c->log, &hdr, AMBROSIA_HEADERSIZE);
+    buf_append(&c->log, payload, len);
+  }
+}
+
+// Turn the pending messages into records.  Runs of RPCs are packed into
+// RPCBatch messages; every other message gets a record of its own.
+static void flush_pending(struct mock_client* c) {
+  static struct buf rec;
+  char* cur = c->pend.data;
+  char* end = c->pend.data + c->pend.len;
+  while (cur < end) {
+    int32_t size;
+    char* body = (char*)read_zigzag_int(cur, &size);
+    if (body[0] != RPC || g_batch_max <= 1) {
+      emit_record(c, cur, (int)(body + size - cur));
+      if (body[0] == RPC) c->rpcs_out++;
+      cur = body + size;
+      continue;
+    }
+    // Gather a run of RPCs:
+    char* run = cur;
+    int count = 0;
+    while (cur < end && count < g_batch_max) {
+      char* b = (char*)read_zigzag_int(cur, &size);
+      if (b[0] != RPC) break;
+      if (count > 0 && (b + size) - run > g_record_max) break;
+      cur = b + size;
+      count++;
+    }
+    c->rpcs_out += count;
+    if (count == 1) {
+      emit_record(c, run, (int)(cur - run));
+      continue;
+    }
+    int runlen = (int)(cur - run);
+    rec.len = 0;
+    buf_reserve(&rec, runlen + 16);
+    char* w = (char*)write_zigzag_int(rec.data, 1 + zigzag_int_size(count) + runlen);
+    *w++ = RPCBatch;
+    w = (char*)write_zigzag_int(w, count);
+    memcpy(w, run, runlen);
+    emit_record(c, rec.data, (int)(w + runlen - rec.data));
+    c->batches_out++;
+  }
+  c->pend.len = 0;
+}
+
+
+// Handling what clients send
+//------------------------------------------------------------------------------
+
+static struct mock_client* find_client(const char* name, int len) {
+  for (int i = 0; i < g_nclients; i++)
+    if (g_clients[i].name_len == len && memcmp(g_clients[i].name, name, len) == 0)
+      return &g_clients[i];
+  return NULL;
+}
+
+// An outgoing RPC: [destLen][dest][incoming RPC]
+static void route_rpc(struct mock_client* c, char* data, int len) {
+  int32_t dest_len;
+  char* dest = (char*)read_zigzag_int(data, &dest_len);
+  char* rpc = dest + dest_len;
+  struct mock_client* to = dest_len == 0 ? c : find_client(dest, dest_len);
+  if (to == NULL) {
+    if (g_drop_unknown) return;
+    to = c;
+  }
+  if (!to->open) return;
+  queue_message(to, RPC, rpc, (int)(data + len - rpc));
+}
+
+// One complete message of the given type.
+static void handle_message(struct mock_client* c, char type, char* data, int len) {
+  c->msgs_in++;
+  switch (type) {
+  case RPC:
+    route_rpc(c, data, len);
+    break;
+  case RPCBatch:
+    { int32_t count;
+      char* cur = (char*)read_zigzag_int(data, &count);
+      for (int i = 0; i < count; i++) {
+        int32_t size;
+        char* body = (char*)read_zigzag_int(cur, &size);
+        handle_message(c, body[0], body + 1, size - 1);
+        cur = body + size;
+      }
+    }
+    break;
+  case InitialMessage:
+    queue_message(c, InitialMessage, data, len);
+    break;
+  case AttachTo:
+    if (g_verbose)
+      printf(" mock: %s attaches to %.*s\n", c->name, len, data);
+    break;
+  case Checkpoint:
+    memcpy(&c->ckpt_skip, data, 8);
+    c->ckpts_received++;
+    c->ckpt_bytes += c->ckpt_skip;
+    c->ckpt_outstanding = 0;
+    if (!c->started && g_verbose)
+      printf(" mock: %s has started (checkpoint of %lld bytes)\n", c->name, (long long)c->ckpt_skip);
+    c->started = 1;
+    break;
+  default:
+    fprintf(stderr, "ERROR: mock coordinator: unexpected message type %d from %s\n", type, c->name);
+    abort();
+  }
+}
+
+// Decode a zig-zag int that may not have fully arrived yet.
+// RETURN: the encoded length, or 0 if more bytes are needed.
+static int peek_zigzag_int(const char* p, int64_t avail, int32_t* out) {
+  uint32_t raw = 0;
+  for (int i = 0; i < 5 && i < avail; i++) {
+    raw |= (uint32_t)(p[i] & 0x7f) << (7 * i);
+    if ((p[i] & 0x80) == 0) {
+      *out = (int32_t)((raw >> 1) ^ -(raw & 1));
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// Handle every complete message received so far.
+static void parse_input(struct mock_client* c) {
+  char* cur = c->in.data;
+  char* end = c->in.data + c->in.len;
+  while (cur < end) {
+    if (c->ckpt_skip > 0) {
+      int64_t n = end - cur < c->ckpt_skip ? end - cur : c->ckpt_skip;
+      cur += n;
+      c->ckpt_skip -= n;
+      continue;
+    }
+    int32_t size;
+    int hl = peek_zigzag_int(cur, end - cur, &size);
+    if (hl == 0 || end - cur < hl + size) break;
+    handle_message(c, cur[hl], cur + hl + 1, size - 1);
+    cur += hl + size;
+  }
+  int64_t used = cur - c->in.data;
+  memmove(c->in.data, cur, c->in.len - used);
+  c->in.len -= used;
+}
+
+
+// Sockets
+//------------------------------------------------------------------------------
+
+static void set_nodelay(int fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void listen_up(struct mock_client* c) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(c->up_port);
+  int one = 1;
+  c->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(c->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(c->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(c->listen_fd, 1) < 0) {
+    fprintf(stderr, "ERROR: mock coordinator could not listen on port %d: %s\n",
+            c->up_port, strerror(errno));
+    abort();
+  }
+}
+
+// Accept the client's connection, then connect back to it, retrying
+// while it gets its own listening socket ready.
+static void connect_client(struct mock_client* c) {
+  c->up_fd = accept(c->listen_fd, NULL, NULL);
+  if (c->up_fd < 0) {
+    fprintf(stderr, "ERROR: mock coordinator accept failed: %s\n", strerror(errno));
+    abort();
+  }
+  close(c->listen_fd);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(c->down_port);
+  for (int tries = 0; ; tries++) {
+    c->down_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(c->down_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) break;
+    close(c->down_fd);
+    if (tries == 1000) {
+      fprintf(stderr, "ERROR: mock coordinator could not connect to %s on port %d\n",
+              c->name, c->down_port);
+      abort();
+    }
+    usleep(10 * 1000);
+  }
+  set_nodelay(c->up_fd);
+  set_nodelay(c->down_fd);
+  fcntl(c->down_fd, F_SETFL, fcntl(c->down_fd, F_GETFL) | O_NONBLOCK);
+  c->open = 1;
+  printf(" mock: %s connected (up %d, down %d)\n", c->name, c->up_port, c->down_port);
+
+  // Starting for the first time:
+  queue_message(c, TakeBecomingPrimaryCheckpoint, NULL, 0);
+  flush_pending(c);
+}
+
+static void close_client(struct mock_client* c) {
+  close(c->up_fd);
+  close(c->down_fd);
+  c->open = 0;
+  if (g_verbose) printf(" mock: %s disconnected\n", c->name);
+}
+
+// Write as much queued output as the socket takes.
+static void send_output(struct mock_client* c) {
+  while (c->out_off < c->out.len) {
+    ssize_t n = send(c->down_fd, c->out.data + c->out_off, c->out.len - c->out_off, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+      if (errno == EINTR) continue;
+      close_client(c); // The client went away.
+      return;
+    }
+    c->out_off += n;
+  }
+  c->out.len = c->out_off = 0;
+}
+
+static void receive_input(struct mock_client* c) {
+  buf_reserve(&c->in, READ_CHUNK);
+  ssize_t n = recv(c->up_fd, c->in.data + c->in.len, READ_CHUNK, 0);
+  if (n <= 0) {
+    if (n < 0 && errno == EINTR) return;
+    close_client(c);
+    return;
+  }
+  c->in.len += n;
+  c->bytes_in += n;
+  parse_input(c);
+}
+
+static void print_summary() {
+  for (int i = 0; i < g_nclients; i++) {
+    struct mock_client* c = &g_clients[i];
+    printf(" *X* mock %s: in %lld msgs %lld bytes; out %lld rpcs %lld records %lld batches %lld bytes;"
+           " checkpoints %lld/%lld (%lld bytes); log %lld bytes (%lld trims)\n",
+           c->name, (long long)c->msgs_in, (long long)c->bytes_in,
+           (long long)c->rpcs_out, (long long)c->records_out, (long long)c->batches_out,
+           (long long)c->bytes_out, (long long)c->ckpts_received, (long long)c->ckpts_requested,
+           (long long)c->ckpt_bytes, (long long)c->log.len, (long long)c->log_trims);
+  }
+  fflush(stdout);
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] name:upport:downport ...\n"
+          "  -b N          pack up to N RPCs into one RPCBatch (default %d; 1 disables)\n"
+          "  -r BYTES      largest record payload when batching (default %d)\n"
+          "  -k MS         send TakeCheckpoint every MS milliseconds (default: never)\n"
+          "  -l memory|null  keep records in an in-memory log, or not at all (default memory)\n"
+          "  -m MIB        cap on the in-memory log per client (default %lld)\n"
+          "  -u echo|drop  RPCs to unknown destinations go back to the sender, or nowhere\n"
+          "  -v            verbose\n",
+          prog, g_batch_max, g_record_max, (long long)(g_log_max >> 20));
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "b:r:k:l:m:u:v")) != -1) {
+    switch (opt) {
+    case 'b': g_batch_max  = atoi(optarg); break;
+    case 'r': g_record_max = atoi(optarg); break;
+    case 'k': g_ckpt_ms    = atoi(optarg); break;
+    case 'l':
+      if      (strcmp(optarg, "memory") == 0) g_keep_log = 1;
+      else if (strcmp(optarg, "null") == 0)   g_keep_log = 0;
+      else usage(argv[0]);
+      break;
+    case 'm': g_log_max = (int64_t)atoi(optarg) << 20; break;
+    case 'u':
+      if      (strcmp(optarg, "echo") == 0) g_drop_unknown = 0;
+      else if (strcmp(optarg, "drop") == 0) g_drop_unknown = 1;
+      else usage(argv[0]);
+      break;
+    case 'v': g_verbose = 1; break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind == argc || argc - optind > MAX_CLIENTS) usage(argv[0]);
+
+  for (int i = optind; i < argc; i++) {
+    struct mock_client* c = &g_clients[g_nclients];
+    if (sscanf(argv[i], "%63[^:]:%d:%d", c->name, &c->up_port, &c->down_port) != 3)
+      usage(argv[0]);
+    c->name_len  = strlen(c->name);
+    c->commit_id = g_nclients + 1;
+    c->seq       = 1;
+    g_nclients++;
+  }
+  setvbuf(stdout, NULL, _IOLBF, 0); // Progress lines, even into a pipe.
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Listen on every port first, so clients may start in any order.
+  for (int i = 0; i < g_nclients; i++) listen_up(&g_clients[i]);
+  for (int i = 0; i < g_nclients; i++) connect_client(&g_clients[i]);
+
+  int64_t next_ckpt = g_ckpt_ms > 0 ? now_ms() + g_ckpt_ms : INT64_MAX;
+  struct pollfd fds[2 * MAX_CLIENTS];
+  while (!g_stop) {
+    int nfds = 0, nopen = 0;
+    for (int i = 0; i < g_nclients; i++) {
+      struct mock_client* c = &g_clients[i];
+      if (!c->open) continue;
+      nopen++;
+      fds[nfds].fd = c->up_fd;   fds[nfds].events = POLLIN;  nfds++;
+      fds[nfds].fd = c->down_fd; fds[nfds].events = c->out.len > c->out_off ? POLLOUT : 0; nfds++;
+    }
+    if (nopen == 0) break;
+    int64_t now = now_ms();
+    int timeout = next_ckpt == INT64_MAX ? -1 : (int)(next_ckpt > now ? next_ckpt - now : 0);
+    if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+      perror("poll");
+      abort();
+    }
+    int k = 0;
+    for (int i = 0; i < g_nclients; i++) {
+      struct mock_client* c = &g_clients[i];
+      if (!c->open) continue;
+      if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) receive_input(c);
+      k += 2;
+    }
+    if (now_ms() >= next_ckpt) {
+      for (int i = 0; i < g_nclients; i++) {
+        struct mock_client* c = &g_clients[i];
+        if (!c->open || !c->started || c->ckpt_outstanding) continue;
+        queue_message(c, TakeCheckpoint, NULL, 0);
+        c->ckpt_outstanding = 1;
+        c->ckpts_requested++;
+      }
+      next_ckpt = now_ms() + g_ckpt_ms;
+    }
+    // Deliver everything that became ready in this round:
+    for (int i = 0; i < g_nclients; i++) {
+      struct mock_client* c = &g_clients[i];
+      if (!c->open) continue;
+      if (c->pend.len > 0) flush_pending(c);
+      send_output(c);
+    }
+  }
+  print_summary();
+  return 0;
+}
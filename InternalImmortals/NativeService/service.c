@@ -31,6 +31,7 @@
   // Unix variants, but really just Linux for now:
   #include <alloca.h>
   #include <pthread.h> 
+  #include <sys/select.h>
 #endif
 
 
@@ -40,6 +41,7 @@
 
 // Extra utilities (print_hex_bytes, amb_socket_send_all):
 #include "ambrosia/internal/bits.h"
+#include "ambrosia/histogram.h"
 
 // Library-level global variables:
 // --------------------------------------------------
@@ -49,9 +51,22 @@
 
 int g_is_sender = -1;     // IVar semantics - set once.
 int g_pingpong_mode = 0;  // IVar semantics - set once.
-int g_pingpong_count = 0;
+int g_pingpong_count = 0; // Replies received.
 int g_total_pingpongs = 20000;
-double* g_pingpong_latencies = NULL; // Array of latencies.
+
+// Ping-pong pacing.  With a zero rate the sender runs CLOSED loop: each
+// reply releases the next ping.  With a target rate it runs OPEN loop:
+// ping i is due at start + i/rate whether or not earlier replies have
+// arrived, up to g_pingpong_outstanding in flight.  Every ping carries
+// its intended send time, and latency is measured from that, so a
+// stall (ours or the system's) is charged to every ping it delays
+// rather than hidden by sending them late.
+double  g_pingpong_rate = 0.0;     // Target pings per second; 0 = closed loop.
+int     g_pingpong_outstanding = 1; // Most pings in flight at once.
+int     g_pingpong_sent = 0;
+int64_t g_pingpong_start_ns = 0;
+int64_t g_pingpong_late = 0;       // Pings held back by the outstanding limit.
+struct amb_histogram g_pingpong_hist; // Nanoseconds from intended send to reply.
 
 int g_waiting_final_ack = 0;
 
@@ -108,10 +123,12 @@ int destLen;    // Initialized below..
 enum MethodTable { STARTUP_ID=32, TPUT_MSG_ID=33, ACK_MSG_ID=34 };
 
 // RPC proxies for remote methods:
-void send_ack();
+void send_ack(void* args, int argsLen);
 
-void receive_ack(int numRPCBytes);
+void receive_ack(int numRPCBytes, char* args, int argsLen);
 void end_round(int numRPCBytes);
+void print_pingpong_summary();
+void pingpong_begin();
 
 // Call send_message in a loop.
 void send_loop( int numRPCBytes )
@@ -186,7 +203,7 @@ static inline void set_total_expected() {
   g_totalExpected = bytesPerRound / g_numRPCBytes;
   if (PREFILL) {
     g_totalExpected *= 2;
-    amb_debug_log("because of PREFILL mode, expecting double (%d) messages", g_totalExpected);
+    amb_debug_log("because of PREFILL mode, expecting double (%lld) messages\n", (long long)g_totalExpected);
   }
   assert(g_totalExpected >= 1);
 }
@@ -207,12 +224,12 @@ void receive_message(char* msg, int64_t len) {
   
   amb_debug_log("GOT THE MESSAGE: %ld bytes, %ld remaining expected messages this round\n", len, g_totalExpected);
 #ifdef AMBCLIENT_DEBUG
-  if ( len != g_numRPCBytes ) {
+  if ( !g_pingpong_mode && len != g_numRPCBytes ) {
     fprintf(stderr,"\nError: expected message of size %d this round, received %lld\n",
             g_numRPCBytes, (long long)len);
     abort();
   }
-  for(int i=0; i<len; i++) {
+  for(int i=0; i<len && !g_pingpong_mode; i++) {
     if (msg[i] != (char)i) {
       fprintf(stderr,"\nError: byte %d of received message was %d, expected %d\n", i, msg[i], i);
       abort();
@@ -222,8 +239,11 @@ void receive_message(char* msg, int64_t len) {
 
   if(g_totalExpected == 0) {
     amb_debug_log(" That's all the expected messages this round.\n");
-    if (SEND_ACK || g_pingpong_mode) {
-      send_ack();
+    if (g_pingpong_mode) {
+      send_ack(msg, len); // Echo the ping's timestamp.
+      amb_debug_log("Sent ACK.\n");
+    } else if (SEND_ACK) {
+      send_ack(NULL, 0);
       amb_debug_log("Sent ACK.\n");
     }
     if (advance_round()) {
@@ -235,7 +255,7 @@ void receive_message(char* msg, int64_t len) {
       printf("Finished last round of this experiment\n");
       if (! SEND_ACK) {
 	printf("Since we are not sending ACKs of every round, send a final shut-down ACK..\n");
-	send_ack();
+	send_ack(NULL, 0);
       }
       g_client_terminating = 1; // exit_or_restart();
     }
@@ -245,7 +265,10 @@ void receive_message(char* msg, int64_t len) {
 // FIXME: add g_numRPCBytes as an argument to startup....
 // startup a ROUND.  Called once per round.
 void startup() {
-  if (g_is_sender || destLen == 0) {
+  if (g_is_sender && g_pingpong_mode) {
+    if (g_moderate_chatter) printf("   Sender starting %d ping-pongs\n", g_total_pingpongs);
+    pingpong_begin();
+  } else if (g_is_sender || destLen == 0) {
     if (g_moderate_chatter) printf("   Sender starting this round, g_numRPCBytes = %d\n", g_numRPCBytes);
     send_loop( g_numRPCBytes );
     if (g_moderate_chatter) printf("   send_loop finished, waiting for ACK...\n");    
@@ -276,8 +299,7 @@ void end_round(int numRPCBytes) {
     char sendbuf[16];
     char* endbuf = amb_write_outgoing_rpc(sendbuf, "", 0, 0, STARTUP_ID, 1, NULL,0);
 
-    // Audit: is this needed?
-    amb_socket_send_all(g_to_immortal_coord, sendbuf, endbuf-sendbuf, 0);
+    amb_client_send_bytes(amb_default_client(), sendbuf, endbuf-sendbuf);
   } else {
     if (SEND_ACK) {
       printf("Finished last round, exiting...\n");
@@ -289,33 +311,87 @@ void end_round(int numRPCBytes) {
   }
 }
 
+// Ping-pong sender
+// --------------------------------------------------
+
+// A ping's argument is its intended send time (CLOCK_MONOTONIC
+// nanoseconds), which the receiver echoes back in its ACK.
+void send_ping(int64_t intended_ns) {
+  char sendbuf[16 + 256 + sizeof(int64_t)];
+  if (destLen > 256) {
+    fprintf(stderr, "ERROR: send_ping, destination (%d) too long\n", destLen);
+    abort();
+  }
+  char* newpos = amb_write_outgoing_rpc(sendbuf, destName, destLen, 0, TPUT_MSG_ID, 1,
+                                        &intended_ns, sizeof(intended_ns));
+  amb_client_send_bytes(amb_default_client(), sendbuf, newpos-sendbuf);
+  g_pingpong_sent++;
+}
+
+// Send every ping that is due and within the outstanding limit.
+//
+// RETURN: the time the next ping falls due, or -1 if there is nothing
+// to wait for but replies (all pings sent, or the limit reached).
+int64_t pingpong_pump() {
+  if (g_pingpong_start_ns == 0) return -1; // Not started yet.
+  while (g_pingpong_sent < g_total_pingpongs) {
+    if (g_pingpong_sent - g_pingpong_count >= g_pingpong_outstanding)
+      return -1;
+    int64_t now = amb_monotonic_ns();
+    int64_t due = now;
+    if (g_pingpong_rate > 0) {
+      due = g_pingpong_start_ns + (int64_t)((double)g_pingpong_sent * 1e9 / g_pingpong_rate);
+      if (due > now) return due;
+      if (now - due > 1000000) g_pingpong_late++; // Over 1ms behind schedule.
+    }
+    send_ping(due);
+  }
+  return -1;
+}
+
+void pingpong_begin() {
+  attach_if_needed(destName, destLen); // Hard-coded global dest name.
+  g_pingpong_start_ns = amb_monotonic_ns();
+  pingpong_pump();
+}
+
+// Wait until the coordinator has bytes for us, or until deadline_ns.
+// RETURN: nonzero if there is something to read.
+int wait_readable(int fd, int64_t deadline_ns) {
+  int64_t left = deadline_ns - amb_monotonic_ns();
+  if (left <= 0) return 0;
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+  struct timeval tv;
+  tv.tv_sec  = (long)(left / 1000000000);
+  tv.tv_usec = (long)(left % 1000000000 / 1000);
+  return select(fd + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
 // Sender side.
-void receive_ack(int numRPCBytes) {
+void receive_ack(int numRPCBytes, char* args, int argsLen) {
   if (g_waiting_final_ack) {
     printf("  Sender received final shutdown ACK, shutting down\n");
     g_client_terminating = 1; // exit_or_restart();
   }
   else if (g_pingpong_mode) {
-    assert(numRPCBytes == 1);
-    double duration = amb_current_time_seconds() - g_startTimeRound;
-    assert(g_pingpong_count < g_total_pingpongs);
-    g_pingpong_latencies[g_pingpong_count] = duration;
-    amb_debug_log("Logged result from ping pong %d: %lf\n", g_pingpong_count, duration);    
+    int64_t intended_ns;
+    if (argsLen != sizeof(intended_ns)) {
+      fprintf(stderr, "ERROR: ping-pong ACK carries %d bytes, expected a timestamp\n", argsLen);
+      abort();
+    }
+    memcpy(&intended_ns, args, sizeof(intended_ns));
+    int64_t latency = amb_monotonic_ns() - intended_ns;
+    amb_hist_record(&g_pingpong_hist, latency);
+    amb_debug_log("Logged result from ping pong %d: %ld ns\n", g_pingpong_count, (long)latency);
     g_pingpong_count++;
-    
-    if (advance_round()) {
-      amb_debug_log("advance_round said we should do more pingpongs, call send_loop\n");
-      send_loop(1);
+
+    if (g_pingpong_count < g_total_pingpongs) {
+      pingpong_pump(); // A reply may free a slot under the outstanding limit.
     } else {
       printf("Time to shut down these ping-pongs..\n");
-      printf("Last 10000 Microsecond latencies:\n");
-      int start = g_total_pingpongs - 10000;
-      if (start < 0) start=0;
-      for(int i= start; i<g_total_pingpongs; i++) {
-	printf("%d ", (int)(g_pingpong_latencies[i] * 1000.0 * 1000.0));
-	if(i % 500 == 0) fflush(stdout);
-      }
-      printf("\n");
+      print_pingpong_summary();
       fflush(stdout);
       exit(0); // HACK
     }
@@ -342,37 +418,22 @@ void bounce(int64_t n) {
 // Everything in this section should, in principle, be automatically GENERATED:
 //------------------------------------------------------------------------------
 
-void send_ack() {
-  char sendbuf[16];
-  char* newpos = amb_write_outgoing_rpc(sendbuf, destName, destLen, 0, ACK_MSG_ID, 1, NULL, 0);
-  amb_socket_send_all(g_to_immortal_coord, sendbuf, newpos-sendbuf, 0);
+void send_ack(void* args, int argsLen) {
+  char sendbuf[16 + 256 + 16];
+  if (destLen > 256 || argsLen > 16) {
+    fprintf(stderr, "ERROR: send_ack, destination (%d) or args (%d) too long\n", destLen, argsLen);
+    abort();
+  }
+  char* newpos = amb_write_outgoing_rpc(sendbuf, destName, destLen, 0, ACK_MSG_ID, 1, args, argsLen);
+  amb_client_send_bytes(amb_default_client(), sendbuf, newpos-sendbuf);
 }
 
 void send_dummy_checkpoint(int upfd) {
   const char* dummy_checkpoint = "dummyckpt";
-  int strsize = strlen(dummy_checkpoint);
-
-  // New protocol, the payload is just a 64 bit size:
-  int   msgsize = 1 + 8;
-  char* buf = alloca(msgsize + 5 + strsize);
-  char* bufcur = write_zigzag_int(buf, msgsize); // Size (including type tag)
-  *bufcur++ = Checkpoint;                        // Type
-  *((int64_t*)bufcur) = strsize;                 // 8 byte size
-  bufcur += 8;
-  
-  assert(bufcur-buf == 9 + zigzag_int_size(msgsize)); 
-
-  // Then write the checkpoint itself AFTER the regular message:
-  bufcur += sprintf(bufcur, "%s", dummy_checkpoint); // Dummy checkpoint.
-
-  amb_socket_send_all(upfd, buf, bufcur-buf, 0);
-  
-#ifdef AMBCLIENT_DEBUG  
-  amb_debug_log("  Trivial checkpoint message sent to coordinator (%lld bytes), checkpoint %d bytes\n",
-                (int64_t)(bufcur-buf), strsize);
-  amb_debug_log("    Message was: ");
-  print_hex_bytes(amb_dbg_fd,buf, bufcur-buf); fprintf(amb_dbg_fd,"\n");
-#endif
+  // The runtime writes the Checkpoint message (whose payload is just a
+  // 64 bit size) and then the checkpoint itself, in order with our
+  // other outgoing messages:
+  amb_client_send_checkpoint(amb_current_client(), dummy_checkpoint, strlen(dummy_checkpoint));
 }
 
 
@@ -391,7 +452,7 @@ void amb_dispatch_method(int32_t methodID, void* args, int argsLen) {
     break;
     
   case ACK_MSG_ID:
-    receive_ack( g_numRPCBytes );
+    receive_ack( g_numRPCBytes, (char*)args, argsLen );
     break;
 
   default:
@@ -442,15 +503,18 @@ void normal_processing_loop(int upfd, int downfd)
   int round = 0;
   while (!g_client_terminating) {
     amb_debug_log("Normal processing (iter %d): receive next log header..\n", round++);
-    amb_recv_log_hdr(downfd, &hdr);
+    // An open-loop sender keeps to its schedule while it waits for replies:
+    if (g_pingpong_mode && g_is_sender && g_pingpong_rate > 0) {
+      int64_t due;
+      while ((due = pingpong_pump()) >= 0 && !wait_readable(downfd, due)) ;
+    }
+    amb_client_recv(amb_default_client(), &hdr, AMBROSIA_HEADERSIZE);
 
     int payloadsize = hdr.totalSize - AMBROSIA_HEADERSIZE;
     char* buf = calloc(payloadsize, 1);
-    recv(downfd, buf, payloadsize, MSG_WAITALL);
-#ifdef AMBCLIENT_DEBUG  
-    amb_debug_log("Entire Message Payload (%d bytes): ", payloadsize);
-    print_hex_bytes(amb_dbg_fd,buf, payloadsize); fprintf(amb_dbg_fd,"\n");
-#endif
+    amb_client_recv(amb_default_client(), buf, payloadsize);
+    amb_debug_log("Entire Message Payload (%d bytes):\n", payloadsize);
+    amb_log_hex(AMB_LOG_DEBUG, "  ", buf, payloadsize);
 
     // Read a stream of messages from the log record:
     int rawsize = 0;
@@ -459,7 +523,7 @@ void normal_processing_loop(int upfd, int downfd)
     int ind = 0;
     while (bufcur < limit) {
       amb_debug_log(" Processing message %d in log record, starting at offset %d (%p), remaining bytes %d\n",
-		    ind++, bufcur-buf, bufcur, limit-bufcur);
+		    ind++, (int)(bufcur-buf), bufcur, (int)(limit-bufcur));
       bufcur = read_zigzag_int(bufcur, &rawsize);  // Size
       char tag = *bufcur++;                      // Type
       rawsize--; // Discount type byte.
@@ -483,7 +547,7 @@ void normal_processing_loop(int upfd, int downfd)
 	  char* batchstart = bufcur;
 	  for (int i=0; i < numMsgs; i++) {
 	    amb_debug_log(" Reading off message %d/%d of batch, current offset %d, bytes left: %d.\n",
-			  i+1, numMsgs, bufcur-batchstart, rawsize);
+			  i+1, numMsgs, (int)(bufcur-batchstart), rawsize);
 	    char* lastbufcur = bufcur;
 	    int32_t msgsize = -100;
 	    bufcur = read_zigzag_int(bufcur, &msgsize);  // Size (unneeded)	    
@@ -512,8 +576,9 @@ void normal_processing_loop(int upfd, int downfd)
   if (g_trials_remaining == 0) {
     printf(" *** processing loop: Last trial finished; exiting.\n");
     if (! g_is_sender) {
-      printf("Receiver exiting after a moderate wait...\n");
-      amb_sleep_seconds(30); // Uh.....
+      printf("Receiver exiting once its last messages are sent...\n");
+      if (!amb_flush(30000))
+        fprintf(stderr, "WARNING: exiting with messages still unsent\n");
     }
     exit(0);
   } else {
@@ -550,17 +615,53 @@ void reset_trial_state() {
     g_is_dummy_round = 0;    
     g_numRPCBytes = 1;
     g_pingpong_count = 0;
-    if (g_pingpong_latencies != NULL) free(g_pingpong_latencies);
-    g_pingpong_latencies = (double*)calloc(sizeof(double), g_total_pingpongs);
+    g_pingpong_sent = 0;
+    g_pingpong_late = 0;
+    g_pingpong_start_ns = 0;
+    amb_hist_reset(&g_pingpong_hist);
   }
 }
 
 
+void print_latency_profile(const struct amb_latency_profile* p) {
+  printf(" *** LATENCY PROFILE: cpus %d/%d (processing/network), numa %d, nodelay %d, quickack %d,"
+         " busy_poll %dus, sized bufs %d, busy reads %d\n",
+         p->processing_cpu, p->network_cpu, p->numa_node, p->tcp_nodelay, p->tcp_quickack,
+         p->busy_poll_usec, p->size_socket_buffers, p->busy_poll_reads);
+}
+
+// Print the latency distribution, then a one-line summary so runs with
+// different latency profiles and rates can be compared directly.
+void print_pingpong_summary() {
+  const struct amb_histogram* h = &g_pingpong_hist;
+  if (h->count == 0) return;
+  static const double pcts[] = { 50, 75, 90, 95, 99, 99.9, 99.99 };
+  double secs = (double)(amb_monotonic_ns() - g_pingpong_start_ns) / 1e9;
+  double achieved = (double)h->count / secs;
+  printf(" *** Ping-pong: %s loop, target rate %.0lf/s, achieved %.0lf/s, outstanding limit %d,"
+         " %ld pings over 1ms behind schedule\n",
+         g_pingpong_rate > 0 ? "open" : "closed", g_pingpong_rate, achieved,
+         g_pingpong_outstanding, (long)g_pingpong_late);
+  printf(" *** Microsecond latencies from intended send time, by percentile:\n");
+  printf("   %8s  %10.1lf\n", "min", h->min / 1e3);
+  for (int i = 0; i < (int)(sizeof(pcts) / sizeof(pcts[0])); i++)
+    printf("   %8.2lf  %10.1lf\n", pcts[i], amb_hist_percentile(h, pcts[i]) / 1e3);
+  printf("   %8s  %10.1lf\n", "max", h->max / 1e3);
+  const char* prof = getenv("AMBROSIA_LATENCY_PROFILE");
+  printf(" *X*  PINGPONG_RTT_US  profile %s  n %ld  p50 %.1lf  p90 %.1lf  p99 %.1lf  p99.9 %.1lf"
+         "  max %.1lf  mean %.1lf  rate %.0lf\n",
+         prof != NULL ? prof : "default", (long)h->count,
+         amb_hist_percentile(h, 50) / 1e3, amb_hist_percentile(h, 90) / 1e3,
+         amb_hist_percentile(h, 99) / 1e3, amb_hist_percentile(h, 99.9) / 1e3,
+         h->max / 1e3, amb_hist_mean(h) / 1e3, achieved);
+}
+
 int main(int argc, char** argv)
 {
   // How big to allocate the buffer:
   int buffer_bytes_allocated = -1; // Ivar semantics - write once.  
   int upport, downport;
+  int roundsz = -1;
   
   srand(time(0));
   
@@ -581,7 +682,8 @@ int main(int argc, char** argv)
     argc--;
   }
   if (argc == 6) {
-    bytesPerRound = 1 << atoi(argv[5]);
+    roundsz = atoi(argv[5]);
+    bytesPerRound = (int64_t)1 << roundsz;
     argc--;
   }
   if (argc == 5) {
@@ -606,10 +708,29 @@ int main(int argc, char** argv)
     fprintf(stderr, "  optional [trials] argument repeats the entire experiment\n");    
     fprintf(stderr, "  optional [bufsz] is the log base 2 of the buffer byte size\n");
     fprintf(stderr, "  \n");    
-    fprintf(stderr, "  NOTE: in ping-pong mode [roundsz] determines the number of pingpongs written to pingpongs.txt\n");
+    fprintf(stderr, "  NOTE: in ping-pong mode [roundsz] is the log base 2 of the number of pingpongs\n");
+    fprintf(stderr, "  Set AMBROSIA_PINGPONG_RATE (pings/sec) to run ping-pong open loop, with up to\n");
+    fprintf(stderr, "  AMBROSIA_PINGPONG_OUTSTANDING (default 1024, or 1 closed loop) in flight.\n");
+    fprintf(stderr, "  Set AMBROSIA_LATENCY_PROFILE=low (and optionally AMBROSIA_PROCESSING_CPU,\n");
+    fprintf(stderr, "  AMBROSIA_NETWORK_CPU, AMBROSIA_NUMA_NODE) to compare ping-pong latencies.\n");
     abort();
   }
 
+  if (g_pingpong_mode) {
+    if (roundsz >= 0) g_total_pingpongs = 1 << roundsz;
+    const char* rate = getenv("AMBROSIA_PINGPONG_RATE");
+    const char* outstanding = getenv("AMBROSIA_PINGPONG_OUTSTANDING");
+    if (rate != NULL) g_pingpong_rate = atof(rate);
+    // Open loop defaults to a generous limit, so that it is the
+    // system, not the limit, that holds pings back:
+    g_pingpong_outstanding = outstanding != NULL ? atoi(outstanding) :
+                             g_pingpong_rate > 0 ? 1024 : 1;
+    if (g_pingpong_outstanding < 1) {
+      fprintf(stderr, "\nERROR: AMBROSIA_PINGPONG_OUTSTANDING must be at least 1.\n");
+      abort();
+    }
+  }
+
   if (bytesPerRound <= maxMessageSize && !g_pingpong_mode) {
     fprintf(stderr, "\nERROR: Bytes-per-round should be bigger than max message size.\n");
     abort();
@@ -627,15 +748,11 @@ int main(int argc, char** argv)
   /* printf("  Ambrosia/bin/x64/Release/net46/LocalAmbrosiaRuntime.exe  native2 50002 50003 native2 logs/ nativetestbins a n y 1000 n 0 0\n"); */
   /* printf("(You need four ports, in the above example: 50000-50003 .)\n"); */
 
-  int upfd, downfd;
-  amb_connect_sockets(upport, downport, &upfd, &downfd);
-  amb_debug_log("Connections established (%d,%d), beginning protocol.\n", upfd, downfd);
-  amb_startup_protocol(upfd, downfd);
-
-  g_to_immortal_coord = upfd;
-  g_from_immortal_coord = downfd;
-
-  new_buffer(buffer_bytes_allocated);
+  // Connects, runs the startup protocol, and starts the network
+  // progress thread, applying any AMBROSIA_LATENCY_PROFILE settings:
+  amb_initialize_client_runtime(upport, downport, buffer_bytes_allocated);
+  int upfd = g_to_immortal_coord, downfd = g_from_immortal_coord;
+  amb_client_pin_processing_thread(amb_default_client());
   
   reset_trial_state();
 
@@ -644,27 +761,14 @@ int main(int argc, char** argv)
   printf(" *** SEND_ACK: %d\n", SEND_ACK);
   printf(" *** PREFILL: %d\n", PREFILL);
   printf(" *** PINGPONG mode: %d\n", g_pingpong_mode);  
+  if (g_pingpong_mode && g_is_sender)
+    printf(" *** PINGPONG rate: %.0lf/s (0 = closed loop), outstanding: %d\n",
+           g_pingpong_rate, g_pingpong_outstanding);
+  print_latency_profile(amb_client_latency_profile(amb_default_client()));
   printf(" *** startup: Beginning experiment, first trial of: %d.\n", g_trials_remaining);
   if ( g_is_sender || destLen == 0)
     printf("Bytes per RPC,  Throughput (GiB/sec),  Round-Time,  Round-Msgs\n");  
 
-#ifdef _WIN32
-  DWORD lpThreadId;
-  HANDLE th = CreateThread(NULL, 0,
-			   amb_network_progress_thread,
-			   NULL, 0,
-			   & lpThreadId);
-  if (th == NULL)
-#else
-  pthread_t th;
-  int res = pthread_create(& th, NULL, amb_network_progress_thread, NULL);
-  if (res != 0)
-#endif
-  {
-    fprintf(stderr, "ERROR: failed to create network progress thread.\n");
-    abort();
-  }
-
   while (g_trials_remaining > 0) {
     normal_processing_loop(upfd,downfd);
     reset_trial_state();
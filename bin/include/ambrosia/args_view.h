@@ -0,0 +1,105 @@
+
+// Zero-copy views over the argument bytes of a received RPC.
+//
+// A schema lists the field types of a method's arguments, in order.
+// amb_view_init walks the payload once, checking every varint and
+// length prefix against the payload bounds and recording where each
+// field starts.  After that, each accessor decodes only the field it
+// is asked for, and byte/string fields are returned as pointers into
+// the log record itself -- nothing is copied or allocated.
+//
+// Views point into the record being dispatched, so they are only
+// valid until the handler returns.
+
+#ifndef AMBROSIA_ARGS_VIEW_HEADER
+#define AMBROSIA_ARGS_VIEW_HEADER
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "ambrosia/client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The maximum number of fields a single schema can describe.
+#define AMB_VIEW_MAX_FIELDS 32
+
+// Field encodings, matching the wire formats in the client protocol:
+enum amb_field_type {
+  AMB_FIELD_INT32   = 0, // ZigZagInt, 1-5 bytes
+  AMB_FIELD_INT64   = 1, // ZigZagLong, 1-10 bytes
+  AMB_FIELD_FIXED32 = 2, // IntFixed, 4 bytes little endian
+  AMB_FIELD_FIXED64 = 3, // LongFixed, 8 bytes little endian
+  AMB_FIELD_BYTES   = 4, // ZigZagInt length followed by that many bytes
+  AMB_FIELD_REST    = 5  // All remaining bytes (last field only)
+};
+
+struct amb_args_view {
+  const char*    base;
+  int            len;
+  int            nfields;
+  const uint8_t* schema;
+  int32_t        offsets[AMB_VIEW_MAX_FIELDS];
+};
+
+// Validate a payload against a schema and index its fields.
+//
+// RETURN: 0 on success, -1 if the payload is malformed, truncated, has
+// trailing bytes, or the schema itself is invalid.
+int amb_view_init(struct amb_args_view* view, const uint8_t* schema, int nfields,
+                  void* args, int argsLen);
+
+// Field accessors.  The field index must be in range and of the type
+// named by the accessor; this is checked only in debug builds.
+
+static inline int32_t amb_view_int32(const struct amb_args_view* v, int field) {
+  assert(field < v->nfields && v->schema[field] == AMB_FIELD_INT32);
+  int32_t x;
+  read_zigzag_int((void*)(v->base + v->offsets[field]), &x);
+  return x;
+}
+
+static inline int64_t amb_view_int64(const struct amb_args_view* v, int field) {
+  assert(field < v->nfields && v->schema[field] == AMB_FIELD_INT64);
+  int64_t x;
+  read_zigzag_long((void*)(v->base + v->offsets[field]), &x);
+  return x;
+}
+
+static inline int32_t amb_view_fixed32(const struct amb_args_view* v, int field) {
+  assert(field < v->nfields && v->schema[field] == AMB_FIELD_FIXED32);
+  int32_t x;
+  memcpy(&x, v->base + v->offsets[field], 4);
+  return x;
+}
+
+static inline int64_t amb_view_fixed64(const struct amb_args_view* v, int field) {
+  assert(field < v->nfields && v->schema[field] == AMB_FIELD_FIXED64);
+  int64_t x;
+  memcpy(&x, v->base + v->offsets[field], 8);
+  return x;
+}
+
+// RETURN: a pointer to the field's bytes inside the record.
+// RETURN(param): the byte length of the field.
+static inline const char* amb_view_bytes(const struct amb_args_view* v, int field, int* len) {
+  assert(field < v->nfields &&
+         (v->schema[field] == AMB_FIELD_BYTES || v->schema[field] == AMB_FIELD_REST));
+  const char* start = v->base + v->offsets[field];
+  if (v->schema[field] == AMB_FIELD_REST) {
+    *len = v->len - v->offsets[field];
+    return start;
+  }
+  int32_t n;
+  const char* data = (const char*)read_zigzag_int((void*)start, &n);
+  *len = n;
+  return data;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
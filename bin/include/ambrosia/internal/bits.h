@@ -0,0 +1,91 @@
+// Small helpers and potentially reusable bits.
+
+
+// Internal helper: try repeatedly on a socket until all bytes are sent.
+// 
+// The Linux man pages are vague on when send on a (blocking) socket
+// can return less than the requested number of bytes.  This little
+// helper simply retries.
+//
+// RETURN: the number of send calls it took.
+static inline
+int amb_socket_send_all(int sock, const void* buf, size_t len, int flags) {
+  char* cur = (char*)buf;
+  int remaining = len;
+  int calls = 0;
+  while (remaining > 0) {
+    int n = send(sock, cur, remaining, flags);
+    calls++;
+    if (n < 0) {
+      char* err = amb_get_error_string();
+      fprintf(stderr,"\nERROR: failed send (%d bytes, of %d) which left errno = %s\n",
+	      remaining, (int)len, err);
+      abort();
+    }
+    cur += n;
+    remaining -= n;
+    if (remaining > 0)
+      amb_debug_log(" Warning: socket send didn't get all bytes across (%d of %d), retrying.\n", n, remaining);
+  }
+  return calls;
+}
+
+static inline
+void print_hex_bytes(FILE* fd, char* ptr, int len) {
+  const int limit = 100; // Only print this many:
+  fprintf(fd,"0x");
+  int j;
+  for (j=0; j < len && j < limit; j++) {
+    fprintf(fd,"%02hhx", (unsigned char)ptr[j]);
+    if (j % 2 == 1)
+      fprintf(fd," ");
+  }
+  if (j<len) fprintf(fd,"...");
+}
+
+void amb_sleep_seconds(double n);
+
+static inline
+#ifdef _WIN32
+double amb_current_time_seconds()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER current;
+    double result;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&current);
+    return (double)current.QuadPart / (double)frequency.QuadPart;
+}
+#else
+double amb_current_time_seconds() {
+  struct timespec current;
+  clock_gettime((clockid_t)CLOCK_REALTIME, &current);
+  // clock_gettime(0,NULL);  
+  return  (double)current.tv_sec + ((double)current.tv_nsec * 0.000000001);
+}
+#endif
+
+// Nanoseconds on a monotonic clock (for intervals, not wall time).
+static inline
+#ifdef _WIN32
+int64_t amb_monotonic_ns()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER current;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&current);
+    return (int64_t)((double)current.QuadPart * 1e9 / (double)frequency.QuadPart);
+}
+#else
+int64_t amb_monotonic_ns() {
+  struct timespec current;
+  clock_gettime(CLOCK_MONOTONIC, &current);
+  return (int64_t)current.tv_sec * 1000000000 + current.tv_nsec;
+}
+#endif
+
+#ifdef _WIN32
+  extern DWORD WINAPI amb_network_progress_thread( LPVOID lpParam );
+#else
+  extern void*        amb_network_progress_thread( void* lpParam );
+#endif
@@ -0,0 +1,131 @@
+
+// The private state of one client runtime (amb_client_t).
+//
+// Everything that used to be a process global lives here, so that one
+// process can host several independent immortals.
+
+#ifndef AMBROSIA_CLIENT_STATE_HEADER
+#define AMBROSIA_CLIENT_STATE_HEADER
+
+#include <stdint.h>
+#include "ambrosia/client.h"
+#include "ambrosia/internal/spsc_rring.h"
+#include "ambrosia/internal/continuations.h"
+#include "ambrosia/histogram.h"
+
+#ifndef _WIN32
+  #include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct amb_client {
+  // Connections to our ImmortalCoordinator:
+  int to_coord;
+  int from_coord;
+
+  // FIXME: looks like we need a hashtable after all...
+  int attached;  // For now, ONE destination.
+
+  // Whether the application is terminating this instance.
+  volatile int terminating;
+
+  // Outgoing bytes, drained by the network progress thread.  The
+  // default client uses the legacy global ring (g_rring).
+  struct spsc_rring* ring;
+
+  // The priority lane for control messages, drained ahead of the ring.
+  struct spsc_rring* control;
+
+  // Oversized reservations (see amb_client_reserve):
+  char* spill;
+  int   spill_cap;
+  int   spilling;   // Whether the outstanding reservation is in spill.
+
+  // Backpressure: the "writable again" callback, armed by a failed
+  // amb_try_reserve.
+  amb_writable_fn writable_fn;
+  void*           writable_arg;
+  int             low_watermark;
+  int             writable_armed;
+
+  // Continuations for outstanding async/await calls.  Lazily initialized.
+  struct amb_continuation_table continuations;
+
+  // Our own instance name, used as the return address for async/await calls.
+  char*   instance_name;
+  int32_t instance_name_len;
+
+  // The async/await call currently being dispatched (if any):
+  char*   current_sender;
+  int32_t current_sender_len;
+  int64_t current_callID;
+
+  // Event-loop integration mode (amb_client_initialize_polled): no
+  // network thread, and received bytes accumulate in inbuf until a
+  // complete log record is available.
+  int   polled;
+  char* inbuf;
+  int   inbuf_cap;
+  int   inbuf_len;
+
+  // Application callbacks:
+  amb_dispatch_fn   dispatch;
+  amb_checkpoint_fn checkpoint;
+  void*             user;
+
+  // Thread placement and socket tuning.  Lazily initialized (from the
+  // environment) unless set with amb_client_set_latency_profile.
+  struct amb_latency_profile profile;
+  int                        profile_set;
+
+  // When the network progress thread sends; same lazy initialization.
+  struct amb_flush_policy flush;
+  int                     flush_set;
+  struct amb_flush_stats  flush_stats; // Written only by the sending thread.
+
+  // Trimming the (elastic) ring after a quiet spell; written only by
+  // the ring's consumer.  A trim_usec of 0 disables it.
+  int     ring_trim_usec;
+  int64_t ring_idle_since;
+  int     ring_trimmed;
+
+  // Statistics (see struct amb_stats).  Receive side, written only by
+  // the processing thread:
+  int64_t recv_bytes;
+  int64_t recv_records;
+  int64_t recv_msgs;
+  int64_t recv_calls;
+  int64_t record_arrival; // When the record being dispatched was read (ns).
+  int64_t record_seq;     // And its seqID.
+  struct amb_histogram dispatch_latency;
+  // Written only by the sending thread:
+  int64_t yields;
+  struct stats_publisher* publisher; // NULL unless AMBROSIA_STATS_SHM is set.
+  // Written only by the ring's producer (through ring->stall_hist):
+  struct amb_histogram stall_latency;
+
+  // The network progress thread, if amb_client_initialize started it,
+  // and the flag that stops it (see amb_client_close).
+  int          network_started;
+  volatile int network_stop;
+#ifdef _WIN32
+  void*        network_thread; // HANDLE
+#else
+  pthread_t    network_thread;
+#endif
+
+  // The drain barrier (amb_client_flush): the producer bumps
+  // flush_requested, and the network thread copies it to flush_acked
+  // once it has found both rings empty.
+  volatile int64_t flush_requested;
+  volatile int64_t flush_acked;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+
+// Single-producer, single-consumer ring-buffer supporting
+// variable-sized byte range operations.
+
+// Each client runtime (amb_client_t) owns one ring.  The original
+// single-ring functions (new_buffer, reserve_buffer, ...) remain, and
+// operate on the ring of the default client.
+
+// An ELASTIC ring reserves address space for its maximum capacity up
+// front, but starts with a small logical capacity, so only the pages it
+// cycles through become resident.  The producer raises the capacity in
+// place when the buffered bytes approach it.  This is only done in the
+// natural (head <= tail) state, where the consumer never touches _end.
+// After a quiet period, the consumer can trim the ring: once a
+// handshake has excluded the producer, it resets the ring to its
+// initial capacity and hands the pages back to the OS.
+
+#ifndef SPSC_RRING_HEADER
+#define SPSC_RRING_HEADER
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct amb_histogram;
+
+struct spsc_rring {
+  char* buffer;
+  volatile int head;  // Byte offset into buffer, written by consumer.
+  volatile int tail;  // Byte offset into buffer, written by producer.
+  volatile int end;   // The current capacity, MODIFIED dynamically by PRODUCER.
+  int orig_end;       // The current capacity (written by the producer, or while trimming).
+  int last_reserved;  // The number of bytes in the last reserve call (producer-private)
+
+  // Elastic rings only (see above):
+  int elastic;
+  int initial_end;    // The capacity to start from, and to trim back to.
+  int max_end;        // The reserved address space.
+  volatile int reserving; // Producer: a reservation is outstanding.
+  volatile int trimming;  // Consumer: a trim is in progress.
+
+  // Statistics, written only by the producer (readers get a snapshot):
+  int64_t releases;   // Completed messages.
+  int64_t high_water; // The most bytes ever buffered.
+  int64_t stalls;     // Reservations that had to wait for space.
+  int64_t stall_ns;   // Total time spent waiting in them.
+  struct amb_histogram* stall_hist; // If set, records each stall (ns).
+};
+
+// Flags for rring_init_elastic:
+#define RRING_THP     1 // Ask for transparent huge pages (Linux).
+#define RRING_HUGETLB 2 // Try explicit huge pages, falling back to normal ones (Linux).
+
+// Buffer life cycle
+// ------------------------------------------------------------
+
+// Allocate the storage of a (zero-initialized) ring.
+void rring_init(struct spsc_rring* r, int sz);
+
+// Set up an elastic ring that starts at initial bytes and may grow to
+// max bytes.
+void rring_init_elastic(struct spsc_rring* r, int initial, int max, int flags);
+
+// (Consumer) Return an EMPTY elastic ring to its initial capacity and
+// release its pages.  Only call it after a quiet period: it backs off
+// if the producer is mid-reservation.
+//
+// RETURN: 1 if the ring was trimmed, 0 if not.
+int rring_trim(struct spsc_rring* r);
+
+// The largest capacity the ring can reach.
+int rring_max_capacity(struct spsc_rring* r);
+
+// Clear the buffer for reuse
+void rring_reset(struct spsc_rring* r);
+
+// Release the memory used by the buffer.
+void rring_free(struct spsc_rring* r);
+
+
+// Buffer operations
+//--------------------------------------------------------------------------------
+
+// (Consumer) Free N bytes from the ring buffer, marking them as consumed and
+// allowing the storage to be reused.
+void  rring_pop(struct spsc_rring* r, int numread);
+
+
+// (Consumer) Wait until a number of (contiguous) bytes is available within the
+// buffer, and write the pointer to those bytes into the pointer argument.
+//
+// This only reads in units of "complete messages", but it is UNKNOWN
+// how many complete messages are returned into the buffer.
+//
+// RETURN: the pointer P to the available bytes.
+// RETURN(param): set N to the (nonzero) number of bytes read.
+// POSTCOND: the permission to read N bytes from P
+// POSTCOND: the caller must use rring_pop(N) to actually
+//          free these bytes for reuse.
+//
+// IDEMPOTENT! Only pop actually clears the bytes.
+char* rring_peek(struct spsc_rring* r, int* numread);
+
+
+// (Producer) Grab a cursor for writing an (unspecified) number of bytes to the
+// tail of the buffer.  It's ok to RESERVE more than you ultimately USE.
+char* rring_reserve(struct spsc_rring* r, int len);
+
+// (Producer) Like rring_reserve, but return NULL instead of waiting for
+// the consumer to free up space.  Requests larger than the whole
+// buffer never succeed.
+char* rring_try_reserve(struct spsc_rring* r, int len);
+
+
+// (Producer) Add "len" bytes to the tail and release the buffer.
+// This number must be less than or equal to the amount reserved.
+//
+// ASSUMPTION: only call release to COMPLETE a message:
+void  rring_release(struct spsc_rring* r, int len);
+
+
+// (Either side) The number of bytes currently in the buffer.  Racy by
+// nature: only a snapshot.
+int   rring_used(struct spsc_rring* r);
+
+// (Producer) Account for ns spent waiting for space, for producers that
+// wait by other means than rring_reserve.
+void  rring_count_stall(struct spsc_rring* r, int64_t ns);
+
+
+// Legacy single-ring API (the default client's ring)
+//--------------------------------------------------------------------------------
+
+extern struct spsc_rring g_rring;
+
+void  new_buffer(int sz);
+void  reset_buffer();
+void  free_buffer();
+void  pop_buffer(int numread);
+char* peek_buffer(int* numread);
+char* reserve_buffer(int len);
+void  release_buffer(int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
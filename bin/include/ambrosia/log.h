@@ -0,0 +1,81 @@
+
+// Leveled, asynchronous diagnostic logging.
+//
+// A logging call does not format its message.  It checks the level,
+// then copies the format pointer and the raw argument values (and
+// the bytes of any %s strings) into the calling thread's own
+// lock-free buffer.  A background writer thread formats the records
+// and writes them out.  The hot path therefore never takes a lock,
+// never makes a system call and never waits for I/O.  That keeps
+// logging from perturbing the timing of whatever it is diagnosing.
+// If a thread's buffer is full, its message is dropped and counted.
+// It does not wait.
+//
+// The level is chosen at runtime.  Use AMBROSIA_LOG=error|warn|info|
+// debug|trace (or 0-5), or call amb_log_set_level.  The default is
+// warn, or debug in a library built with -DAMBCLIENT_DEBUG (make debug).
+// Below the level, a logging call costs one load and one branch.
+//
+// Formats must be string literals, or strings that outlive the
+// writer, because only their address is recorded.  All the usual
+// conversions are supported, apart from %n.  Each call produces one
+// line; a trailing newline is added if the format lacks one.
+
+#ifndef AMBROSIA_LOG_HEADER
+#define AMBROSIA_LOG_HEADER
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum amb_log_level {
+  AMB_LOG_OFF = 0,
+  AMB_LOG_ERROR,
+  AMB_LOG_WARN,
+  AMB_LOG_INFO,
+  AMB_LOG_DEBUG,
+  AMB_LOG_TRACE
+};
+
+// The current level: messages above it are discarded at the call site.
+extern volatile int amb_log_level;
+
+// (Any thread) Log a printf-style message at the given level.
+#define amb_log(level, ...) \
+  do { if ((level) <= amb_log_level) amb_log_write((level), __VA_ARGS__); } while (0)
+
+// (Any thread) Log a hex dump of len bytes, after the label.  Long
+// buffers are truncated.
+#define amb_log_hex(level, label, buf, len) \
+  do { if ((level) <= amb_log_level) amb_log_write_hex((level), (label), (buf), (len)); } while (0)
+
+// The functions behind the macros above, which check the level first.
+void amb_log_write(int level, const char* format, ...)
+#ifdef __GNUC__
+  __attribute__((format(printf, 2, 3)))
+#endif
+  ;
+void amb_log_write_hex(int level, const char* label, const void* buf, int len);
+
+void amb_log_set_level(int level);
+
+// Apply AMBROSIA_LOG (the level), AMBROSIA_LOG_FILE (where to write,
+// default stderr) and AMBROSIA_LOG_BUFFER (bytes of buffer per thread,
+// default 256 KiB).  Client initialization calls this.
+void amb_log_init_from_env();
+
+// (Any thread) Wait until every message logged before the call has
+// been written and flushed.  Messages are also flushed at exit.  They
+// are not flushed on abort(), so call this first to keep them.
+void amb_log_flush();
+
+// The number of messages dropped so far because a buffer was full.
+int64_t amb_log_dropped();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+
+// Binary event tracing: a flight recorder for the client runtime.
+//
+// Each thread writes fixed-size events (a timestamp counter reading,
+// an event ID, a log seqID and a size) into its own ring of the most
+// recent events, without locks.  amb_trace_dump writes all the rings
+// to a file, which bin/amb_trace.exe converts to Chrome trace JSON
+// (chrome://tracing, or ui.perfetto.dev), so that ring reservations,
+// network sends, log record arrivals and handler spans line up on one
+// timeline.
+//
+// Tracing is compiled in only with -DAMBROSIA_TRACE (make trace);
+// otherwise AMB_TRACE expands to nothing.  When compiled in, it is
+// still off until amb_trace_enable(1) or AMBROSIA_TRACE=1, and then
+// costs one predictable branch per event site.
+
+#ifndef AMBROSIA_TRACE_HEADER
+#define AMBROSIA_TRACE_HEADER
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Event IDs.  _BEGIN/_END pairs are spans on their thread; the rest
+// are instants.
+enum amb_trace_id {
+  AMB_TRACE_RESERVE = 1,         // Producer reserved ring space (size: bytes).
+  AMB_TRACE_RELEASE,             // Producer released a message (size: bytes).
+  AMB_TRACE_STALL_BEGIN,         // Producer waiting for ring space.
+  AMB_TRACE_STALL_END,
+  AMB_TRACE_PEEK,                // Sender found bytes in the ring (size: bytes).
+  AMB_TRACE_SEND_BEGIN,          // Sender writing to the socket (size: bytes).
+  AMB_TRACE_SEND_END,
+  AMB_TRACE_RECV_HDR,            // A log header arrived (seqID, size: record bytes).
+  AMB_TRACE_RECORD_BEGIN,        // Processing one log record (seqID).
+  AMB_TRACE_RECORD_END,
+  AMB_TRACE_DISPATCH_BEGIN,      // A handler (seqID of its record, size: args, aux: method ID).
+  AMB_TRACE_DISPATCH_END,
+  AMB_TRACE_CHECKPOINT_BEGIN,    // The checkpoint callback.
+  AMB_TRACE_CHECKPOINT_END,
+  AMB_TRACE_ID_COUNT,
+
+  AMB_TRACE_USER = 1024          // Applications may use IDs from here up.
+};
+
+// One event (24 bytes).
+struct amb_trace_event {
+  uint64_t tsc;    // Timestamp counter (or monotonic ns where there is none).
+  int64_t  seqID;  // The log record concerned, or 0.
+  uint32_t size;
+  uint16_t id;     // enum amb_trace_id
+  uint16_t aux;    // Event specific: the (low 16 bits of the) method ID for dispatches.
+};
+
+extern volatile int amb_trace_on;
+
+// (Any thread) Append an event to the calling thread's ring.  Use the
+// AMB_TRACE macro rather than calling this directly.
+void amb_trace_record(uint16_t id, int64_t seqID, uint32_t size, uint16_t aux);
+
+#ifdef AMBROSIA_TRACE
+  #define AMB_TRACE(id, seqID, size, aux) \
+    do { if (amb_trace_on) amb_trace_record((id), (seqID), (uint32_t)(size), (uint16_t)(aux)); } while (0)
+  #define AMB_TRACE_THREAD(name) amb_trace_thread_name(name)
+#else
+  #define AMB_TRACE(id, seqID, size, aux) do { } while (0)
+  #define AMB_TRACE_THREAD(name) do { } while (0)
+#endif
+
+// Turn recording on or off, process wide.
+void amb_trace_enable(int on);
+
+// Apply AMBROSIA_TRACE (1 to start recording), AMBROSIA_TRACE_EVENTS
+// (the per-thread ring size, default 65536 events) and
+// AMBROSIA_TRACE_FILE (dump there at exit).  Client initialization
+// calls this.
+void amb_trace_init_from_env();
+
+// Name the calling thread in the trace.
+void amb_trace_thread_name(const char* name);
+
+// Write every thread's recent events to a file.  Threads may keep
+// recording meanwhile; events written during the dump may be torn.
+//
+// RETURN: the number of events written, or -1 on an I/O error.
+int64_t amb_trace_dump(const char* path);
+
+
+// The dump format: a file header, then for each thread a thread
+// header followed by its events, oldest first.  Timestamps convert to
+// nanoseconds by the two (tsc, ns) calibration points.
+#define AMB_TRACE_MAGIC 0x54424d41 // "AMBT"
+
+struct amb_trace_file_hdr {
+  uint32_t magic;
+  uint32_t version;  // 1
+  uint64_t tsc0;     // Calibration: when tracing was first enabled...
+  int64_t  ns0;
+  uint64_t tsc1;     // ... and at the dump.
+  int64_t  ns1;
+  uint32_t threads;
+  uint32_t reserved;
+};
+
+struct amb_trace_thread_hdr {
+  char     name[24];
+  int64_t  tid;
+  uint64_t count;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -86,6 +86,17 @@ ln -s unsafedereg/UnsafeDeregisterInstance
 popd
 set +x
 
+if [ "$UNAME" == Linux ]; then
+    echo
+    echo "Building adv-file-ops native library (Linux)"
+    echo "------------------------------------"
+    set -x
+    make -C Ambrosia/adv-file-ops
+    make -C Ambrosia/adv-file-ops publish DEST=$OUTDIR/runtime
+    make -C Ambrosia/adv-file-ops publish DEST=$OUTDIR/coord
+    set +x
+fi
+
 echo 
 echo "Building C# client tools"
 echo "----------------------------------------"